@@ -0,0 +1,186 @@
+/*
+ * bitsbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures the bit packing kernels behind SeaMaxLinReadBits and
+ * SeaMaxLinWriteBits: unpacking coils or discrete inputs to a byte per
+ * channel, and packing them back, for a 96 channel PIO module and for a
+ * whole 2000 bit MODBUS read.  Every kernel this processor can run is first
+ * checked against the portable one, and left out if it disagrees.  Last, a
+ * 96 coil read from the in-process loopback module is timed both ways:
+ * SeaMaxLinRead followed by a loop over the bits, and SeaMaxLinReadBits.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o bitsbench bitsbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./bitsbench [iterations]   (default 1000000)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "seamaxlin.h"
+
+static const char *names[] = { "auto", "scalar", "sse2", "avx2", "bmi2" };
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Check a kernel against the portable one, over odd lengths too
+static int check(seamax_bits_t kernel)
+{
+	unsigned char packed[256], bits[2048], expect[2048], repacked[256];
+	unsigned char want[256];
+	int trial, count, index, bad = 0;
+
+	for (trial = 0; trial < 2000; trial++)
+	{
+		count = trial % 2001;
+		for (index = 0; index < sizeof(packed); index++)
+			packed[index] = rand();
+
+		SeaMaxLinSetBitKernel(SEAMAX_BITS_SCALAR);
+		SeaMaxLinUnpackBits(packed, expect, count);
+		SeaMaxLinSetBitKernel(kernel);
+		memset(bits, 0xEE, sizeof(bits));
+		SeaMaxLinUnpackBits(packed, bits, count);
+		if (memcmp(bits, expect, count) != 0 || bits[count] != 0xEE) bad++;
+
+		//Any byte that isn't zero is on
+		for (index = 0; index < count; index++)
+			bits[index] = (rand() & 1) ? rand() | 1 : 0;
+		SeaMaxLinSetBitKernel(SEAMAX_BITS_SCALAR);
+		SeaMaxLinPackBits(bits, want, count);
+		SeaMaxLinSetBitKernel(kernel);
+		memset(repacked, 0xEE, sizeof(repacked));
+		SeaMaxLinPackBits(bits, repacked, count);
+		if (memcmp(repacked, want, (count + 7) / 8) != 0 ||
+			repacked[(count + 7) / 8] != 0xEE) bad++;
+	}
+	return bad;
+}
+
+static void bench(int count, int iterations)
+{
+	unsigned char packed[256], bits[2048];
+	int kernel, index;
+	double start, unpack, pack;
+
+	for (index = 0; index < sizeof(packed); index++) packed[index] = rand();
+
+	printf("%d channels\n", count);
+	for (kernel = SEAMAX_BITS_SCALAR; kernel <= SEAMAX_BITS_BMI2; kernel++)
+	{
+		if (SeaMaxLinSetBitKernel(kernel) < 0) continue;
+		if (check(kernel) != 0)
+		{
+			printf("  %-8s WRONG\n", names[kernel]);
+			continue;
+		}
+		SeaMaxLinSetBitKernel(kernel);
+
+		start = now_ns();
+		for (index = 0; index < iterations; index++)
+		{
+			packed[0] ^= index;
+			SeaMaxLinUnpackBits(packed, bits, count);
+		}
+		unpack = (now_ns() - start) / iterations;
+
+		start = now_ns();
+		for (index = 0; index < iterations; index++)
+		{
+			bits[0] ^= index;
+			SeaMaxLinPackBits(bits, packed, count);
+		}
+		pack = (now_ns() - start) / iterations;
+
+		printf("  %-8s unpack %8.1f ns   pack %8.1f ns\n",
+			names[kernel], unpack, pack);
+	}
+	printf("\n");
+}
+
+int main(int argc, char * argv[])
+{
+	SeaMaxLin *module = SeaMaxLinCreate();
+	char name[] = "sealevel_loop://rtu";
+	unsigned char packed[12], bits[96];
+	int iterations = 1000000, index, channel, on = 0;
+	double start, loop, unpacked;
+
+	if (argc > 1) iterations = atoi(argv[1]);
+	if (iterations < 1) iterations = 1;
+
+	printf("auto picks %s\n\n", names[SeaMaxLinSetBitKernel(SEAMAX_BITS_AUTO)]);
+	bench(96, iterations);
+	bench(2000, iterations / 10);
+
+	if (SeaMaxLinOpen(module, name) < 0)
+	{
+		fprintf(stderr, "can't open %s\n", name);
+		return 1;
+	}
+	for (index = 0; index < 96; index++) bits[index] = index % 3 == 0;
+	SeaMaxLinSetBitKernel(SEAMAX_BITS_AUTO);
+	SeaMaxLinWriteBits(module, 1, 1, 96, bits);
+
+	start = now_ns();
+	for (index = 0; index < iterations / 10; index++)
+	{
+		SeaMaxLinRead(module, 1, COILS, 1, 96, packed);
+		for (channel = 0; channel < 96; channel++)
+			bits[channel] = (packed[channel / 8] >> (channel % 8)) & 1;
+		on += bits[index % 96];
+	}
+	loop = (now_ns() - start) / (iterations / 10);
+
+	start = now_ns();
+	for (index = 0; index < iterations / 10; index++)
+	{
+		SeaMaxLinReadBits(module, 1, COILS, 1, 96, bits);
+		on += bits[index % 96];
+	}
+	unpacked = (now_ns() - start) / (iterations / 10);
+
+	printf("96 coils from the loopback module (%d on)\n", on);
+	printf("  SeaMaxLinRead + loop  %8.1f ns\n", loop);
+	printf("  SeaMaxLinReadBits     %8.1f ns\n", unpacked);
+
+	SeaMaxLinClose(module);
+	SeaMaxLinDestroy(module);
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * broadcastbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures updating the same holding register on every device
+ * of a Modbus RTU bus: one SeaMaxLinWrite per device, against a single
+ * SeaMaxLinBroadcast.  Each update is followed by reading one device back,
+ * so the broadcast's turnaround is paid for in the time measured.  Both are
+ * run with each I/O engine (see SeaMaxLinSetIoBackend).
+ *
+ * The bus is a pseudo-terminal with a forked process on the far end playing
+ * every device.  It holds each reply for as long as the request and reply
+ * would take on the wire at the given baud rate, plus a fixed turnaround, and
+ * takes a broadcast in for as long as it would take to arrive.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o broadcastbench broadcastbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./broadcastbench [devices [cycles [baud [turnaround_ms]]]]
+ *        (default 30 devices, 5 cycles, 9600 baud, 5 ms turnaround)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "seamaxlin.h"
+
+static int devices = 30, baud = 9600, turnaround = 5;
+
+// Length of an RTU request, once enough of it is in to tell
+static int requestLength(unsigned char *request, int length)
+{
+	if (length < 2) return 0;
+	if (request[1] == 0x10) return (length < 7) ? 0 : 9 + request[6];
+	return 8;
+}
+
+// Sleep for as long as the given bytes take on the wire, and then some
+static void pace(int bytes, int extra_ms)
+{
+	struct timespec wire;
+	long long ns = bytes * 10 * 1000000000LL / baud + extra_ms * 1000000LL;
+
+	wire.tv_sec = ns / 1000000000;
+	wire.tv_nsec = ns % 1000000000;
+	nanosleep(&wire, NULL);
+}
+
+// Every device of the bus, each with one holding register
+static void serve(int master)
+{
+	unsigned short registers[256] = { 0 };
+	unsigned char request[300], reply[8];
+	int length = 0, incoming, size, slave, index;
+
+	for (;;)
+	{
+		incoming = read(master, &request[length], sizeof(request) - length);
+		if (incoming <= 0) _exit(0);
+		length += incoming;
+		if ((size = requestLength(request, length)) == 0 || length < size)
+			continue;
+		length = 0;
+
+		slave = request[0];
+		if (slave > devices) continue;
+		if (request[1] == 0x06 || request[1] == 0x10)
+		{
+			index = (request[1] == 0x06) ? 4 : 7;
+			if (slave == 0)
+			{
+				//Everyone takes it; no one answers
+				for (slave = 1; slave <= devices; slave++)
+					registers[slave] = (request[index] << 8) |
+						request[index + 1];
+				pace(size, 0);
+				continue;
+			}
+			registers[slave] = (request[index] << 8) | request[index + 1];
+			memcpy(reply, request, 6);
+			size = 6;
+		}
+		else
+		{
+			reply[0] = slave;
+			reply[1] = request[1];
+			reply[2] = 2;
+			reply[3] = registers[slave] >> 8;
+			reply[4] = registers[slave];
+			size = 5;
+		}
+		calc_crc(size, reply);
+		pace(8 + size + 2, turnaround);
+		write(master, reply, size + 2);
+	}
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void bench(const char *name, SeaMaxLin *bus, int broadcast,
+	int cycles)
+{
+	unsigned char value[2], check[2];
+	int cycle, slave, failed = 0, wrong = 0;
+	double start, elapsed;
+
+	start = now_ms();
+	for (cycle = 0; cycle < cycles; cycle++)
+	{
+		value[0] = broadcast;
+		value[1] = cycle;
+		if (broadcast)
+		{
+			if (SeaMaxLinBroadcast(bus, HOLDINGREG, 1, 1, value) < 0)
+				failed++;
+		}
+		else for (slave = 1; slave <= devices; slave++)
+		{
+			if (SeaMaxLinWrite(bus, slave, HOLDINGREG, 1, 1, value) < 0)
+				failed++;
+		}
+
+		//The last device shows whether everyone got it
+		if (SeaMaxLinRead(bus, devices, HOLDINGREG, 1, 1, check) < 0)
+			failed++;
+		else if (memcmp(value, check, 2) != 0) wrong++;
+	}
+	elapsed = now_ms() - start;
+
+	printf("%-28s %8.1f ms/update %d failed %d wrong\n", name,
+		elapsed / cycles, failed, wrong);
+}
+
+int main(int argc, char * argv[])
+{
+	static const char *engines[] = { "direct", "epoll", "io_uring" };
+	SeaMaxLin *buses[3];
+	struct termios raw;
+	char name[64], label[64];
+	int master, cycles = 5, delay, engine, used[3];
+	pid_t child;
+
+	if (argc > 1) devices = atoi(argv[1]);
+	if (argc > 2) cycles = atoi(argv[2]);
+	if (argc > 3) baud = atoi(argv[3]);
+	if (argc > 4) turnaround = atoi(argv[4]);
+	if (devices < 1 || devices > 247) devices = 30;
+	if (cycles < 1) cycles = 1;
+	if (baud < 1200) baud = 1200;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+	{
+		perror("posix_openpt");
+		return 1;
+	}
+	tcgetattr(master, &raw);
+	cfmakeraw(&raw);
+	tcsetattr(master, TCSANOW, &raw);
+	snprintf(name, sizeof(name), "sealevel_rtu:/%s", ptsname(master));
+
+	//The bus is opened once per engine, all before the master is let go
+	if ((child = fork()) == 0) serve(master);
+	for (engine = SEAMAX_IO_DIRECT; engine <= SEAMAX_IO_URING; engine++)
+	{
+		used[engine] = SeaMaxLinSetIoBackend(engine);
+		buses[engine] = SeaMaxLinCreate();
+		if (SeaMaxLinOpen(buses[engine], name) < 0)
+		{
+			fprintf(stderr, "can't open %s\n", name);
+			return 1;
+		}
+	}
+	close(master);
+
+	printf("%d devices at %d baud, %d ms device turnaround\n", devices,
+		baud, turnaround);
+	for (engine = SEAMAX_IO_DIRECT; engine <= SEAMAX_IO_URING; engine++)
+	{
+		printf("\n%s engine\n", engines[used[engine]]);
+		bench("SeaMaxLinWrite to each", buses[engine], 0, cycles);
+		for (delay = 200; delay >= 50; delay /= 2)
+		{
+			SeaMaxLinSetTurnaround(buses[engine], delay);
+			snprintf(label, sizeof(label), "SeaMaxLinBroadcast, %d ms",
+				delay);
+			bench(label, buses[engine], 1, cycles);
+		}
+	}
+
+	for (engine = SEAMAX_IO_DIRECT; engine <= SEAMAX_IO_URING; engine++)
+	{
+		SeaMaxLinClose(buses[engine]);
+		SeaMaxLinDestroy(buses[engine]);
+	}
+	kill(child, SIGTERM);
+	waitpid(child, NULL, 0);
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * exchangebench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures a write-outputs, read-inputs step on the bit bang
+ * SeaDAC Lite models against the stub libftdi in ftdistub.c: as a
+ * SeaDacLinWrite followed by a SeaDacLinRead, as a one step
+ * SeaDacLinExchange, and as steps of a longer SeaDacLinExchange sweep.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -shared -fPIC -o libftdi.so ftdistub.c
+ *   gcc -O2 -I../seadac_lib/source_files -o exchangebench exchangebench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: FTDISTUB_PRODUCT=8111 LD_LIBRARY_PATH=. ./exchangebench [steps [device]]
+ *        (default 100000 steps on "sealevel_d2x://8111")
+ *
+ * FTDISTUB_PRODUCT has the stub list a module of the model benchmarked.
+ * Set FTDISTUB_LATENCY_US to give every USB transfer a cost.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <termios.h>
+#include <time.h>
+
+#include "seamaxlin.h"
+
+#define SWEEP_STEPS	1000
+
+static unsigned long *writes, *reads;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, long steps, unsigned long transfers,
+		   double start)
+{
+	printf("%-28s %8ld steps %6.3f transfers %9.1f ns/step\n", name, steps,
+		(double)transfers / steps, (now_ns() - start) / steps);
+}
+
+int main(int argc, char * argv[])
+{
+	char *device = "sealevel_d2x://8111";
+	unsigned char out[SWEEP_STEPS], data[SWEEP_STEPS];
+	unsigned long transfers;
+	SeaMaxLin *module;
+	void *stub;
+	long steps = 100000, n;
+	double start;
+	int ret;
+
+	if (argc > 1) steps = atol(argv[1]);
+	if (steps < SWEEP_STEPS) steps = SWEEP_STEPS;
+	if (argc > 2) device = argv[2];
+
+	module = SeaMaxLinCreate();
+	ret = SeaMaxLinOpen(module, device);
+	if (ret < 0)
+	{
+		fprintf(stderr, "open failed (%d); is LD_LIBRARY_PATH=. set?\n", ret);
+		return 1;
+	}
+
+	stub = dlopen("libftdi.so", RTLD_LAZY | RTLD_NOLOAD);
+	writes = stub ? dlsym(stub, "ftdistub_writes") : NULL;
+	reads = stub ? dlsym(stub, "ftdistub_reads") : NULL;
+	if (!writes || !reads)
+	{
+		fprintf(stderr, "libftdi.so is not the ftdistub library\n");
+		return 1;
+	}
+
+	for (n = 0; n < SWEEP_STEPS; n++) out[n] = (n << 4) & 0xF0;
+
+	transfers = *writes + *reads;
+	start = now_ns();
+	for (n = 0; n < steps; n++)
+	{
+		SeaDacLinWrite(module, &out[n % SWEEP_STEPS], 1);
+		SeaDacLinRead(module, &data[0], 1);
+	}
+	report("SeaDacLinWrite + Read", steps, *writes + *reads - transfers, start);
+
+	transfers = *writes + *reads;
+	start = now_ns();
+	for (n = 0; n < steps; n++)
+		SeaDacLinExchange(module, &out[n % SWEEP_STEPS], &data[0], 1);
+	report("SeaDacLinExchange, 1 step", steps, *writes + *reads - transfers, start);
+
+	transfers = *writes + *reads;
+	start = now_ns();
+	for (n = 0; n < steps; n += SWEEP_STEPS)
+		SeaDacLinExchange(module, out, data, SWEEP_STEPS);
+	report("SeaDacLinExchange, sweep", steps, *writes + *reads - transfers, start);
+
+	SeaMaxLinClose(module);
+	SeaMaxLinDestroy(module);
+	return 0;
+}
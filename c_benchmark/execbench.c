@@ -0,0 +1,259 @@
+/*
+ * execbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures the multi-bus executor (SeaMaxExecutorCreate) on
+ * simulated RS-485 buses.  Each bus is a pseudo-terminal with a forked
+ * process on the far end answering Modbus RTU reads of holding registers,
+ * holding each reply for as long as the request and reply would take on the
+ * wire at the given baud rate.  For 1 to 16 buses it reports the aggregate
+ * transactions per second of one thread reading the buses in turn, as
+ * application code does today, and of the executor keeping every bus busy,
+ * with the mean bus utilisation.
+ *
+ * A last case has one bus whose callbacks block for 5 ms, as a slow
+ * consumer would, and compares one callback worker with four: with four,
+ * the other workers take the remaining buses' callbacks from the blocked
+ * worker's deque and those buses keep their pace.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o execbench execbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./execbench [seconds [baud]]
+ *        (default 2 seconds per case, 115200 baud)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "seamaxlin.h"
+
+#define BUSES		16
+#define REGISTERS	4
+#define IN_FLIGHT	4
+
+// A Modbus RTU slave on a pty, paced as if on the wire at baud
+static void serve(int master, int baud)
+{
+	unsigned char request[256], reply[256];
+	struct timespec wire;
+	int length = 0, incoming, quantity, index;
+
+	for (;;)
+	{
+		incoming = read(master, &request[length], sizeof(request) - length);
+		if (incoming <= 0) _exit(0);
+		length += incoming;
+		if (length < 8) continue;
+
+		quantity = (request[4] << 8) | request[5];
+		if (quantity > 125) quantity = 125;
+		reply[0] = request[0];
+		reply[1] = 0x03;
+		reply[2] = quantity * 2;
+		for (index = 0; index < quantity * 2; index++)
+			reply[3 + index] = index;
+		calc_crc(3 + quantity * 2, reply);
+
+		// Ten bits a byte, request in and reply out
+		wire.tv_sec = 0;
+		wire.tv_nsec = (8 + 5 + quantity * 2) * 10 * 1000000000LL / baud;
+		nanosleep(&wire, NULL);
+		write(master, reply, 5 + quantity * 2);
+		length = 0;
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// One request kept going round its bus until the run ends
+typedef struct pending_s
+{
+	seamax_op_s op;
+	unsigned char data[REGISTERS * 2];
+	SeaMaxExecutor *executor;
+	int slow;
+} pending_s;
+
+static int running;
+
+static void resubmit(seamax_op_s *op, void *context)
+{
+	pending_s *pending = (pending_s*)context;
+
+	if (pending->slow) usleep(5000);
+	if (__atomic_load_n(&running, __ATOMIC_RELAXED))
+		SeaMaxExecutorSubmit(pending->executor, op, resubmit, pending);
+}
+
+static double sequential(SeaMaxLin **modules, int buses, double seconds)
+{
+	unsigned char data[REGISTERS * 2];
+	double start = now_ns();
+	long count = 0;
+	int index;
+
+	while (now_ns() < start + seconds * 1e9)
+		for (index = 0; index < buses; index++, count++)
+			SeaMaxLinRead(modules[index], 1, HOLDINGREG, 1, REGISTERS, data);
+
+	return count / ((now_ns() - start) / 1e9);
+}
+
+static double executor(SeaMaxLin **modules, int buses, int workers, int slow,
+	double seconds, double *utilisation, double *fastest)
+{
+	static pending_s pending[BUSES * IN_FLIGHT];
+	SeaMaxExecutor *executor = SeaMaxExecutorCreate(workers);
+	seamax_bus_stats_s stats;
+	unsigned long long total = 0;
+	double start;
+	int index;
+
+	for (index = 0; index < buses; index++)
+		SeaMaxExecutorAddBus(executor, modules[index]);
+
+	__atomic_store_n(&running, 1, __ATOMIC_RELAXED);
+	start = now_ns();
+	for (index = 0; index < buses * IN_FLIGHT; index++)
+	{
+		memset(&pending[index], 0, sizeof(pending_s));
+		pending[index].op.module = modules[index % buses];
+		pending[index].op.slaveId = 1;
+		pending[index].op.type = HOLDINGREG;
+		pending[index].op.starting_address = 1;
+		pending[index].op.range = REGISTERS;
+		pending[index].op.data = pending[index].data;
+		pending[index].executor = executor;
+		pending[index].slow = slow && (index % buses) == 0;
+		SeaMaxExecutorSubmit(executor, &pending[index].op, resubmit,
+			&pending[index]);
+	}
+
+	usleep(seconds * 1e6);
+	__atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+	SeaMaxExecutorWait(executor);
+
+	*utilisation = 0;
+	*fastest = 0;
+	for (index = 0; index < buses; index++)
+	{
+		SeaMaxExecutorBusStats(executor, index, &stats);
+		total += stats.completed - stats.failed;
+		*utilisation += stats.utilisation / buses;
+		if (index > 0 && stats.completed > *fastest) *fastest = stats.completed;
+	}
+	*fastest /= (now_ns() - start) / 1e9;
+
+	SeaMaxExecutorDestroy(executor);
+	return total / ((now_ns() - start) / 1e9);
+}
+
+int main(int argc, char * argv[])
+{
+	SeaMaxLin *modules[BUSES];
+	pid_t children[BUSES];
+	struct termios raw;
+	char device[64];
+	double seconds = 2, one = 0, rate, utilisation, fastest;
+	int baud = 115200, buses, index, master;
+
+	if (argc > 1) seconds = atof(argv[1]);
+	if (argc > 2) baud = atoi(argv[2]);
+	if (baud < 1200) baud = 1200;
+
+	for (index = 0; index < BUSES; index++)
+	{
+		master = posix_openpt(O_RDWR | O_NOCTTY);
+		if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+		{
+			perror("posix_openpt");
+			return 1;
+		}
+		tcgetattr(master, &raw);
+		cfmakeraw(&raw);
+		tcsetattr(master, TCSANOW, &raw);
+		snprintf(device, sizeof(device), "sealevel_rtu:/%s", ptsname(master));
+
+		if ((children[index] = fork()) == 0) serve(master, baud);
+		modules[index] = SeaMaxLinCreate();
+		if (SeaMaxLinOpen(modules[index], device) < 0)
+		{
+			fprintf(stderr, "can't open %s\n", device);
+			return 1;
+		}
+		close(master);
+	}
+
+	printf("%d registers a read at %d baud, %.1f s per case\n\n",
+		REGISTERS, baud, seconds);
+	printf("buses  one thread   executor  speedup  utilisation\n");
+	for (buses = 1; buses <= BUSES; buses *= 2)
+	{
+		rate = executor(modules, buses, 0, 0, seconds, &utilisation, &fastest);
+		if (buses == 1) one = rate;
+		printf("%5d  %8.0f/s  %8.0f/s  %6.2fx  %9.1f%%\n", buses,
+			sequential(modules, buses, seconds), rate, rate / one,
+			utilisation * 100);
+	}
+
+	printf("\n%d buses, bus 0 callbacks blocking 5 ms:\n", BUSES);
+	for (index = 1; index <= 4; index *= 4)
+	{
+		rate = executor(modules, BUSES, index, 1, seconds, &utilisation,
+			&fastest);
+		printf("%d worker%s  %8.0f/s total  %6.0f/s busiest other bus  "
+			"%5.1f%% mean utilisation\n", index, index > 1 ? "s" : " ",
+			rate, fastest, utilisation * 100);
+	}
+
+	for (index = 0; index < BUSES; index++)
+	{
+		SeaMaxLinClose(modules[index]);
+		SeaMaxLinDestroy(modules[index]);
+		kill(children[index], SIGTERM);
+		waitpid(children[index], NULL, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * ftdistub.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * A stand-in for libftdi.so with no hardware behind it.  Every write is
+ * accepted and every read returns the requested number of zero bytes (an
+ * I2C ACK on the 8126), except that the MPSSE "bad command" reply is given
+ * to an 0xAA probe, and synchronous bit bang mode returns the pins as they
+ * were before each byte written, so the library's FTDI paths can be timed
+ * and their USB traffic counted on any machine.  Each transfer can be made to cost a
+ * fixed time to stand in for the USB round trip.  The stub is an H series
+ * chip; with FTDISTUB_CHIP=D it is an older one, rejecting 0x8A (divide by 5
+ * off) with a bad command reply as well.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -shared -fPIC -o libftdi.so ftdistub.c
+ *
+ * then run a benchmark with LD_LIBRARY_PATH=. so it is picked up instead of
+ * the real library.  FTDISTUB_LATENCY_US sets the cost of each transfer.
+ * With FTDISTUB_LATENCY_TIMER=1, a read shorter than a USB packet also waits
+ * out the chip's latency timer (16 ms unless set), as real hardware does, and
+ * bad command replies are held back that long after the write, reading as
+ * nothing until then.
+ * FTDISTUB_DEVICES modules (default 1) of each model in FTDISTUB_PRODUCT
+ * (default 8126, or a list such as 8111,8126) are listed, with serial numbers
+ * STUB0000, STUB0001 and so on.
+ * Setting ftdistub_fail_writes (with dlsym) to n fails the next n writes,
+ * as if the module had been unplugged.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+// Traffic counters, read by the benchmarks with dlsym().
+unsigned long ftdistub_writes = 0;
+unsigned long ftdistub_reads = 0;
+unsigned long ftdistub_bytes_written = 0;
+unsigned long ftdistub_bytes_read = 0;
+
+// Writes still to fail, and the opens done, also reached with dlsym()
+int ftdistub_fail_writes = 0;
+unsigned long ftdistub_opens = 0;
+
+static int latency = -1;
+
+// A listed module, as libusb-1.0 hands it out under libftdi 1.x
+struct stub_device
+{
+	int number;
+};
+
+struct ftdi_device_list
+{
+	struct ftdi_device_list *next;
+	struct stub_device *dev;
+};
+
+// What the stub keeps per ftdi context
+struct stub_context
+{
+	unsigned char replies[16];	// Bad command replies to be read ...
+	int replyCount;
+	unsigned long long replyAt;	// ... from this time (ns)
+	int mode;			// Bit mode last set
+	unsigned char pins;		// Last byte written
+	int pending;			// Synchronous bit bang samples to read
+	int latency;			// Latency timer (ms), 0 for the default
+	unsigned char samples[4096];
+};
+
+static void transfer(void)
+{
+	char *value;
+
+	if (latency < 0)
+	{
+		value = getenv("FTDISTUB_LATENCY_US");
+		latency = value ? atoi(value) : 0;
+	}
+	if (latency > 0) usleep(latency);
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Is the latency timer to be waited out?
+static int latencyTimer(void)
+{
+	char *value = getenv("FTDISTUB_LATENCY_TIMER");
+	return value && atoi(value);
+}
+
+// Is this an older chip than the H series?
+static int olderChip(void)
+{
+	char *value = getenv("FTDISTUB_CHIP");
+	return value && strcmp(value, "D") == 0;
+}
+
+void *ftdi_new(void)
+{
+	return calloc(1, sizeof(struct stub_context));
+}
+
+void ftdi_free(void *ftdi)
+{
+	free(ftdi);
+}
+
+int ftdi_init(void *ftdi)
+{
+	return 0;
+}
+
+void ftdi_deinit(void *ftdi)
+{
+}
+
+int ftdi_usb_open(void *ftdi, int vendor, int product)
+{
+	ftdistub_opens++;
+	return 0;
+}
+
+int ftdi_usb_find_all(void *ftdi, struct ftdi_device_list **devlist,
+		      int vendor, int product)
+{
+	char *list = getenv("FTDISTUB_PRODUCT"), *end, *value;
+	int count, index, slot;
+
+	*devlist = NULL;
+	for (list = list ? list : "8126", slot = 0; ; list = end + 1, slot++)
+	{
+		if (strtol(list, &end, 16) == product) break;
+		if (*end != ',') return 0;
+	}
+
+	value = getenv("FTDISTUB_DEVICES");
+	count = value ? atoi(value) : 1;
+	for (index = count - 1; index >= 0; index--)
+	{
+		struct ftdi_device_list *node = calloc(1, sizeof(*node));
+		node->dev = calloc(1, sizeof(struct stub_device));
+		node->dev->number = slot * count + index;
+		node->next = *devlist;
+		*devlist = node;
+	}
+	return count;
+}
+
+void ftdi_list_free(struct ftdi_device_list **devlist)
+{
+	struct ftdi_device_list *node;
+
+	while ((node = *devlist) != NULL)
+	{
+		*devlist = node->next;
+		free(node->dev);
+		free(node);
+	}
+}
+
+int ftdi_usb_get_strings(void *ftdi, struct stub_device *dev,
+			 char *manufacturer, int mnf_len, char *description,
+			 int desc_len, char *serial, int serial_len)
+{
+	if (manufacturer) snprintf(manufacturer, mnf_len, "Sealevel");
+	if (description) snprintf(description, desc_len, "ftdistub");
+	if (serial) snprintf(serial, serial_len, "STUB%04d", dev->number);
+	return 0;
+}
+
+// Tells the library that the devices are libusb-1.0 ones
+int ftdi_get_library_version(void)
+{
+	return 1;
+}
+
+unsigned char libusb_get_bus_number(struct stub_device *dev)
+{
+	return 1;
+}
+
+unsigned char libusb_get_device_address(struct stub_device *dev)
+{
+	return dev->number + 2;
+}
+
+int ftdi_usb_open_dev(void *ftdi, struct stub_device *dev)
+{
+	ftdistub_opens++;
+	return 0;
+}
+
+int ftdi_usb_close(void *ftdi)
+{
+	return 0;
+}
+
+int ftdi_usb_purge_buffers(void *ftdi)
+{
+	((struct stub_context *)ftdi)->pending = 0;
+	((struct stub_context *)ftdi)->replyCount = 0;
+	return 0;
+}
+
+int ftdi_write_data(void *ftdi, unsigned char *buf, int size)
+{
+	struct stub_context *context = ftdi;
+	int index;
+
+	transfer();
+	if (ftdistub_fail_writes > 0)
+	{
+		ftdistub_fail_writes--;
+		return -1;
+	}
+	// Answer a readiness probe, or 0x8A on an older chip, as MPSSE would
+	if (size == 1 && (buf[0] == 0xAA || (buf[0] == 0x8A && olderChip())) &&
+		context->replyCount + 2 <= (int)sizeof(context->replies))
+	{
+		context->replies[context->replyCount++] = 0xFA;
+		context->replies[context->replyCount++] = buf[0];
+		context->replyAt = now_ns() + (latencyTimer() ?
+			(context->latency ? context->latency : 16) * 1000000ULL : 0);
+	}
+	for (index = 0; index < size; index++)
+	{
+		if (context->mode == 0x04 && context->pending < (int)sizeof(context->samples))
+			context->samples[context->pending++] = context->pins;
+		context->pins = buf[index];
+	}
+	ftdistub_writes++;
+	ftdistub_bytes_written += size;
+	return size;
+}
+
+int ftdi_read_data(void *ftdi, unsigned char *buf, int size)
+{
+	struct stub_context *context = ftdi;
+
+	transfer();
+
+	// Bad command replies come first, once the chip lets them go
+	if (context->replyCount > 0)
+	{
+		if (now_ns() < context->replyAt) size = 0;
+		if (size > context->replyCount) size = context->replyCount;
+		memcpy(buf, context->replies, size);
+		context->replyCount -= size;
+		memmove(context->replies, context->replies + size,
+			context->replyCount);
+		ftdistub_reads++;
+		ftdistub_bytes_read += size;
+		return size;
+	}
+
+	// The chip only sends a part filled packet when its timer runs out
+	if (latencyTimer() && size < 62)
+		usleep((context->latency ? context->latency : 16) * 1000);
+	memset(buf, (size == 1) ? 0xFF : 0, size);
+
+	if (context->mode == 0x04)
+	{
+		if (size > context->pending) size = context->pending;
+		memcpy(buf, context->samples, size);
+		context->pending -= size;
+		memmove(context->samples, context->samples + size, context->pending);
+	}
+	ftdistub_reads++;
+	ftdistub_bytes_read += size;
+	return size;
+}
+
+int ftdi_set_latency_timer(void *ftdi, unsigned char latency)
+{
+	if (latency < 1) return -1;
+	((struct stub_context *)ftdi)->latency = latency;
+	return 0;
+}
+
+int ftdi_get_latency_timer(void *ftdi, unsigned char *latency)
+{
+	int value = ((struct stub_context *)ftdi)->latency;
+
+	*latency = value ? value : 16;
+	return 0;
+}
+
+int ftdi_read_data_set_chunksize(void *ftdi, unsigned int chunksize)
+{
+	return 0;
+}
+
+int ftdi_write_data_set_chunksize(void *ftdi, unsigned int chunksize)
+{
+	return 0;
+}
+
+int ftdi_enable_bitbang(void *ftdi, unsigned char bitmask)
+{
+	((struct stub_context *)ftdi)->mode = 0x01;
+	return 0;
+}
+
+int ftdi_disable_bitbang(void *ftdi)
+{
+	return 0;
+}
+
+int ftdi_set_bitmode(void *ftdi, unsigned char bitmask, unsigned char mode)
+{
+	((struct stub_context *)ftdi)->mode = mode;
+	return 0;
+}
+
+int ftdi_read_pins(void *ftdi, unsigned char *pins)
+{
+	transfer();
+	*pins = ((struct stub_context *)ftdi)->pins;
+	ftdistub_reads++;
+	ftdistub_bytes_read++;
+	return 0;
+}
+
+char *ftdi_get_error_string(void *ftdi)
+{
+	return "stub";
+}
@@ -0,0 +1,703 @@
+/*
+ * i2creplay.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code checks the SeaDAC Lite 8126 I2C queue optimiser at the pin
+ * level.  Every chunk the library sends is captured as it was built and as
+ * I2C_OptimizeQueue left it, and both streams are replayed through a model
+ * of the MPSSE pins wired to two simulated PCA9535 I/O expanders.  For each
+ * chunk the collapsed SCL, SDA and GPIO level sequences, the bytes read back
+ * and the expander registers must be identical, and the optimised stream must
+ * not add SDA contention.  The results of the PIO calls are also checked
+ * against the simulated expanders, and random command streams are put
+ * through the optimiser the same way.
+ *
+ * The library's seadaclite.c is compiled into this file so that the queue is
+ * visible here, and its dlsym calls are routed to the simulated device.
+ * The chunk is captured when I2C_FlushQueue looks up ftdi_write_data, which
+ * it does before optimising.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o i2creplay i2creplay.c \
+ *       $(ls ../seadac_lib/source_files/[a-z]*.c | grep -v seadaclite) \
+ *       -ldl -lpthread
+ *
+ * Usage: ./i2creplay [rounds]
+ *        (default 200 rounds of every PIO call and a long transaction,
+ *        and 100 random streams per round)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <dlfcn.h>
+
+static void *replayDlsym(void *handle, const char *name);
+#define dlsym replayDlsym
+#include "seadaclite.c"
+#undef dlsym
+
+// The 8126 expanders and the inputs wired to their pins
+#define CHIPS		2
+static const unsigned char chipAddress[CHIPS] = { 0xE8, 0xEA };
+static const unsigned char chipInputs[CHIPS][2] = { { 0x3C, 0xA5 }, { 0x5A, 0x0F } };
+
+// What an expander is doing on the bus
+enum { BUS_IDLE, BUS_RECEIVE, BUS_ACK, BUS_TRANSMIT, BUS_MASTER_ACK, BUS_IGNORE };
+
+#define MAXIMUM_SAMPLES	(16 * MAXIMUM_COMMAND_BYTES)
+#define MAXIMUM_REPLY	(2 * MAXIMUM_COMMAND_BYTES)
+
+typedef struct pca9535
+{
+	unsigned char reg[8];		//Input, output, polarity, configuration.
+	unsigned char pointer;		//Command byte.
+} pca9535;
+
+typedef struct device
+{
+	unsigned char low, lowDirection;	//ADBUS (SCL, SDA, GPIO 0-3)
+	unsigned char high, highDirection;	//ACBUS (GPIO 4-7)
+	int scl, sda;				//Bus levels
+	int slaveSda;				//0 while an expander pulls SDA low
+	int state, bits, chip, read, first, ack;
+	unsigned char shift;
+	unsigned int level;			//Last sample
+	pca9535 chips[CHIPS];
+} device;
+
+typedef struct trace
+{
+	unsigned int samples[MAXIMUM_SAMPLES];
+	int sampleCount;
+	unsigned char reply[MAXIMUM_REPLY];
+	int replyCount;
+	int contention;
+	int errors;
+} trace;
+
+static device sim, shadow;
+static trace optimized, raw;
+static seaMaxModule *module;
+
+// The chunk as I2C_FlushQueue found it
+static unsigned char captured[MAXIMUM_COMMAND_BYTES];
+static int capturedLength = -1;
+static i2c_chunk *capturedChunk;
+
+// Bytes waiting for ftdi_read_data
+static unsigned char fifo[MAXIMUM_REPLY];
+static int fifoHead, fifoTail;
+
+static long chunks, mismatches, rawBytes, optimizedBytes, samples, failures;
+
+
+//  --------------------------------------------------------------------------
+// ( Private function reads an expander register and steps to its pair.      )
+//  --------------------------------------------------------------------------
+static unsigned char expanderRead(device *d)
+{
+	pca9535 *p = &d->chips[d->chip];
+	int port = p->pointer & 1;
+	unsigned char value;
+
+	if (p->pointer < 2)
+	{
+		value = (p->reg[2 + port] & ~p->reg[6 + port]) |
+			(chipInputs[d->chip][port] & p->reg[6 + port]);
+		value ^= p->reg[4 + port];
+	}
+	else value = p->reg[p->pointer];
+
+	p->pointer ^= 1;
+	return value;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function takes a byte written to an expander.                   )
+//  --------------------------------------------------------------------------
+static void expanderWrite(device *d, unsigned char byte)
+{
+	pca9535 *p = &d->chips[d->chip];
+
+	if (d->first)
+	{
+		p->pointer = byte & 0x07;
+		d->first = 0;
+		return;
+	}
+
+	// The input registers are read only
+	if (p->pointer >= 2) p->reg[p->pointer] = byte;
+	p->pointer ^= 1;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function moves the expanders on at a falling SCL edge.          )
+// The expanders change SDA only while SCL is low.
+//  --------------------------------------------------------------------------
+static void busFall(device *d)
+{
+	int index;
+
+	switch (d->state)
+	{
+	case BUS_RECEIVE:
+		if (d->bits < 8) break;
+		if (d->chip < 0)
+		{
+			for (index = 0; index < CHIPS; index++)
+				if (chipAddress[index] == (d->shift & 0xFE)) d->chip = index;
+			if (d->chip < 0)
+			{
+				d->state = BUS_IGNORE;
+				break;
+			}
+			d->read = d->shift & 0x01;
+		}
+		else expanderWrite(d, d->shift);
+
+		d->slaveSda = 0;
+		d->state = BUS_ACK;
+		break;
+
+	case BUS_ACK:
+		d->slaveSda = 1;
+		d->bits = 0;
+		if (d->read)
+		{
+			d->shift = expanderRead(d);
+			d->slaveSda = (d->shift >> 7) & 1;
+			d->state = BUS_TRANSMIT;
+		}
+		else d->state = BUS_RECEIVE;
+		break;
+
+	case BUS_TRANSMIT:
+		if (d->bits < 8) d->slaveSda = (d->shift >> (7 - d->bits)) & 1;
+		else
+		{
+			d->slaveSda = 1;
+			d->state = BUS_MASTER_ACK;
+		}
+		break;
+
+	case BUS_MASTER_ACK:
+		if (d->ack)
+		{
+			d->shift = expanderRead(d);
+			d->slaveSda = (d->shift >> 7) & 1;
+			d->bits = 0;
+			d->state = BUS_TRANSMIT;
+		}
+		else d->state = BUS_IGNORE;
+		break;
+	}
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function samples SDA at a rising SCL edge.                      )
+//  --------------------------------------------------------------------------
+static void busRise(device *d)
+{
+	switch (d->state)
+	{
+	case BUS_RECEIVE:
+		d->shift = (d->shift << 1) | d->sda;
+		d->bits++;
+		break;
+	case BUS_TRANSMIT:
+		d->bits++;
+		break;
+	case BUS_MASTER_ACK:
+		d->ack = !d->sda;
+		break;
+	}
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function records the bus and GPIO levels when they change.      )
+// GPIO inputs are recorded apart from driven levels.
+//  --------------------------------------------------------------------------
+static void record(device *d, trace *t)
+{
+	unsigned int level = d->scl | (d->sda << 1) |
+		(d->low & d->lowDirection & 0xF0) |
+		((d->lowDirection & 0xF0) << 4) |
+		((d->high & d->highDirection) << 16) |
+		(d->highDirection << 24);
+
+	if (level == d->level) return;
+	d->level = level;
+	if (t->sampleCount < MAXIMUM_SAMPLES) t->samples[t->sampleCount] = level;
+	t->sampleCount++;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function works out the bus after the pins have been written.    )
+// SCL and SDA are pulled up, and the expanders can only pull SDA low.  When
+// one write moves both lines, SDA is taken to change while SCL is low.
+//  --------------------------------------------------------------------------
+static void settle(device *d, trace *t)
+{
+	int scl = (d->lowDirection & SCL) ? ((d->low & SCL) != 0) : 1;
+	int master = (d->lowDirection & SDA) ? ((d->low & SDA) != 0) : 1;
+	int sda;
+
+	if (d->scl && !scl)
+	{
+		d->scl = 0;
+		busFall(d);
+		record(d, t);
+	}
+
+	sda = master & d->slaveSda;
+	if (sda != d->sda)
+	{
+		d->sda = sda;
+		if (d->scl)
+		{
+			// Start or stop
+			d->state = sda ? BUS_IDLE : BUS_RECEIVE;
+			d->bits = 0;
+			d->chip = -1;
+			d->first = 1;
+			d->slaveSda = 1;
+		}
+		record(d, t);
+	}
+
+	if (!d->scl && scl)
+	{
+		d->scl = 1;
+		busRise(d);
+	}
+	record(d, t);
+
+	// The MPSSE pins are push-pull
+	if ((d->lowDirection & SDA) && (d->low & SDA) && !d->slaveSda) t->contention++;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function runs MPSSE commands on the simulated pins.             )
+//  --------------------------------------------------------------------------
+static void execute(device *d, trace *t, unsigned char *command, int length)
+{
+	int index = 0, bit, count;
+	unsigned char in;
+
+	t->sampleCount = 0;
+	t->replyCount = 0;
+	t->contention = 0;
+	t->errors = 0;
+
+	while (index < length)
+	{
+		switch (command[index])
+		{
+		case 0x80: case 0x82: case 0x13: case 0x86:	count = 3; break;
+		case 0x26:					count = 2; break;
+		default:					count = 1; break;
+		}
+		if (index + count > length || t->replyCount + 2 > MAXIMUM_REPLY)
+		{
+			t->errors++;
+			return;
+		}
+
+		switch (command[index])
+		{
+		case 0x80:
+			d->low = command[index + 1];
+			d->lowDirection = command[index + 2];
+			settle(d, t);
+			break;
+
+		case 0x82:
+			d->high = command[index + 1];
+			d->highDirection = command[index + 2];
+			settle(d, t);
+			break;
+
+		case 0x13:
+			// Bits out MSB first, changing while SCL is low
+			for (bit = 0; bit <= command[index + 1] && bit < 8; bit++)
+			{
+				if (command[index + 2] & (0x80 >> bit)) d->low |= SDA;
+				else d->low &= ~SDA;
+				settle(d, t);
+				d->low |= SCL;
+				settle(d, t);
+				d->low &= ~SCL;
+				settle(d, t);
+			}
+			break;
+
+		case 0x26:
+			// Bits in MSB first, shifted up from bit 0
+			for (bit = 0, in = 0; bit <= command[index + 1] && bit < 8; bit++)
+			{
+				d->low |= SCL;
+				settle(d, t);
+				in = (in << 1) | d->sda;
+				d->low &= ~SCL;
+				settle(d, t);
+			}
+			t->reply[t->replyCount++] = in;
+			break;
+
+		case 0x81:
+			in = (d->low & d->lowDirection) | ~d->lowDirection;
+			in &= ~(SCL | SDA | TDO);
+			in |= (d->scl ? SCL : 0) | (d->sda ? (SDA | TDO) : 0);
+			t->reply[t->replyCount++] = in;
+			break;
+
+		case 0x83:
+			t->reply[t->replyCount++] = (d->high & d->highDirection) | ~d->highDirection;
+			break;
+
+		case 0x85: case 0x86: case 0x87:
+			break;
+
+		default:
+			// Bad command
+			t->reply[t->replyCount++] = 0xFA;
+			t->reply[t->replyCount++] = command[index];
+			t->errors++;
+			break;
+		}
+		index += count;
+	}
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function checks that two replays left the same marks.          )
+// A dropped write may have been driving SDA high against an expander, so
+// the optimised stream can have less contention, but never more.
+//  --------------------------------------------------------------------------
+static int sameReplay(device *before, device *after)
+{
+	int index;
+
+	if (raw.sampleCount != optimized.sampleCount ||
+		raw.replyCount != optimized.replyCount ||
+		raw.contention < optimized.contention ||
+		raw.errors != optimized.errors) return 0;
+
+	for (index = 0; index < raw.sampleCount && index < MAXIMUM_SAMPLES; index++)
+		if (raw.samples[index] != optimized.samples[index]) return 0;
+	if (memcmp(raw.reply, optimized.reply, raw.replyCount) != 0) return 0;
+
+	if (before->low != after->low || before->lowDirection != after->lowDirection ||
+		before->high != after->high || before->highDirection != after->highDirection ||
+		before->scl != after->scl || before->sda != after->sda ||
+		before->slaveSda != after->slaveSda || before->state != after->state ||
+		before->bits != after->bits || before->chip != after->chip) return 0;
+
+	for (index = 0; index < CHIPS; index++)
+	{
+		if (memcmp(before->chips[index].reg, after->chips[index].reg, 8) != 0 ||
+			before->chips[index].pointer != after->chips[index].pointer) return 0;
+	}
+	return 1;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Stub libftdi calls, on the simulated device.                            )
+//  --------------------------------------------------------------------------
+static int replayWrite(ftdi_context ftdi, unsigned char *buf, int size)
+{
+	i2c_queue *q = (i2c_queue*)module->i2cQueue;
+	int queued = (capturedLength >= 0 && q->open == capturedChunk &&
+		buf == q->open->MPSSECommand);
+
+	if (queued)
+	{
+		// Replay the chunk as built on a copy of the device
+		shadow = sim;
+		execute(&shadow, &raw, captured, capturedLength);
+	}
+	execute(&sim, &optimized, buf, size);
+
+	if (queued)
+	{
+		chunks++;
+		rawBytes += capturedLength;
+		optimizedBytes += size;
+		samples += optimized.sampleCount;
+		if (!sameReplay(&shadow, &sim) && mismatches++ == 0)
+		{
+			fprintf(stderr, "chunk %ld differs: %d -> %d command bytes, "
+				"%d / %d samples, %d / %d replies, %d / %d contention\n",
+				chunks, capturedLength, size,
+				raw.sampleCount, optimized.sampleCount,
+				raw.replyCount, optimized.replyCount,
+				raw.contention, optimized.contention);
+		}
+	}
+	capturedLength = -1;
+
+	if (fifoHead == fifoTail) fifoHead = fifoTail = 0;
+	if (fifoTail + optimized.replyCount > MAXIMUM_REPLY) return -1;
+	memcpy(&fifo[fifoTail], optimized.reply, optimized.replyCount);
+	fifoTail += optimized.replyCount;
+	return size;
+}
+
+static int replayRead(ftdi_context ftdi, unsigned char *buf, int size)
+{
+	int count = fifoTail - fifoHead;
+
+	if (count > size) count = size;
+	memcpy(buf, &fifo[fifoHead], count);
+	fifoHead += count;
+	return count;
+}
+
+static int replayPurge(ftdi_context ftdi)
+{
+	fifoHead = fifoTail = 0;
+	return 0;
+}
+
+static void *replayDlsym(void *handle, const char *name)
+{
+	i2c_queue *q = module ? (i2c_queue*)module->i2cQueue : NULL;
+
+	if (strcmp(name, "ftdi_write_data") == 0)
+	{
+		// I2C_FlushQueue asks for this before it optimises the open chunk
+		capturedLength = -1;
+		if (q && q->open)
+		{
+			memcpy(captured, q->open->MPSSECommand, q->open->byteIndex);
+			capturedLength = q->open->byteIndex;
+			capturedChunk = q->open;
+		}
+		return (void*)replayWrite;
+	}
+	if (strcmp(name, "ftdi_read_data") == 0) return (void*)replayRead;
+	if (strcmp(name, "ftdi_usb_purge_buffers") == 0) return (void*)replayPurge;
+	return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function counts a PIO call that went wrong.                     )
+//  --------------------------------------------------------------------------
+static void check(int ok, const char *what, int round)
+{
+	if (ok) return;
+	if (failures++ < 10) fprintf(stderr, "round %d: %s\n", round, what);
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function optimises random command streams and replays them.     )
+// The library's own queues never clock data just before a pin write that
+// repeats an old state, or change GPIO between two low byte writes, so
+// these streams mix every command the optimiser knows in any order.
+//  --------------------------------------------------------------------------
+static long randomStreams(int rounds)
+{
+	static i2c_chunk chunk;
+	device before, after;
+	unsigned char gpio = 0xF0, gpioDirection = 0xF0;
+	long differ = 0;
+	int round, length;
+
+	for (round = 0; round < rounds; round++)
+	{
+		for (length = 0; length + 3 <= 180; )
+		{
+			switch (rand() % 8)
+			{
+			case 0: case 1: case 2: case 3:
+				if ((rand() % 8) == 0) gpio = rand() & 0xF0;
+				if ((rand() % 8) == 0) gpioDirection = rand() & 0xF0;
+				chunk.MPSSECommand[length++] = 0x80;
+				chunk.MPSSECommand[length++] = gpio | (rand() & (SCL | SDA));
+				chunk.MPSSECommand[length++] = gpioDirection | (rand() & (SCL | SDA));
+				break;
+			case 4:
+				chunk.MPSSECommand[length++] = 0x82;
+				chunk.MPSSECommand[length++] = rand() & 0x03;
+				chunk.MPSSECommand[length++] = 0x03;
+				break;
+			case 5:
+				chunk.MPSSECommand[length++] = 0x13;
+				chunk.MPSSECommand[length++] = rand() & 0x07;
+				chunk.MPSSECommand[length++] = rand() & 0xFF;
+				break;
+			case 6:
+				chunk.MPSSECommand[length++] = 0x26;
+				chunk.MPSSECommand[length++] = rand() & 0x07;
+				break;
+			case 7:
+				chunk.MPSSECommand[length++] = 0x87;
+				break;
+			}
+		}
+		chunk.byteIndex = length;
+		memcpy(captured, chunk.MPSSECommand, length);
+		I2C_OptimizeQueue(&chunk);
+
+		before = after = sim;
+		execute(&before, &raw, captured, length);
+		execute(&after, &optimized, chunk.MPSSECommand, chunk.byteIndex);
+		if (!sameReplay(&before, &after) && differ++ == 0)
+		{
+			fprintf(stderr, "random stream %d differs: %d -> %d command bytes\n",
+				round, length, chunk.byteIndex);
+		}
+	}
+
+	return differ;
+}
+
+
+int main(int argc, char **argv)
+{
+	SeaMaxLin *handle;
+	SeaDacTxn *txn;
+	int rounds = (argc > 1) ? atoi(argv[1]) : 200;
+	int round, index, bank, ret;
+	long differ;
+	unsigned char directions[4], banks[4], outputs[4], expected[4], data[4];
+	unsigned char written[48][2], readBack[48][2], enable;
+
+	// Power on: expander outputs high and every pin an input
+	memset(&sim, 0, sizeof(sim));
+	sim.scl = sim.sda = sim.slaveSda = 1;
+	sim.chip = -1;
+	for (index = 0; index < CHIPS; index++)
+	{
+		memset(sim.chips[index].reg, 0xFF, 8);
+		sim.chips[index].reg[4] = sim.chips[index].reg[5] = 0x00;
+	}
+
+	// An open 8126 without the USB side
+	handle = SeaMaxLinCreate();
+	module = (seaMaxModule*)handle;
+	if (module == NULL) return 1;
+	module->commMode = FTDI_DIRECT;
+	module->deviceType = SDL_8126;
+	module->libftdi = &sim;
+	module->ftdic = &sim;
+	module->i2cClock = 0;
+	module->pioCached = 0;
+	module->reconnectMs = 0;
+	module->i2cQueue = calloc(1, sizeof(i2c_queue));
+	txn = SeaDacTxnCreate();
+	if (module->i2cQueue == NULL || txn == NULL) return 1;
+	if (I2C_InitializeI2C(module) < 0)
+	{
+		fprintf(stderr, "I2C setup failed\n");
+		return 1;
+	}
+
+	srand(8126);
+	for (round = 0; round < rounds; round++)
+	{
+		// Random bank directions, then the line drivers to match
+		for (index = 0, enable = 0; index < 4; index++)
+		{
+			directions[index] = rand() & 1;
+			banks[index] = directions[index] ? 0xFF : 0x00;
+			if (!directions[index]) enable |= (1 << index);
+		}
+		ret = SeaDacSetPIODirection(handle, directions);
+		check(ret == 0, "SeaDacSetPIODirection failed", round);
+		for (index = 0; index < 4; index++)
+			check(sim.chips[index / 2].reg[6 + (index & 1)] == banks[index],
+				"configuration register not written", round);
+		check(((sim.low >> 4) & 0x0F) == (~enable & 0x0F), "line drivers not set", round);
+
+		for (index = 0; index < 4; index++) outputs[index] = rand() & 0xFF;
+		ret = SeaDacSetPIO(handle, outputs);
+		check(ret == 0, "SeaDacSetPIO failed", round);
+		for (index = 0; index < 4; index++)
+		{
+			check(sim.chips[index / 2].reg[2 + (index & 1)] == outputs[index],
+				"output register not written", round);
+			expected[index] = directions[index] ?
+				chipInputs[index / 2][index & 1] : outputs[index];
+		}
+
+		ret = SeaDacGetPIO(handle, data);
+		check(ret == 4 && memcmp(data, expected, 4) == 0, "SeaDacGetPIO wrong", round);
+
+		memset(data, 0x55, 4);
+		ret = SeaDacGetInputs(handle, data);
+		check(ret == 4 && memcmp(data, expected, 4) == 0, "SeaDacGetInputs wrong", round);
+
+		ret = SeaDacGetPIODirection(handle, data);
+		check(ret == 0 && memcmp(data, banks, 4) == 0, "SeaDacGetPIODirection wrong", round);
+
+		// A transaction long enough to be sent in several chunks
+		SeaDacTxnClear(txn);
+		for (index = 0; index < 48; index++)
+		{
+			bank = index & 1;
+			written[index][0] = rand() & 0xFF;
+			written[index][1] = rand() & 0xFF;
+			SeaDacTxnWrite(txn, chipAddress[bank], 2, written[index], 2);
+			SeaDacTxnRead(txn, chipAddress[bank], 2, readBack[index], 2);
+			if ((index % 16) == 15) SeaDacTxnSetGPIO(txn, 0xFF, ~enable);
+		}
+		ret = SeaDacTxnExecute(handle, txn);
+		check(ret == 0, "SeaDacTxnExecute failed", round);
+		for (index = 0; index < 48; index++)
+			check(memcmp(written[index], readBack[index], 2) == 0,
+				"transaction read back wrong", round);
+	}
+
+	printf("%d rounds: %ld chunks, %ld -> %ld command bytes, %ld samples\n",
+		rounds, chunks, rawBytes, optimizedBytes, samples);
+	printf("%ld chunks differ, %ld PIO checks failed\n", mismatches, failures);
+
+	differ = randomStreams(100 * rounds);
+	printf("%d random streams: %ld differ\n", 100 * rounds, differ);
+
+	SeaDacTxnDestroy(txn);
+	free(module->i2cQueue);
+	module->i2cQueue = NULL;
+	module->libftdi = NULL;
+	module->ftdic = NULL;
+	module->commMode = NO_CONNECT;
+	SeaMaxLinDestroy(handle);
+
+	return (mismatches || failures || differ || chunks == 0) ? 1 : 0;
+}
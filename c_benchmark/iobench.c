@@ -0,0 +1,333 @@
+/*
+ * iobench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code compares the Modbus/TCP I/O engines (see SeaMaxLinSetIoBackend)
+ * against a Modbus/TCP server forked onto the loopback interface: system
+ * calls, CPU time and wall-clock time per transaction, for one module after
+ * another with SeaMaxLinRead and for all modules at once with SeaMaxLinBatch.
+ * Every transaction reads one holding register.
+ *
+ * System calls are counted by wrapping the libc entry points the library uses
+ * for I/O; CPU time is the process's user and system time, io_uring workers
+ * included.  The server runs in its own process and is not counted.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o iobench iobench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./iobench [modules [rounds]]     (default 32 modules, 1000 rounds)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "seamaxlin.h"
+
+// System call counting.  The libc entry points the library does its I/O
+// through are wrapped, io_uring_enter (made with syscall()) included.
+static unsigned long syscalls = 0;
+
+#define REAL(name) \
+	static __typeof__(name) *real; \
+	if (real == NULL) real = dlsym(RTLD_NEXT, #name); \
+	syscalls++
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	REAL(read);
+	return real(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	REAL(write);
+	return real(fd, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+	REAL(readv);
+	return real(fd, iov, iovcnt);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	REAL(writev);
+	return real(fd, iov, iovcnt);
+}
+
+ssize_t recvmsg(int fd, struct msghdr *msg, int flags)
+{
+	REAL(recvmsg);
+	return real(fd, msg, flags);
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+	REAL(send);
+	return real(fd, buf, len, flags);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+	REAL(recv);
+	return real(fd, buf, len, flags);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	REAL(poll);
+	return real(fds, nfds, timeout);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+	int timeout)
+{
+	REAL(epoll_wait);
+	return real(epfd, events, maxevents, timeout);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+	REAL(epoll_ctl);
+	return real(epfd, op, fd, event);
+}
+
+long syscall(long number, ...)
+{
+	long args[6];
+	va_list list;
+	int index;
+	REAL(syscall);
+
+	va_start(list, number);
+	for (index = 0; index < 6; index++) args[index] = va_arg(list, long);
+	va_end(list);
+	return real(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+}
+
+// A Modbus/TCP server answering every read of holding registers with zeros
+static void serve(int listener)
+{
+	struct epoll_event event, events[64];
+	unsigned char request[260], reply[260];
+	int poller, count, index, fd, length, quantity;
+
+	poller = epoll_create1(0);
+	event.events = EPOLLIN;
+	event.data.fd = listener;
+	epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+
+	for (;;)
+	{
+		count = epoll_wait(poller, events, 64, -1);
+		for (index = 0; index < count; index++)
+		{
+			fd = events[index].data.fd;
+			if (fd == listener)
+			{
+				event.data.fd = accept(listener, NULL, NULL);
+				if (event.data.fd >= 0)
+					epoll_ctl(poller, EPOLL_CTL_ADD, event.data.fd, &event);
+				continue;
+			}
+
+			length = recv(fd, request, sizeof(request), 0);
+			if (length <= 0)
+			{
+				close(fd);
+				continue;
+			}
+			if (length < 12) continue;
+
+			memcpy(reply, request, 8);
+			quantity = (request[10] << 8) | request[11];
+			if (request[7] != 0x03 || quantity < 1 || quantity > 125)
+			{
+				reply[7] |= 0x80;
+				reply[8] = 0x01;
+				length = 9;
+			}
+			else
+			{
+				reply[8] = quantity * 2;
+				memset(&reply[9], 0, quantity * 2);
+				length = 9 + quantity * 2;
+			}
+			reply[4] = (length - 6) >> 8;
+			reply[5] = (length - 6) & 0xFF;
+			send(fd, reply, length, 0);
+		}
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double cpu_ns(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9 +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+}
+
+static void bench(const char *engine, const char *name, SeaMaxLin **modules,
+	int count, long rounds, int batch)
+{
+	seamax_op_s *ops = calloc(count, sizeof(seamax_op_s));
+	unsigned char data[256 * 2];
+	unsigned long calls = syscalls;
+	double start = now_ns(), cpu = cpu_ns(), txns = (double)rounds * count;
+	long round, failed = 0;
+	int index;
+
+	for (index = 0; index < count; index++)
+	{
+		ops[index].module = modules[index];
+		ops[index].slaveId = 1;
+		ops[index].type = HOLDINGREG;
+		ops[index].starting_address = 1;
+		ops[index].range = 1;
+		ops[index].data = &data[index * 2];
+	}
+
+	for (round = 0; round < rounds; round++)
+	{
+		if (batch)
+		{
+			failed += count - SeaMaxLinBatch(ops, count);
+			continue;
+		}
+		for (index = 0; index < count; index++)
+			if (SeaMaxLinRead(modules[index], 1, HOLDINGREG, 1, 1, data) < 0)
+				failed++;
+	}
+
+	printf("%-6s %-14s %8.0f txns %6.2f syscalls/txn %7.2f us CPU/txn "
+		"%7.2f us/txn %ld failed\n", engine, name, txns,
+		(syscalls - calls) / txns, (cpu_ns() - cpu) / txns / 1000,
+		(now_ns() - start) / txns / 1000, failed);
+	free(ops);
+}
+
+int main(int argc, char * argv[])
+{
+	const char *engines[3] = { "direct", "epoll", "uring" };
+	struct sockaddr_in address;
+	socklen_t size = sizeof(address);
+	SeaMaxLin **modules;
+	char device[64];
+	long rounds = 1000;
+	int count = 32, listener, index, engine, used, ret;
+	pid_t server;
+
+	if (argc > 1) count = atoi(argv[1]);
+	if (count < 1) count = 1;
+	if (count > 256) count = 256;
+	if (argc > 2) rounds = atol(argv[2]);
+	if (rounds < 1) rounds = 1;
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+		listen(listener, 256) < 0 ||
+		getsockname(listener, (struct sockaddr*)&address, &size) < 0)
+	{
+		perror("server socket");
+		return 1;
+	}
+
+	server = fork();
+	if (server == 0) serve(listener);
+	close(listener);
+
+	modules = calloc(count, sizeof(SeaMaxLin*));
+	for (engine = 0; engine < 3; engine++)
+	{
+		used = SeaMaxLinSetIoBackend(engine);
+		if (used != engine)
+		{
+			printf("%-6s unavailable, %s used instead\n", engines[engine],
+				engines[used]);
+			continue;
+		}
+
+		for (index = 0; index < count; index++)
+		{
+			snprintf(device, sizeof(device), "sealevel_tcp://127.0.0.1:%d",
+				ntohs(address.sin_port));
+			modules[index] = SeaMaxLinCreate();
+			ret = SeaMaxLinOpen(modules[index], device);
+			if (ret < 0)
+			{
+				fprintf(stderr, "%s: open failed (%d)\n", device, ret);
+				kill(server, SIGTERM);
+				return 1;
+			}
+		}
+
+		bench(engines[engine], "SeaMaxLinRead", modules, count, rounds, 0);
+		bench(engines[engine], "SeaMaxLinBatch", modules, count, rounds, 1);
+
+		for (index = 0; index < count; index++)
+		{
+			SeaMaxLinClose(modules[index]);
+			SeaMaxLinDestroy(modules[index]);
+		}
+	}
+
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+	free(modules);
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * loopbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures whole SeaMaxLinRead, SeaMaxLinWrite and
+ * SeaMaxLinIoctl calls against the in-process loopback module
+ * ("sealevel_loop://rtu" and "sealevel_loop://tcp").  No device, port or
+ * socket is involved, so the times are the library's own: locking, framing,
+ * CRC, statistics, tracing and parsing.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o loopbench loopbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./loopbench [calls]     (default 1000000 calls per case)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+
+#include "seamaxlin.h"
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(SeaMaxLin *module, const char *framing, const char *name,
+	long calls, int type, int range, int write)
+{
+	unsigned char data[256];
+	double start;
+	long n, failed = 0;
+
+	memset(data, 0x5A, sizeof(data));
+	start = now_ns();
+	for (n = 0; n < calls; n++)
+	{
+		data[0] = n;
+		if (write)
+		{
+			if (SeaMaxLinWrite(module, 1, type, 1, range, data) < 0) failed++;
+		}
+		else if (SeaMaxLinRead(module, 1, type, 1, range, data) < 0) failed++;
+	}
+
+	printf("%-4s %-28s %8ld calls %8.1f ns/call %ld failed\n", framing, name,
+		calls, (now_ns() - start) / calls, failed);
+}
+
+static void bench_ioctl(SeaMaxLin *module, const char *framing, long calls)
+{
+	seaio_ioctl_s ioctl;
+	double start;
+	long n, failed = 0;
+
+	start = now_ns();
+	for (n = 0; n < calls; n++)
+	{
+		if (SeaMaxLinIoctl(module, 1, IOCTL_READ_COMM_PARAM, &ioctl) < 0) failed++;
+	}
+
+	printf("%-4s %-28s %8ld calls %8.1f ns/call %ld failed\n", framing,
+		"ioctl READ_COMM_PARAM", calls, (now_ns() - start) / calls, failed);
+}
+
+int main(int argc, char * argv[])
+{
+	char *devices[2] = { "sealevel_loop://rtu", "sealevel_loop://tcp" };
+	SeaMaxLin *module;
+	long calls = 1000000;
+	int index, ret;
+
+	if (argc > 1) calls = atol(argv[1]);
+	if (calls < 1) calls = 1;
+
+	module = SeaMaxLinCreate();
+	for (index = 0; index < 2; index++)
+	{
+		ret = SeaMaxLinOpen(module, devices[index]);
+		if (ret < 0)
+		{
+			fprintf(stderr, "%s: open failed (%d)\n", devices[index], ret);
+			return 1;
+		}
+
+		bench(module, devices[index] + 16, "read 16 coils", calls, COILS, 16, 0);
+		bench(module, devices[index] + 16, "write 16 coils", calls, COILS, 16, 1);
+		bench(module, devices[index] + 16, "read 1 holding register", calls, HOLDINGREG, 1, 0);
+		bench(module, devices[index] + 16, "read 100 holding registers", calls, HOLDINGREG, 100, 0);
+		bench(module, devices[index] + 16, "write 1 holding register", calls, HOLDINGREG, 1, 1);
+		bench(module, devices[index] + 16, "write 100 holding registers", calls, HOLDINGREG, 100, 1);
+		bench_ioctl(module, devices[index] + 16, calls);
+
+		SeaMaxLinClose(module);
+	}
+
+	SeaMaxLinDestroy(module);
+	return 0;
+}
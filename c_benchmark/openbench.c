@@ -0,0 +1,170 @@
+/*
+ * openbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures how long SeaMaxLinOpen takes on SeaDAC Lite modules,
+ * opening several modules one after another, all at once from separate
+ * threads, and with SeaDacOpenAll.  It runs against the stub libftdi in ftdistub.c, or
+ * against real hardware when the modules are attached.  With the stub it also
+ * times a call that loses the module and reconnects to it.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -shared -fPIC -o libftdi.so ftdistub.c
+ *   gcc -O2 -I../seadac_lib/source_files -o openbench openbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: LD_LIBRARY_PATH=. ./openbench [modules [device]]
+ *        (default 10 modules of "sealevel_d2x://8126")
+ *
+ * Set FTDISTUB_LATENCY_US to give every USB transfer a cost, and
+ * FTDISTUB_DEVICES to the module count for SeaDacOpenAll to find them.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+
+#include "seamaxlin.h"
+
+#define MAXIMUM_MODULES	64
+
+// Calls timed for the reconnect row
+#define RECONNECTS	20
+
+static char *device = "sealevel_d2x://8126";
+static SeaMaxLin *modules[MAXIMUM_MODULES];
+static int results[MAXIMUM_MODULES];
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *open_one(void *arg)
+{
+	long index = (long)arg;
+
+	results[index] = SeaMaxLinOpen(modules[index], device);
+	return NULL;
+}
+
+static void report(const char *name, int count, double elapsed)
+{
+	int index, failed = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		if (results[index] < 0) failed++;
+		SeaMaxLinClose(modules[index]);
+	}
+
+	printf("%-12s %3d modules %10.2f ms total %10.2f ms/open %3d failed\n",
+		name, count, elapsed / 1e6, elapsed / 1e6 / count, failed);
+}
+
+// A SeaDacSetPIO whose first write fails, as when the module is unplugged
+// and plugged back in: the call reopens the module, restores it and goes on.
+static void reconnect(void)
+{
+	unsigned char data[4] = { 0x12, 0x34, 0x56, 0x78 };
+	int *fail_writes, index, failed = 0;
+	void *stub;
+	double start, elapsed = 0;
+
+	stub = dlopen("libftdi.so", RTLD_LAZY | RTLD_NOLOAD);
+	fail_writes = stub ? dlsym(stub, "ftdistub_fail_writes") : NULL;
+	if (!fail_writes) return;
+
+	results[0] = SeaMaxLinOpen(modules[0], device);
+	if (results[0] < 0) return;
+
+	for (index = 0; index < RECONNECTS; index++)
+	{
+		*fail_writes = 1;
+		start = now_ns();
+		if (SeaDacSetPIO(modules[0], data) < 0) failed++;
+		elapsed += now_ns() - start;
+	}
+	SeaMaxLinClose(modules[0]);
+
+	printf("%-12s %3d calls   %10.2f ms total %10.2f ms/call %3d failed\n",
+		"reconnect", RECONNECTS, elapsed / 1e6, elapsed / 1e6 / RECONNECTS,
+		failed);
+}
+
+int main(int argc, char * argv[])
+{
+	pthread_t threads[MAXIMUM_MODULES];
+	SeaMaxLin *all[MAXIMUM_MODULES];
+	double start, elapsed;
+	long index;
+	int count = 10, opened;
+
+	if (argc > 1) count = atoi(argv[1]);
+	if (count < 1) count = 1;
+	if (count > MAXIMUM_MODULES) count = MAXIMUM_MODULES;
+	if (argc > 2) device = argv[2];
+
+	for (index = 0; index < count; index++)
+		modules[index] = SeaMaxLinCreate();
+
+	start = now_ns();
+	for (index = 0; index < count; index++) open_one((void *)index);
+	report("serial", count, now_ns() - start);
+
+	start = now_ns();
+	for (index = 0; index < count; index++)
+		pthread_create(&threads[index], NULL, open_one, (void *)index);
+	for (index = 0; index < count; index++)
+		pthread_join(threads[index], NULL);
+	report("concurrent", count, now_ns() - start);
+
+	start = now_ns();
+	opened = SeaDacOpenAll(0, NULL, all, count);
+	elapsed = now_ns() - start;
+	printf("%-12s %3d modules %10.2f ms total %10.2f ms/open\n", "open all",
+		opened, elapsed / 1e6, (opened > 0) ? elapsed / 1e6 / opened : 0.0);
+	for (index = 0; index < opened; index++)
+	{
+		SeaMaxLinClose(all[index]);
+		SeaMaxLinDestroy(all[index]);
+	}
+
+	reconnect();
+
+	for (index = 0; index < count; index++)
+		SeaMaxLinDestroy(modules[index]);
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * piobench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures the SeaDAC Lite 8126 PIO calls against the stub
+ * libftdi in ftdistub.c: USB bytes written and read per call, transfers per
+ * call and wall-clock time per call.  It also times a read-inputs,
+ * write-outputs control cycle done with separate calls and as a transaction.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -shared -fPIC -o libftdi.so ftdistub.c
+ *   gcc -O2 -I../seadac_lib/source_files -o piobench piobench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: LD_LIBRARY_PATH=. ./piobench [calls [device]]
+ *        (default 100000 calls on "sealevel_d2x://8126")
+ *
+ * Set FTDISTUB_LATENCY_US to give every USB transfer a cost, and
+ * FTDISTUB_LATENCY_TIMER=1 to compare USB profiles, e.g. with the device
+ * "sealevel_d2x://8126?profile=latency".
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <termios.h>
+#include <time.h>
+
+#include "seamaxlin.h"
+
+static unsigned long *writes, *reads, *written, *read;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(SeaMaxLin *module, long calls, const char *name,
+		  int (*call)(SeaMaxLin*, unsigned char*))
+{
+	unsigned long w = *writes, r = *reads, bw = *written, br = *read;
+	unsigned char data[4] = { 0x12, 0x34, 0x56, 0x78 };
+	double start;
+	long n;
+
+	start = now_ns();
+	for (n = 0; n < calls; n++)
+	{
+		data[0] = n;
+		call(module, data);
+	}
+
+	printf("%-24s %8ld calls %7.1f out %6.1f in %5.1f transfers %9.1f ns/call\n",
+		name, calls, (double)(*written - bw) / calls,
+		(double)(*read - br) / calls,
+		(double)(*writes - w + *reads - r) / calls,
+		(now_ns() - start) / calls);
+}
+
+// One idle poll of the INT line; times out straight away.
+static int wait_idle(SeaMaxLin *module, unsigned char *data)
+{
+	seadac_pio_event_s event;
+
+	return SeaDacWaitForChange(module, &event, 0);
+}
+
+// A control cycle: read the inputs and write the outputs of both expanders,
+// once as separate calls and once as a single transaction.
+static unsigned char cycle_in[4], cycle_out[4];
+static SeaDacTxn *cycle;
+
+static int cycle_calls(SeaMaxLin *module, unsigned char *data)
+{
+	int ret;
+
+	cycle_out[0] = data[0];
+	ret = SeaDacGetPIO(module, cycle_in);
+	if (ret < 0) return ret;
+	return SeaDacSetPIO(module, cycle_out);
+}
+
+static int cycle_txn(SeaMaxLin *module, unsigned char *data)
+{
+	cycle_out[0] = data[0];
+	return SeaDacTxnExecute(module, cycle);
+}
+
+int main(int argc, char * argv[])
+{
+	char *device = "sealevel_d2x://8126";
+	unsigned char inputs[4] = { 1, 1, 1, 1 };
+	SeaMaxLin *module;
+	void *stub;
+	long calls = 100000;
+	int ret;
+
+	if (argc > 1) calls = atol(argv[1]);
+	if (calls < 1) calls = 1;
+	if (argc > 2) device = argv[2];
+
+	module = SeaMaxLinCreate();
+	ret = SeaMaxLinOpen(module, device);
+	if (ret < 0)
+	{
+		fprintf(stderr, "open failed (%d); is LD_LIBRARY_PATH=. set?\n", ret);
+		return 1;
+	}
+
+	stub = dlopen("libftdi.so", RTLD_LAZY | RTLD_NOLOAD);
+	writes = stub ? dlsym(stub, "ftdistub_writes") : NULL;
+	reads = stub ? dlsym(stub, "ftdistub_reads") : NULL;
+	written = stub ? dlsym(stub, "ftdistub_bytes_written") : NULL;
+	read = stub ? dlsym(stub, "ftdistub_bytes_read") : NULL;
+	if (!writes || !reads || !written || !read)
+	{
+		fprintf(stderr, "libftdi.so is not the ftdistub library\n");
+		return 1;
+	}
+
+	bench(module, calls, "SeaDacGetPIO", SeaDacGetPIO);
+
+	// The stub reads back every register as zero (all outputs), so make
+	// the banks inputs for the input-only path to have something to read
+	SeaDacSetPIODirection(module, inputs);
+	bench(module, calls, "SeaDacGetInputs", SeaDacGetInputs);
+	wait_idle(module, NULL);
+	bench(module, calls, "SeaDacWaitForChange idle", wait_idle);
+	bench(module, calls, "SeaDacSetPIO", SeaDacSetPIO);
+	bench(module, calls, "SeaDacGetPIODirection", SeaDacGetPIODirection);
+
+	cycle = SeaDacTxnCreate();
+	SeaDacTxnRead(cycle, 0xE8, 0, &cycle_in[0], 2);
+	SeaDacTxnRead(cycle, 0xEA, 0, &cycle_in[2], 2);
+	SeaDacTxnWrite(cycle, 0xE8, 2, &cycle_out[0], 2);
+	SeaDacTxnWrite(cycle, 0xEA, 2, &cycle_out[2], 2);
+	bench(module, calls, "cycle, GetPIO + SetPIO", cycle_calls);
+	bench(module, calls, "cycle, SeaDacTxnExecute", cycle_txn);
+	SeaDacTxnDestroy(cycle);
+
+	SeaMaxLinClose(module);
+	SeaMaxLinDestroy(module);
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * protobench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures the CPU cost of the Modbus protocol layer on its own:
+ * request framing, CRC, response parsing and A/D configuration packing.  No
+ * device, serial port or socket is opened; every frame is synthetic.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o protobench protobench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./protobench [frames]     (default 2000000 frames per case)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+
+#include "seamaxlin.h"
+
+// Allocation counting.  The glibc entry points are wrapped so any heap use
+// inside the protocol layer shows up in the allocs/frame column.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long allocations = 0;
+
+void *malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	allocations++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+// Keeps the optimiser from discarding the work being measured.
+static volatile unsigned int sink;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, long frames, double start,
+		   unsigned long allocStart)
+{
+	double elapsed = now_ns() - start;
+
+	printf("%-32s %10ld frames %8.1f ns/frame %6.2f allocs/frame\n", name,
+		frames, elapsed / frames,
+		(double)(allocations - allocStart) / frames);
+}
+
+static void bench_encode(long frames, seaio_mode_t mode, unsigned char funct,
+			 address_range_t quan, const char *name)
+{
+	unsigned char frame[256], payload[256];
+	unsigned long allocStart = allocations;
+	double start;
+	long n;
+
+	for (n = 0; n < (long)sizeof(payload); n++) payload[n] = n * 7;
+
+	start = now_ns();
+	for (n = 0; n < frames; n++)
+	{
+		payload[0] = n;
+		sink += encodeRequest(mode, n, 1 + (n & 0x7F), funct, n & 0xFFF,
+			quan, payload, frame);
+		sink += frame[n & 7];
+	}
+	report(name, frames, start, allocStart);
+}
+
+static void bench_crc(long frames, int length)
+{
+	unsigned char frame[258];
+	unsigned long allocStart = allocations;
+	char name[64];
+	double start;
+	long n;
+
+	for (n = 0; n < length; n++) frame[n] = n * 13;
+
+	snprintf(name, sizeof(name), "calc_crc %d bytes", length);
+	start = now_ns();
+	for (n = 0; n < frames; n++)
+	{
+		frame[0] = n;
+		calc_crc(length, frame);
+		sink += frame[length];
+	}
+	report(name, frames, start, allocStart);
+}
+
+static void bench_decode(long frames, seaio_mode_t mode, unsigned char funct,
+			 int payloadBytes, const char *name)
+{
+	unsigned char frame[256], data[256];
+	unsigned long allocStart = allocations;
+	int i = 0, length, n;
+	double start;
+	long f;
+
+	// Synthesize a well formed response to parse over and over.
+	if (mode == MODBUS_TCP)
+	{
+		frame[0] = 0;
+		frame[1] = 1;
+		frame[2] = 0;
+		frame[3] = 0;
+		frame[4] = 0;
+		frame[5] = 3 + payloadBytes;
+		i = 6;
+	}
+	frame[i++] = 1;
+	frame[i++] = funct;
+	frame[i++] = payloadBytes;
+	for (n = 0; n < payloadBytes; n++) frame[i++] = n;
+	length = i;
+	if (mode == MODBUS_RTU)
+	{
+		calc_crc(length, frame);
+		length += 2;
+	}
+
+	start = now_ns();
+	for (f = 0; f < frames; f++)
+	{
+		frame[length - 3] = f;
+		sink += decodeResponse(mode, funct, frame, length, data);
+		sink += data[f & 7];
+	}
+	report(name, frames, start, allocStart);
+}
+
+static void bench_adda(long frames)
+{
+	unsigned char buffer[5];
+	adda_config config;
+	unsigned long allocStart = allocations;
+	double start;
+	long n;
+
+	memset(&config, 0, sizeof(config));
+
+	start = now_ns();
+	for (n = 0; n < frames; n++)
+	{
+		config.channels.ch_1 = n & 3;
+		config.device.channel_mode = n & 1;
+		packADDAConfig(&config, buffer);
+		buffer[2] ^= n;
+		unpackADDAConfig(buffer, &config);
+		sink += config.channels.ch_5;
+	}
+	report("ADDA pack+unpack", frames, start, allocStart);
+}
+
+int main(int argc, char * argv[])
+{
+	long frames = 2000000;
+
+	if (argc > 1) frames = atol(argv[1]);
+	if (frames < 1) frames = 1;
+
+	bench_encode(frames, MODBUS_RTU, 0x03, 16, "encode RTU read 0x03");
+	bench_encode(frames, MODBUS_TCP, 0x03, 16, "encode TCP read 0x03");
+	bench_encode(frames, MODBUS_RTU, 0x10, 32, "encode RTU write 0x10 x32");
+	bench_encode(frames, MODBUS_RTU, 0x0F, 96, "encode RTU write 0x0F x96");
+	bench_crc(frames, 8);
+	bench_crc(frames, 64);
+	bench_crc(frames, 253);
+	bench_decode(frames, MODBUS_RTU, 0x03, 64, "decode RTU 0x03 32 regs");
+	bench_decode(frames, MODBUS_TCP, 0x03, 64, "decode TCP 0x03 32 regs");
+	bench_decode(frames, MODBUS_RTU, 0x02, 12, "decode RTU 0x02 96 inputs");
+	bench_adda(frames);
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * reactorbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures the Modbus/TCP reactor (SeaMaxLinReactorStart) with
+ * thousands of simulated modules: each module is a connection to a Modbus/TCP
+ * server forked onto the loopback interface.  For each number of shards it
+ * polls every module at 10 Hz with SeaMaxLinBatch from a single thread,
+ * reporting how long a sweep of all modules takes and the CPU it costs, then
+ * runs sweeps back to back for the most transactions per second.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o reactorbench reactorbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./reactorbench [modules [seconds [servers]]]
+ *        (default 2000 modules, 3 seconds per case, 2 server processes)
+ *
+ * The server processes share the machine, so scaling stops once the shards
+ * and servers together fill the cores.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "seamaxlin.h"
+
+// A Modbus/TCP server answering every read of holding registers with zeros
+static void serve(int listener)
+{
+	struct epoll_event event, events[64];
+	unsigned char request[260], reply[260];
+	int poller, count, index, fd, length, quantity;
+
+	poller = epoll_create1(0);
+	event.events = EPOLLIN;
+	event.data.fd = listener;
+	epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event);
+
+	for (;;)
+	{
+		count = epoll_wait(poller, events, 64, -1);
+		for (index = 0; index < count; index++)
+		{
+			fd = events[index].data.fd;
+			if (fd == listener)
+			{
+				event.data.fd = accept(listener, NULL, NULL);
+				if (event.data.fd >= 0)
+					epoll_ctl(poller, EPOLL_CTL_ADD, event.data.fd, &event);
+				continue;
+			}
+
+			length = recv(fd, request, sizeof(request), 0);
+			if (length <= 0)
+			{
+				close(fd);
+				continue;
+			}
+			if (length < 12) continue;
+
+			memcpy(reply, request, 8);
+			quantity = (request[10] << 8) | request[11];
+			if (request[7] != 0x03 || quantity < 1 || quantity > 125)
+			{
+				reply[7] |= 0x80;
+				reply[8] = 0x01;
+				length = 9;
+			}
+			else
+			{
+				reply[8] = quantity * 2;
+				memset(&reply[9], 0, quantity * 2);
+				length = 9 + quantity * 2;
+			}
+			reply[4] = (length - 6) >> 8;
+			reply[5] = (length - 6) & 0xFF;
+			send(fd, reply, length, 0);
+		}
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double cpu_ns(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9 +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+}
+
+static void bench(int shards, seamax_op_s *ops, int count, double seconds)
+{
+	double start, cpu, sweep, total = 0, slowest = 0, tick;
+	long sweeps = 0, failed = 0, flat = 0;
+
+	// 10 Hz: one sweep of every module each 100 ms
+	start = now_ns();
+	cpu = cpu_ns();
+	for (tick = start; tick < start + seconds * 1e9; tick += 100e6)
+	{
+		while (now_ns() < tick) usleep(1000);
+		sweep = now_ns();
+		failed += count - SeaMaxLinBatch(ops, count);
+		sweep = now_ns() - sweep;
+		total += sweep;
+		if (sweep > slowest) slowest = sweep;
+		sweeps++;
+	}
+	cpu = (cpu_ns() - cpu) / (now_ns() - start);
+
+	printf("%2d shards  10 Hz: %6.1f ms/sweep (max %6.1f) %5.1f%% CPU "
+		"%ld failed", shards, total / sweeps / 1e6, slowest / 1e6,
+		cpu * 100, failed);
+
+	// Flat out
+	start = now_ns();
+	while (now_ns() < start + seconds * 1e9)
+	{
+		failed += count - SeaMaxLinBatch(ops, count);
+		flat += count;
+	}
+	printf("  flat out: %8.0f txns/s\n", flat / ((now_ns() - start) / 1e9));
+}
+
+int main(int argc, char * argv[])
+{
+	struct sockaddr_in address;
+	socklen_t size = sizeof(address);
+	struct rlimit files;
+	SeaMaxLin **modules;
+	seamax_op_s *ops;
+	unsigned char *data;
+	char device[64];
+	double seconds = 3;
+	int count = 2000, servers = 2, listener, index, shards, ret;
+	pid_t *children;
+
+	if (argc > 1) count = atoi(argv[1]);
+	if (count < 1) count = 1;
+	if (argc > 2) seconds = atof(argv[2]);
+	if (argc > 3) servers = atoi(argv[3]);
+	if (servers < 1) servers = 1;
+
+	// Every module holds a socket, in this process and a server's
+	getrlimit(RLIMIT_NOFILE, &files);
+	files.rlim_cur = files.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &files);
+	if (files.rlim_cur < (rlim_t)count + 64)
+	{
+		fprintf(stderr, "only %ld descriptors allowed\n", (long)files.rlim_cur);
+		return 1;
+	}
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+		listen(listener, 4096) < 0 ||
+		getsockname(listener, (struct sockaddr*)&address, &size) < 0)
+	{
+		perror("server socket");
+		return 1;
+	}
+	fcntl(listener, F_SETFL, O_NONBLOCK);
+
+	children = calloc(servers, sizeof(pid_t));
+	for (index = 0; index < servers; index++)
+	{
+		children[index] = fork();
+		if (children[index] == 0) serve(listener);
+	}
+	close(listener);
+
+	modules = calloc(count, sizeof(SeaMaxLin*));
+	ops = calloc(count, sizeof(seamax_op_s));
+	data = calloc(count, 2);
+	printf("%d modules, %d server processes, %ld cores\n", count, servers,
+		sysconf(_SC_NPROCESSORS_ONLN));
+
+	for (shards = 1; shards <= 8; shards *= 2)
+	{
+		ret = SeaMaxLinReactorStart(shards);
+		if (ret < 0)
+		{
+			fprintf(stderr, "reactor start failed (%d)\n", ret);
+			break;
+		}
+
+		for (index = 0; index < count; index++)
+		{
+			snprintf(device, sizeof(device), "sealevel_tcp://127.0.0.1:%d",
+				ntohs(address.sin_port));
+			modules[index] = SeaMaxLinCreate();
+			ret = SeaMaxLinOpen(modules[index], device);
+			if (ret < 0)
+			{
+				fprintf(stderr, "%s: open failed (%d)\n", device, ret);
+				break;
+			}
+			ops[index].module = modules[index];
+			ops[index].slaveId = 1;
+			ops[index].type = HOLDINGREG;
+			ops[index].starting_address = 1;
+			ops[index].range = 1;
+			ops[index].data = &data[index * 2];
+		}
+
+		// The first sweep makes the connections
+		SeaMaxLinBatch(ops, count);
+		bench(shards, ops, count, seconds);
+
+		for (index = 0; index < count; index++)
+		{
+			SeaMaxLinClose(modules[index]);
+			SeaMaxLinDestroy(modules[index]);
+		}
+		SeaMaxLinReactorStop();
+	}
+
+	for (index = 0; index < servers; index++)
+	{
+		kill(children[index], SIGTERM);
+		waitpid(children[index], NULL, 0);
+	}
+	free(children);
+	free(modules);
+	free(ops);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * rwbench.c
+ * SeaMAX for Linux Benchmark Code
+ *
+ * This C code measures the control loop cycle of writing setpoints to a
+ * Modbus RTU device and reading its values back: SeaMaxLinWrite followed by
+ * SeaMaxLinRead, against SeaMaxLinReadWrite, which does both with one read/
+ * write multiple registers (0x17) request.  A third case runs
+ * SeaMaxLinReadWrite against a device that refuses 0x17, so it falls back
+ * to a write and a read.
+ *
+ * Each device is a pseudo-terminal with a forked process on the far end,
+ * holding every reply for as long as the request and reply would take on the
+ * wire at the given baud rate, plus a fixed turnaround.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../seadac_lib/source_files -o rwbench rwbench.c \
+ *       ../seadac_lib/source_files/[a-z]*.c -ldl -lpthread
+ *
+ * Usage: ./rwbench [cycles [baud [registers [turnaround_ms]]]]
+ *        (default 25 cycles, 9600 baud, 10 registers each way, 5 ms)
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2009-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "seamaxlin.h"
+
+static int baud = 9600, turnaround = 5;
+
+// Length of an RTU request, once enough of it is in to tell
+static int requestLength(unsigned char *request, int length)
+{
+	if (length < 2) return 0;
+	switch (request[1])
+	{
+	case 0x10:
+		return (length < 7) ? 0 : 9 + request[6];
+	case 0x17:
+		return (length < 11) ? 0 : 13 + request[10];
+	default:
+		return 8;
+	}
+}
+
+// A Modbus RTU device on a pty with 65536 holding registers, paced as if on
+// the wire; with refuse set it answers 0x17 with an illegal function
+static void serve(int master, int refuse)
+{
+	static unsigned short registers[65536];
+	unsigned char request[300], reply[300];
+	struct timespec wire;
+	int length = 0, incoming, start, quantity, index, size;
+
+	for (;;)
+	{
+		incoming = read(master, &request[length], sizeof(request) - length);
+		if (incoming <= 0) _exit(0);
+		length += incoming;
+		if ((size = requestLength(request, length)) == 0 || length < size)
+			continue;
+
+		reply[0] = request[0];
+		reply[1] = request[1];
+		start = (request[2] << 8) | request[3];
+		quantity = (request[4] << 8) | request[5];
+		switch (request[1])
+		{
+		case 0x10:
+			for (index = 0; index < quantity; index++)
+				registers[(start + index) & 0xFFFF] =
+					(request[7 + index * 2] << 8) | request[8 + index * 2];
+			memcpy(&reply[2], &request[2], 4);
+			size = 6;
+			break;
+
+		case 0x17:
+			if (!refuse)
+			{
+				index = (request[6] << 8) | request[7];
+				for (incoming = 0; incoming < request[10] / 2; incoming++)
+					registers[(index + incoming) & 0xFFFF] =
+						(request[11 + incoming * 2] << 8) |
+						request[12 + incoming * 2];
+			}
+			// Fall through to read back
+
+		case 0x03:
+		case 0x04:
+			if (request[1] == 0x17 && refuse)
+			{
+				reply[1] |= 0x80;
+				reply[2] = 0x01;
+				size = 3;
+				break;
+			}
+			reply[2] = quantity * 2;
+			for (index = 0; index < quantity; index++)
+			{
+				reply[3 + index * 2] = registers[(start + index) & 0xFFFF] >> 8;
+				reply[4 + index * 2] = registers[(start + index) & 0xFFFF];
+			}
+			size = 3 + quantity * 2;
+			break;
+
+		default:
+			reply[1] |= 0x80;
+			reply[2] = 0x01;
+			size = 3;
+			break;
+		}
+		calc_crc(size, reply);
+
+		// Ten bits a byte, request in and reply out, then the turnaround
+		wire.tv_sec = 0;
+		wire.tv_nsec = (length + size + 2) * 10 * 1000000000LL / baud +
+			turnaround * 1000000LL;
+		while (wire.tv_nsec >= 1000000000)
+		{
+			wire.tv_sec++;
+			wire.tv_nsec -= 1000000000;
+		}
+		nanosleep(&wire, NULL);
+		write(master, reply, size + 2);
+		length = 0;
+	}
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static SeaMaxLin *device(int refuse, pid_t *child)
+{
+	SeaMaxLin *module = SeaMaxLinCreate();
+	struct termios raw;
+	char name[64];
+	int master;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+	{
+		perror("posix_openpt");
+		exit(1);
+	}
+	tcgetattr(master, &raw);
+	cfmakeraw(&raw);
+	tcsetattr(master, TCSANOW, &raw);
+	snprintf(name, sizeof(name), "sealevel_rtu:/%s", ptsname(master));
+
+	if ((*child = fork()) == 0) serve(master, refuse);
+	if (SeaMaxLinOpen(module, name) < 0)
+	{
+		fprintf(stderr, "can't open %s\n", name);
+		exit(1);
+	}
+	close(master);
+	return module;
+}
+
+static void bench(const char *name, SeaMaxLin *module, int combined,
+	int cycles, int registers)
+{
+	unsigned char setpoints[256], values[256];
+	int cycle, index, failed = 0, wrong = 0, ret;
+	double start, elapsed;
+
+	start = now_ms();
+	for (cycle = 0; cycle < cycles; cycle++)
+	{
+		for (index = 0; index < registers * 2; index++)
+			setpoints[index] = cycle + index;
+
+		// Read back what was just written, to check the order
+		if (combined)
+			ret = SeaMaxLinReadWrite(module, 1, HOLDINGREG, 100, registers,
+				values, 100, registers, setpoints);
+		else if ((ret = SeaMaxLinWrite(module, 1, HOLDINGREG, 100,
+			registers, setpoints)) >= 0)
+			ret = SeaMaxLinRead(module, 1, HOLDINGREG, 100, registers,
+				values);
+
+		if (ret < 0) failed++;
+		else if (memcmp(setpoints, values, registers * 2) != 0) wrong++;
+	}
+	elapsed = now_ms() - start;
+
+	printf("%-34s %7.1f ms/cycle %d failed %d wrong\n", name,
+		elapsed / cycles, failed, wrong);
+}
+
+int main(int argc, char * argv[])
+{
+	SeaMaxLin *plain, *refusing;
+	pid_t children[2];
+	int cycles = 25, registers = 10;
+
+	if (argc > 1) cycles = atoi(argv[1]);
+	if (argc > 2) baud = atoi(argv[2]);
+	if (argc > 3) registers = atoi(argv[3]);
+	if (argc > 4) turnaround = atoi(argv[4]);
+	if (cycles < 1) cycles = 1;
+	if (baud < 1200) baud = 1200;
+	if (registers < 1 || registers > 121) registers = 10;
+
+	plain = device(0, &children[0]);
+	refusing = device(1, &children[1]);
+
+	printf("%d registers each way at %d baud, %d ms turnaround\n\n",
+		registers, baud, turnaround);
+	bench("SeaMaxLinWrite + SeaMaxLinRead", plain, 0, cycles, registers);
+	bench("SeaMaxLinReadWrite (0x17)", plain, 1, cycles, registers);
+	bench("SeaMaxLinReadWrite, 0x17 refused", refusing, 1, cycles,
+		registers);
+
+	SeaMaxLinClose(plain);
+	SeaMaxLinClose(refusing);
+	SeaMaxLinDestroy(plain);
+	SeaMaxLinDestroy(refusing);
+	kill(children[0], SIGTERM);
+	kill(children[1], SIGTERM);
+	waitpid(children[0], NULL, 0);
+	waitpid(children[1], NULL, 0);
+	return 0;
+}
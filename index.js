@@ -24,14 +24,19 @@ class SeaDAC {
 
   open() {
     return new Promise((resolve, reject) => {
-      const res = this.lib.SeaMaxLinOpen(this.seaDAC, this.port);
-      if (res !== 0) {
-        const error = new Error('Could not open device');
-        error.cause = 'hardware error';
-        error.hardwareErrorCode = ret;
-        return reject(error);
-      }
-      return resolve(res);
+      // Opening waits on the USB device, so run it off the event loop
+      this.lib.SeaMaxLinOpen.async(this.seaDAC, this.port, (err, res) => {
+        if (err) {
+          return reject(err);
+        }
+        if (res !== 0) {
+          const error = new Error('Could not open device');
+          error.cause = 'hardware error';
+          error.hardwareErrorCode = res;
+          return reject(error);
+        }
+        return resolve(res);
+      });
     })
   }
 
@@ -68,7 +68,38 @@ typedef int (*pf_ftdi_set_bitmode)(ftdi_context ftdi, unsigned char bitmask, uns
 //int ftdi_read_pins(struct ftdi_context *ftdi, unsigned char *pins);
 typedef int (*pf_ftdi_read_pins)(ftdi_context ftdi, unsigned char *pins);
 
+//int ftdi_set_latency_timer(struct ftdi_context *ftdi, unsigned char latency);
+typedef int (*pf_ftdi_set_latency_timer)(ftdi_context ftdi, unsigned char latency);
+//int ftdi_get_latency_timer(struct ftdi_context *ftdi, unsigned char *latency);
+typedef int (*pf_ftdi_get_latency_timer)(ftdi_context ftdi, unsigned char *latency);
+//int ftdi_read_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize);
+typedef int (*pf_ftdi_read_data_set_chunksize)(ftdi_context ftdi, unsigned int chunksize);
+//int ftdi_write_data_set_chunksize(struct ftdi_context *ftdi, unsigned int chunksize);
+typedef int (*pf_ftdi_write_data_set_chunksize)(ftdi_context ftdi, unsigned int chunksize);
+
 //char *ftdi_get_error_string(struct ftdi_context *ftdi);
 typedef char* (*pf_ftdi_get_error_string)(ftdi_context ftdi);
+
+/** List of devices found by ftdi_usb_find_all; dev is the libusb device */
+struct ftdi_device_list
+{
+    struct ftdi_device_list *next;
+    void *dev;
+};
+
+//int ftdi_usb_find_all(struct ftdi_context *ftdi, struct ftdi_device_list **devlist, int vendor, int product);
+typedef int (*pf_ftdi_usb_find_all)(ftdi_context ftdi, struct ftdi_device_list **devlist, int vendor, int product);
+//void ftdi_list_free(struct ftdi_device_list **devlist);
+typedef void (*pf_ftdi_list_free)(struct ftdi_device_list **devlist);
+//int ftdi_usb_get_strings(struct ftdi_context *ftdi, struct usb_device *dev, char *manufacturer, int mnf_len, char *description, int desc_len, char *serial, int serial_len);
+typedef int (*pf_ftdi_usb_get_strings)(ftdi_context ftdi, void *dev, char *manufacturer, int mnf_len, char *description, int desc_len, char *serial, int serial_len);
+//int ftdi_usb_open_dev(struct ftdi_context *ftdi, struct usb_device *dev);
+typedef int (*pf_ftdi_usb_open_dev)(ftdi_context ftdi, void *dev);
+
+/** libusb-1.0, under libftdi 1.x (the one with ftdi_get_library_version) */
+//uint8_t libusb_get_bus_number(libusb_device *dev);
+typedef unsigned char (*pf_libusb_get_bus_number)(void *dev);
+//uint8_t libusb_get_device_address(libusb_device *dev);
+typedef unsigned char (*pf_libusb_get_device_address)(void *dev);
  
 #endif /* __libftdi_bind_h__ */
@@ -25,8 +25,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 #include "seamaxlin.h"
+#include "seamaxprobes.h"
 #include "ftdi.h"
 
 // Sealevel vendor ID number
@@ -35,6 +38,52 @@
 #define MAXIMUM_COMMANDS	255
 #define MAXIMUM_COMMAND_BYTES	4096
 
+// Response bytes per chunk.  Two chunks may be in flight at once, and their
+// replies must fit the FT2232C/D's 384 byte transmit buffer or it stalls.
+#define MAXIMUM_RESPONSE_BYTES	128
+
+// How long to wait for the responses to one chunk
+#define RESPONSE_TIMEOUT_MS	1000
+
+// How long the chip may take to answer after a mode change
+#define READY_TIMEOUT_MS	1000
+
+// USB tuning profiles, chosen with the profile= option
+#define PROFILE_DEFAULT		0
+#define PROFILE_LATENCY		1
+#define PROFILE_THROUGHPUT	2
+#define PROFILE_AUTO		3
+
+// libftdi transfer chunk sizes: its own default, and those of the profiles
+#define DEFAULT_CHUNK_BYTES	4096
+#define LATENCY_CHUNK_BYTES	512
+#define THROUGHPUT_CHUNK_BYTES	16384
+
+// Round trips timed at each latency timer setting by SeaDacCalibrate
+#define CALIBRATION_ROUNDS	5
+
+// How long a lost module is looked for by default (reconnect= option), and
+// the pause between attempts to reopen it
+#define RECONNECT_MS		100
+#define RECONNECT_POLL_MS	5
+
+// Steps per synchronous bit bang write.  Fits the FT2232's 384 byte receive
+// buffer, so the write completes before any of its samples are read.
+#define EXCHANGE_CHUNK_BYTES	256
+
+// MPSSE master clocks: FT2232C/D, and H series with the divide by 5 off
+#define MPSSE_CLOCK		12000000
+#define MPSSE_CLOCK_H		60000000
+
+// Which of the 8126 register copies kept in the module are up to date
+#define PIO_CACHED_DIRECTION	0x01
+#define PIO_CACHED_OUTPUT	0x02
+#define PIO_CACHED_EVENT	0x04
+
+// Levels seen on SCL and SDA for an 0x80 value and direction; a released
+// line is pulled high
+#define I2C_LEVELS(value, direction)	(((value) | ~(direction)) & (SCL | SDA))
+
 // ----------------------------------------------------------------------------
 // SeaDAC Lite range configuration type.
 // This is the range of available SeaDAC products
@@ -60,15 +109,78 @@ typedef enum
 	GPIO_4 = 0x10, GPIO_5 = 0x20, GPIO_6 = 0x40, GPIO_7 = 0x80
 } sdl_i2c_type;
 
-static unsigned char	i2cMPSSEValue;
-static unsigned char	i2cMPSSEDirection;
+// ----------------------------------------------------------------------------
+// One USB write worth of MPSSE commands, and where its response bytes go.
+// The command buffer is reused for the responses once it has been sent.
+// ----------------------------------------------------------------------------
+typedef struct i2c_chunk
+{
+	unsigned char MPSSECommand[MAXIMUM_COMMAND_BYTES];
+	int byteIndex;
+	int bytesToRead;
+	int responseCount;
+	int responseOffsets[MAXIMUM_COMMANDS];
+	void* variableCallbacks[MAXIMUM_COMMANDS];
+	int inFlight;
+} i2c_chunk;
+
+// ----------------------------------------------------------------------------
+// An I2C transaction queue, one per 8126 module.  Commands are built in the
+// open chunk; when it fills it is sent and the other chunk, sent earlier, has
+// its responses collected, so the device always has the next chunk waiting.
+// ----------------------------------------------------------------------------
+typedef struct i2c_queue
+{
+	i2c_chunk chunk[2];
+	i2c_chunk *open;		//Chunk being built.
+	unsigned char value;		//Low GPIO byte (0x80) state...
+	unsigned char direction;	//... and direction.
+	int error;			//First failure since the queue was started.
+	int started;			//A chunk has been sent.
+	int sent, received;		//Bytes moved for the statistics.
+} i2c_queue;
+
+// Opening and listing modules walk libusb's global device list, so threads
+// doing either take turns at it
+static pthread_mutex_t d2xOpenLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Append one command byte to the open chunk
+#define I2C_EMIT(q, byte)	((q)->open->MPSSECommand[(q)->open->byteIndex++] = (byte))
+
+// Command bytes queued by each I2C step
+#define I2C_START_BYTES		12
+#define I2C_STOP_BYTES		12
+#define I2C_ADDRESS_BYTES	11
+#define I2C_WRITE_BYTES		14
+#define I2C_READ_BYTES		11
+
+void I2C_FlushQueue(seaMaxModule* in);
+
+// Kinds of transaction step
+#define TXN_READ	0
+#define TXN_WRITE	1
+#define TXN_GPIO	2
 
-static unsigned char MPSSECommand[MAXIMUM_COMMAND_BYTES];
-static int byteIndex;
-static int bytesToRead;
-static int responseCount;
-static int responseOffsets[MAXIMUM_COMMANDS];
-static void* variableCallbacks[MAXIMUM_COMMANDS];
+// ----------------------------------------------------------------------------
+// One step of a SeaDAC Lite transaction.
+// ----------------------------------------------------------------------------
+typedef struct seadac_txn_op_s
+{
+	int type;			//TXN_READ, TXN_WRITE or TXN_GPIO.
+	unsigned char address;		//I/O expander address and ...
+	unsigned char reg;		//... first register.
+	unsigned char direction;	//GPIO direction and ...
+	unsigned char state;		//... levels.
+	unsigned char *data;		//Caller's buffer.
+	int count;			//Registers to transfer.
+} seadac_txn_op_s;
+
+struct seadac_txn_s
+{
+	seadac_txn_op_s *ops;
+	int count;
+	int size;
+};
 
 
 //  --------------------------------------------------------------------------
@@ -90,12 +202,78 @@ int SDL_IsSupported(int pid)
 }
 
 
+//  --------------------------------------------------------------------------
+// ( Private function programs the MPSSE clock for a given I2C rate.          )
+// H series parts are told apart by their answer to 0x8A (divide by 5 off):
+// older chips reject it with the bad command reply 0xFA 0x8A.  H parts also
+// get 3-phase clocking (0x8C), so SDA is held across the falling SCL edge
+// the way I2C requires; that stretches each bit to 3 half periods.
+// A reply can sit in the chip until its latency timer runs out, so 0x8A is
+// followed by an opcode every part rejects (0xAA), and replies are read until
+// that one's comes back: whatever 0x8A drew is in by then.
+//  --------------------------------------------------------------------------
+int I2C_SetClock(seaMaxModule* in, unsigned int clock)
+{
+	unsigned long long deadline = statsNow() + READY_TIMEOUT_MS * 1000000ULL;
+	unsigned char command[3], reply[64], last = 0;
+	unsigned int divisor;
+	int ret, index, hseries = 1, synced = 0;
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+
+	if (!ftdi_write_data || !ftdi_read_data) return -EIO;
+
+	command[0] = 0x8A;
+	command[1] = 0xAA;
+	if (ftdi_write_data(in->ftdic, &command[0], 1) != 1 ||
+		ftdi_write_data(in->ftdic, &command[1], 1) != 1) return -EIO;
+
+	while (!synced)
+	{
+		ret = ftdi_read_data(in->ftdic, reply, sizeof(reply));
+		if (ret < 0) return -EIO;
+		for (index = 0; index < ret && !synced; index++)
+		{
+			if (last == 0xFA && reply[index] == 0x8A) hseries = 0;
+			synced = (last == 0xFA && reply[index] == 0xAA);
+			last = reply[index];
+		}
+		if (synced) break;
+		if (statsNow() >= deadline) return -EIO;
+		if (ret == 0) usleep(1000);
+	}
+
+	if (hseries)
+	{
+		// Enable 3-phase data clocking
+		command[0] = 0x8C;
+		if (ftdi_write_data(in->ftdic, command, 1) != 1) return -EIO;
+
+		// SCL = 60 MHz / ((1 + divisor) * 3), rounded down to the next rate
+		divisor = (MPSSE_CLOCK_H + 3 * clock - 1) / (3 * clock) - 1;
+	}
+	else
+	{
+		// SCL = 12 MHz / ((1 + divisor) * 2), rounded down to the next rate
+		divisor = (MPSSE_CLOCK + 2 * clock - 1) / (2 * clock) - 1;
+	}
+	if (divisor > 0xFFFF) divisor = 0xFFFF;
+
+	command[0] = 0x86;
+	command[1] = divisor & 0xFF;
+	command[2] = divisor >> 8;
+	if (ftdi_write_data(in->ftdic, command, 3) != 3) return -EIO;
+	return 0;
+}
+
+
 //  --------------------------------------------------------------------------
 // ( Private function set the chipset into bit bang mode for I2C emulation.   )
 //  --------------------------------------------------------------------------
 int I2C_InitializeI2C(seaMaxModule* in)
 {
 	unsigned char InitCommand[32];
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
 	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
 	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
 
@@ -111,28 +289,32 @@ int I2C_InitializeI2C(seaMaxModule* in)
 		// Read in the state of the GPIO
 		InitCommand[0] = 0x81;
 		ftdi_write_data(in->ftdic, InitCommand, 1);
-		ftdi_read_data(in->ftdic, (unsigned char*)&i2cMPSSEValue, 1);
+		ftdi_read_data(in->ftdic, &q->value, 1);
 
 		// Mask out anything but the GPIO, then ...
 		//
 		// Set the SCL and SDA as outputs (high), set TDO/DI and TMS/CS as inputs
 		// Everything else is set as a low output
-		i2cMPSSEValue &= 0xF0;
-		i2cMPSSEValue |= (SCL | SDA);
-		i2cMPSSEDirection = 0xF3;
+		q->value &= 0xF0;
+		q->value |= (SCL | SDA);
+		q->direction = 0xF3;
 
 		// Set the I/O Direction for the first 8 ADBUS lines (Command 0x80)
 		// All are outputs (excluding TMS/CS - we don't use it anyway)
 		InitCommand[0] = 0x80;
-		InitCommand[1] = i2cMPSSEValue;
-		InitCommand[2] = i2cMPSSEDirection;
+		InitCommand[1] = q->value;
+		InitCommand[2] = q->direction;
 		ftdi_write_data(in->ftdic, InitCommand, 3);
 
-		// Set the clock divisor to product approximate a 45 KHz (Command 0x86)
-		InitCommand[0] = 0x86;
-		InitCommand[1] = 0x0D;
-		InitCommand[2] = 0x00;
-		ftdi_write_data(in->ftdic, InitCommand, 3);
+		if (in->i2cClock == 0)
+		{
+			// Set the clock divisor to product approximate a 45 KHz (Command 0x86)
+			InitCommand[0] = 0x86;
+			InitCommand[1] = 0x0D;
+			InitCommand[2] = 0x00;
+			ftdi_write_data(in->ftdic, InitCommand, 3);
+		}
+		else if (I2C_SetClock(in, in->i2cClock) < 0) return -EIO;
 
 		// Disable loopback (local echo)
 		InitCommand[0] = 0x85;
@@ -148,64 +330,64 @@ int I2C_InitializeI2C(seaMaxModule* in)
 //  --------------------------------------------------------------------------
 // ( Private function set the I2C start condition.                            )
 //  --------------------------------------------------------------------------
-void I2C_Start()
+void I2C_Start(i2c_queue* q)
 {
 	// Set the data line as a high output
-	i2cMPSSEDirection |= (SDA | SCL);
-	i2cMPSSEValue |= SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= (SDA | SCL);
+	q->value |= SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Set the clock and data lines high
-	i2cMPSSEValue |= (SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->value |= (SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Set the clock high and data line low
-	i2cMPSSEValue &= ~SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->value &= ~SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Set the clock and data lines low
-	i2cMPSSEValue &= ~(SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->value &= ~(SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 }
 
 //  --------------------------------------------------------------------------
 // ( Private function set the I2C stop condition and prepare to listen.       )
 //  --------------------------------------------------------------------------
-void I2C_Stop()
+void I2C_Stop(i2c_queue* q)
 {
 	// Set the data line low
-	i2cMPSSEDirection |= (SCL | SDA);
-	i2cMPSSEValue &= ~SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= (SCL | SDA);
+	q->value &= ~SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Set the clock high and data line low
-	i2cMPSSEValue |= SCL;
-	i2cMPSSEValue &= ~SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->value |= SCL;
+	q->value &= ~SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Set the clock and data lines high
-	i2cMPSSEValue |= (SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->value |= (SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Set the clock and data lines as inputs
-	i2cMPSSEDirection &= ~(SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction &= ~(SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 }
 
 
@@ -217,543 +399,2158 @@ void I2C_Stop()
 // function would be called with address = 0xA2, rw = 0x01.  Likewise, to perform
 // a write to the same address, the rw parameter would be set to zero.
 //  --------------------------------------------------------------------------
-void I2C_WriteAddress(unsigned char address, int rw)
+void I2C_WriteAddress(i2c_queue* q, unsigned char address, int rw)
 {
 	// Write the address
-	MPSSECommand[byteIndex++] = 0x13;
-	MPSSECommand[byteIndex++] = 7;
-	MPSSECommand[byteIndex++] = (address & 0xFE) | (rw & 0x01);
+	I2C_EMIT(q, 0x13);
+	I2C_EMIT(q, 7);
+	I2C_EMIT(q, (address & 0xFE) | (rw & 0x01));
 
 	// Read the acknowledgement
 	// Configure the clock as an output and data line as an input
-	i2cMPSSEDirection |= SCL;
-	i2cMPSSEDirection &= ~SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= SCL;
+	q->direction &= ~SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Check the ACK bit
-	MPSSECommand[byteIndex++] = 0x26;
-	MPSSECommand[byteIndex++] = 0;
+	I2C_EMIT(q, 0x26);
+	I2C_EMIT(q, 0);
+	q->open->bytesToRead++;
 
 	// Configure the clock and data lines as outputs (both low) again
-	i2cMPSSEDirection |= (SCL | SDA);
-	i2cMPSSEValue &= ~(SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= (SCL | SDA);
+	q->value &= ~(SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 }
 
 
 //  --------------------------------------------------------------------------
 // ( Private function write a byte to SDA and check ack.                      )
 //  --------------------------------------------------------------------------
-void I2C_WriteByte(unsigned char byte)
+void I2C_WriteByte(i2c_queue* q, unsigned char byte)
 {
 
 	// Configure the lines as an output again
-	i2cMPSSEDirection |= (SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= (SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Write out the byte
-	MPSSECommand[byteIndex++] = 0x13;
-	MPSSECommand[byteIndex++] = 7;
-	MPSSECommand[byteIndex++] = byte;
+	I2C_EMIT(q, 0x13);
+	I2C_EMIT(q, 7);
+	I2C_EMIT(q, byte);
 
 	// Configure the clock as an output and data line as an input
-	i2cMPSSEDirection |= SCL;
-	i2cMPSSEDirection &= ~SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= SCL;
+	q->direction &= ~SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Check the ACK bit
-	MPSSECommand[byteIndex++] = 0x26;
-	MPSSECommand[byteIndex++] = 0;
+	I2C_EMIT(q, 0x26);
+	I2C_EMIT(q, 0);
+	q->open->bytesToRead++;
 
 	// Configure the clock and data lines as outputs (both low) again
-	i2cMPSSEDirection |= (SCL | SDA);
-	i2cMPSSEValue &= ~(SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= (SCL | SDA);
+	q->value &= ~(SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function read a byte from SDA and check ack.                     )
+// ( Private function read a byte from SDA and acknowledge it.                )
+// The byte is stored at data when the queue's responses come back.  Pass a
+// non-zero ack to ask the slave for another byte; the last byte of a read is
+// never acknowledged.
 //  --------------------------------------------------------------------------
-void I2C_ReadByte()
+void I2C_ReadByte(i2c_queue* q, unsigned char* data, int ack)
 {
 	// Configure the clock as an output and data line as an input
-	i2cMPSSEDirection |= SCL;
-	i2cMPSSEDirection &= ~SDA;
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
+	q->direction |= SCL;
+	q->direction &= ~SDA;
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
 
 	// Read the slave's data byte
-	MPSSECommand[byteIndex++] = 0x26;
-	MPSSECommand[byteIndex++] = 7;
+	I2C_EMIT(q, 0x26);
+	I2C_EMIT(q, 7);
+	q->open->responseOffsets[q->open->responseCount] = q->open->bytesToRead++;
+	q->open->variableCallbacks[q->open->responseCount++] = data;
 
 	// Set the clock and data lines as outputs (both low) again
 	// Configure the clock and data lines as outputs (both low) again
-	i2cMPSSEDirection |= (SCL | SDA);
-	i2cMPSSEValue &= ~(SCL | SDA);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
-
-	// Write out our acknowledgement
-	MPSSECommand[byteIndex++] = 0x13;
-	MPSSECommand[byteIndex++] = 1;
-	MPSSECommand[byteIndex++] = 0x80;
+	q->direction |= (SCL | SDA);
+	q->value &= ~(SCL | SDA);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
+
+	// Write out our acknowledgement (SDA low) or not (SDA high)
+	I2C_EMIT(q, 0x13);
+	if (ack)
+	{
+		I2C_EMIT(q, 0);
+		I2C_EMIT(q, 0x00);
+	}
+	else
+	{
+		I2C_EMIT(q, 1);
+		I2C_EMIT(q, 0x80);
+	}
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function reads an I2C register.                                  )
+// ( Private function makes room in the open chunk for the next I2C step.     )
+// When the step would not fit, the chunk is sent as it is.  Steps only ever
+// end with SCL held low, so the bus simply waits for the next chunk.
 //  --------------------------------------------------------------------------
-void I2C_ReadRegister(unsigned char address, unsigned char reg, unsigned char* data)
+void I2C_Reserve(seaMaxModule* in, int commandBytes, int responses)
 {
-	I2C_Start();
-	I2C_WriteAddress(address, 0);
-	I2C_WriteByte(reg);
-	I2C_Start();
-	I2C_WriteAddress(address, 1);
-	I2C_ReadByte();
-	I2C_Stop();
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
 
-	bytesToRead += 4;
-
-	responseOffsets[responseCount] = bytesToRead - 1;
-	variableCallbacks[responseCount++] = data;
+	if (q->open->byteIndex + commandBytes > MAXIMUM_COMMAND_BYTES ||
+		q->open->bytesToRead + responses > MAXIMUM_RESPONSE_BYTES ||
+		q->open->responseCount + responses > MAXIMUM_COMMANDS)
+	{
+		I2C_FlushQueue(in);
+	}
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function write to an I2C register.                               )
+// ( Private function reads consecutive I2C registers in one transaction.     )
+// The PCA9535 steps its command pointer to the other register of a pair
+// (0/1, 2/3, 4/5, 6/7) after each byte, so a pair costs one transaction.
 //  --------------------------------------------------------------------------
-void I2C_WriteRegister(unsigned char address, unsigned char reg, unsigned char data)
+void I2C_ReadRegisters(seaMaxModule* in, unsigned char address, unsigned char reg, unsigned char* data, int count)
 {
-	I2C_Start();
-	I2C_WriteAddress(address, 0);
-	I2C_WriteByte(reg);
-	I2C_WriteByte(data);
-	I2C_Stop();
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
+	int i;
 
-	bytesToRead += 3;
+	I2C_Reserve(in, 2 * I2C_START_BYTES + 2 * I2C_ADDRESS_BYTES + I2C_WRITE_BYTES, 3);
+	I2C_Start(q);
+	I2C_WriteAddress(q, address, 0);
+	I2C_WriteByte(q, reg);
+	I2C_Start(q);
+	I2C_WriteAddress(q, address, 1);
+
+	for (i = 0; i < count; i++)
+	{
+		I2C_Reserve(in, I2C_READ_BYTES, 1);
+		I2C_ReadByte(q, &data[i], i < count - 1);
+	}
 
+	I2C_Reserve(in, I2C_STOP_BYTES, 0);
+	I2C_Stop(q);
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function initializes I2C queue.                                  )
+// ( Private function reads an I2C register.                                  )
 //  --------------------------------------------------------------------------
-void I2C_InitializeQueue(seaMaxModule* in)
+void I2C_ReadRegister(seaMaxModule* in, unsigned char address, unsigned char reg, unsigned char* data)
 {
-	pf_ftdi_usb_purge_buffers ftdi_usb_purge_buffers = dlsym(in->libftdi, "ftdi_usb_purge_buffers");
+	I2C_ReadRegisters(in, address, reg, data, 1);
+}
 
-	byteIndex = 0;
-	bytesToRead = 0;
-	responseCount = 0;
 
-	memset(responseOffsets, 0, sizeof(responseOffsets));
-	memset(variableCallbacks, 0, sizeof(variableCallbacks));
+//  --------------------------------------------------------------------------
+// ( Private function writes consecutive I2C registers in one transaction.    )
+//  --------------------------------------------------------------------------
+void I2C_WriteRegisters(seaMaxModule* in, unsigned char address, unsigned char reg, unsigned char* data, int count)
+{
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
+	int i;
+
+	I2C_Reserve(in, I2C_START_BYTES + I2C_ADDRESS_BYTES + I2C_WRITE_BYTES, 2);
+	I2C_Start(q);
+	I2C_WriteAddress(q, address, 0);
+	I2C_WriteByte(q, reg);
 
-	if (ftdi_usb_purge_buffers) ftdi_usb_purge_buffers(in->ftdic);
+	for (i = 0; i < count; i++)
+	{
+		I2C_Reserve(in, I2C_WRITE_BYTES, 1);
+		I2C_WriteByte(q, data[i]);
+	}
+
+	I2C_Reserve(in, I2C_STOP_BYTES, 0);
+	I2C_Stop(q);
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function executes I2C queue.                                     )
+// ( Private function write to an I2C register.                               )
 //  --------------------------------------------------------------------------
-void I2C_ExecuteQueue(seaMaxModule* in)
+void I2C_WriteRegister(seaMaxModule* in, unsigned char address, unsigned char reg, unsigned char data)
 {
-	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
-	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+	I2C_WriteRegisters(in, address, reg, &data, 1);
+}
+
 
-	if (ftdi_write_data) ftdi_write_data(in->ftdic, MPSSECommand, byteIndex);
-	memset(MPSSECommand, 0, sizeof(MPSSECommand));
-	if (ftdi_read_data) ftdi_read_data(in->ftdic, MPSSECommand, bytesToRead);
+//  --------------------------------------------------------------------------
+// ( Private function initializes I2C queue.                                  )
+//  --------------------------------------------------------------------------
+void I2C_InitializeQueue(seaMaxModule* in)
+{
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
+	pf_ftdi_usb_purge_buffers ftdi_usb_purge_buffers = dlsym(in->libftdi, "ftdi_usb_purge_buffers");
+	int i;
 
-	for (int i = 0; i < responseCount; i++)
+	for (i = 0; i < 2; i++)
 	{
-		*((unsigned char*)variableCallbacks[i]) = MPSSECommand[responseOffsets[i]];
+		q->chunk[i].byteIndex = 0;
+		q->chunk[i].bytesToRead = 0;
+		q->chunk[i].responseCount = 0;
+		q->chunk[i].inFlight = 0;
 	}
+	q->open = &q->chunk[0];
+	q->error = 0;
+	q->started = 0;
+	q->sent = 0;
+	q->received = 0;
+
+	if (ftdi_usb_purge_buffers) ftdi_usb_purge_buffers(in->ftdic);
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function sets or clears a GPIO state and direction.              )
-// Direction can be a logical OR'ing of any of the GPIO values and their state.  For
-// instance, I2C_SetGPIO( (GPIO_0 | GPIO_1) , GPIO_1 ) sets the GPIO_0 and GPIO_1 pins
-// as outputs, with the GPIO_0 pin low and the GPIO_1 pin high.  All other GPIOs (2 & 3)
-// are configured as inputs.
+// ( Private function removes pin writes that cannot change the bus.          )
+// The I2C helpers set SCL/SDA with 0x80 (and the high GPIO with 0x82) before
+// and after nearly every step, so a queue holds many writes that repeat the
+// current state, or that only flip SDA between a driven high and a released
+// (pulled up) high right before another write.  Dropping those leaves the
+// sequence of levels on every pin exactly as it was, so no edge is lost or
+// reordered; only the idle time between edges gets shorter.  The clocked
+// commands (0x13, 0x26) move SCL and SDA themselves, so the low byte state is
+// forgotten after one.  Anything unrecognised is passed on untouched.
 //  --------------------------------------------------------------------------
-void I2C_SetGPIO(unsigned char direction, unsigned char state)
+void I2C_OptimizeQueue(i2c_chunk* chunk)
 {
-	// Clear the stored state of the GPIO
-	i2cMPSSEValue &= 0x0F;
-	i2cMPSSEDirection &= 0x0F;
+	int read = 0, write = 0, length, known = 0, knownHigh = 0, afterPin = 0;
+	unsigned char value = 0, direction = 0, highValue = 0, highDirection = 0;
+	unsigned char *command;
 
-	// Set the state and direction
-	i2cMPSSEValue |= (state << 4);
-	i2cMPSSEDirection |= (direction << 4);
-	MPSSECommand[byteIndex++] = 0x80;
-	MPSSECommand[byteIndex++] = i2cMPSSEValue;
-	MPSSECommand[byteIndex++] = i2cMPSSEDirection;
-	MPSSECommand[byteIndex++] = 0x82;
-	MPSSECommand[byteIndex++] = (state >> 4);
-	MPSSECommand[byteIndex++] = (direction >> 4);
-}
+	while (read < chunk->byteIndex)
+	{
+		command = &chunk->MPSSECommand[read];
+		switch (command[0])
+		{
+		case 0x80: case 0x82: case 0x13:	length = 3; break;
+		case 0x26:				length = 2; break;
+		case 0x81: case 0x83: case 0x87:	length = 1; break;
+		default:				length = 0; break;
+		}
+
+		// Copy the rest verbatim if we can't follow it
+		if (length == 0 || read + length > chunk->byteIndex)
+		{
+			memmove(&chunk->MPSSECommand[write], command, chunk->byteIndex - read);
+			write += chunk->byteIndex - read;
+			break;
+		}
+
+		if (command[0] == 0x80)
+		{
+			// Same state again
+			if (known && command[1] == value && command[2] == direction)
+			{
+				read += length;
+				continue;
+			}
+
+			// Same levels on every pin, and replaced by the very next write
+			if (afterPin && read + length < chunk->byteIndex &&
+				chunk->MPSSECommand[read + length] == 0x80 &&
+				I2C_LEVELS(command[1], command[2]) == I2C_LEVELS(value, direction) &&
+				((command[1] ^ value) & ~(SCL | SDA)) == 0 &&
+				((command[2] ^ direction) & ~(SCL | SDA)) == 0)
+			{
+				read += length;
+				continue;
+			}
+
+			value = command[1];
+			direction = command[2];
+			known = afterPin = 1;
+		}
+		else if (command[0] == 0x82)
+		{
+			if (knownHigh && command[1] == highValue && command[2] == highDirection)
+			{
+				read += length;
+				continue;
+			}
+
+			highValue = command[1];
+			highDirection = command[2];
+			knownHigh = 1;
+			afterPin = 0;
+		}
+		else
+		{
+			if (command[0] == 0x13 || command[0] == 0x26) known = 0;
+			afterPin = 0;
+		}
+
+		memmove(&chunk->MPSSECommand[write], command, length);
+		write += length;
+		read += length;
+	}
 
+	chunk->byteIndex = write;
+}
 
 
 //  --------------------------------------------------------------------------
-// ( Private function to open a SeaDAC Lite                                   )
+// ( Private function collects the responses to a sent chunk.                 )
+// Every response byte that isn't queued data is an acknowledge bit read
+// from a slave (bit 0, low for ACK).  A missing acknowledge usually means
+// the clock is too fast for the bus, and fails the whole queue.
 //  --------------------------------------------------------------------------
-int openD2X(SeaMaxLin *SeaMaxPointer, char *devName)
+void I2C_CollectChunk(seaMaxModule* in, i2c_chunk* chunk)
 {
-	int ret, pid;
-	char *ptr;
-	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
+	unsigned long long deadline = statsNow() + RESPONSE_TIMEOUT_MS * 1000000ULL;
+	int ret = 0, got = 0, i, j, nack = 0;
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
 
-	//Quick test to make sure nothing is already opened
-	if (in->hDevice > 0) return -EBUSY;
+	chunk->inFlight = 0;
+	if (q->error) return;
 
-	//Check user input device string
-	pid = strtol(devName, &ptr, 16);
-	if (!SDL_IsSupported(pid))
+	// The device may still be working through the chunk
+	SEAMAX_PROBE3(ftdi_transfer_begin, in->traceId, 1, chunk->bytesToRead);
+	while (got < chunk->bytesToRead)
 	{
-		fprintf(stderr, "Device type is not supported\n");
-		return -ERANGE;
+		ret = ftdi_read_data ? ftdi_read_data(in->ftdic,
+			&chunk->MPSSECommand[got], chunk->bytesToRead - got) : -1;
+		if (ret < 0) break;
+		got += ret;
+		if (ret == 0 && statsNow() > deadline) break;
 	}
-	else if (*ptr != '\0')
+	SEAMAX_PROBE3(ftdi_transfer_end, in->traceId, 1, (ret < 0) ? ret : got);
+	traceFrame(in, SEAMAX_TRACE_RX, chunk->MPSSECommand, got,
+		(ret < 0) ? -EIO : ((got < chunk->bytesToRead) ? -ENODEV : 0));
+	q->received += got;
+
+	if (got < chunk->bytesToRead)
 	{
-		fprintf(stderr, "Bad device type argument\n");
-		return -EINVAL;
+		q->error = (ret < 0) ? -EIO : -ENODEV;
+		return;
 	}
 
-	//If necessary, open the dynamic library
-	if (!in->libftdi)
+	for (i = 0, j = 0; i < chunk->bytesToRead; i++)
 	{
-		in->libftdi = dlopen("libftdi.so", RTLD_LAZY);
+		if (j < chunk->responseCount && chunk->responseOffsets[j] == i) j++;
+		else if (chunk->MPSSECommand[i] & 0x01) nack = 1;
 	}
-	// Check for failure to load library
-	if (!in->libftdi)
+	if (nack)
 	{
-		fprintf(stderr, "failed to load libftdi.so (%s)\n", dlerror());
-		return -EAGAIN;
+		q->error = -ENXIO;
+		return;
 	}
 
-	// Allocate FTDI context stucture
-	pf_ftdi_new ftdi_new = dlsym(in->libftdi, "ftdi_new");
-	if (!ftdi_new || !(in->ftdic = ftdi_new()))
+	for (i = 0; i < chunk->responseCount; i++)
 	{
-		fprintf(stderr, "ftdi_new failed\n");
-		return -EAGAIN;
+		*((unsigned char*)chunk->variableCallbacks[i]) =
+			chunk->MPSSECommand[chunk->responseOffsets[i]];
 	}
+}
 
-	//Initialize the ftdi context structure
-	pf_ftdi_init ftdi_init = dlsym(in->libftdi, "ftdi_init");
-	if (!ftdi_init || ftdi_init(in->ftdic) < 0)
-	{
-		fprintf(stderr, "ftdi_init failed\n");
-		return -EAGAIN;
-	}
 
-	//Open ftdi device based on connection string passed in
-	pf_ftdi_usb_open ftdi_usb_open = dlsym(in->libftdi, "ftdi_usb_open");
-	if (!ftdi_usb_open)
-	{
-		fprintf(stderr, "ftdi_usb_open failed\n");
-		return -EAGAIN;
-	}
+//  --------------------------------------------------------------------------
+// ( Private function sends the open chunk and collects the one before it.    )
+// The device starts on the new chunk while the earlier responses are read,
+// so it is never left idle waiting for the host between chunks.
+//  --------------------------------------------------------------------------
+void I2C_FlushQueue(seaMaxModule* in)
+{
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
+	i2c_chunk* chunk = q->open;
+	i2c_chunk* previous = (chunk == &q->chunk[0]) ? &q->chunk[1] : &q->chunk[0];
+	int ret = -1;
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
 
-	pf_ftdi_get_error_string ftdi_get_error_string = dlsym(in->libftdi, "ftdi_get_error_string");
-	ret = ftdi_usb_open(in->ftdic, VENDOR, pid);
-	if (ret < 0 && ret != -5)
+	if (chunk->byteIndex > 0 && !q->error)
 	{
-		fprintf(stderr, "unable to open ftdi device: %d %d (%s)\n",
-			pid, ret, 
-			ftdi_get_error_string ? ftdi_get_error_string(in->ftdic) : "ERROR");
-		return -EEXIST;
-	}
+		I2C_OptimizeQueue(chunk);
 
-	//Pre-map the set_bitmode and enable_bitbang functions
-	pf_ftdi_set_bitmode ftdi_set_bitmode = dlsym(in->libftdi, "ftdi_set_bitmode");
-	if (!ftdi_set_bitmode)
-	{
-		fprintf(stderr, "ftdi_set_bitmode failed\n");
-		return -EAGAIN;
-	}
-	pf_ftdi_enable_bitbang ftdi_enable_bitbang = dlsym(in->libftdi, "ftdi_enable_bitbang");
-	if (!ftdi_enable_bitbang)
-	{
-		fprintf(stderr, "ftdi_enable_bitbang failed\n");
-		return -EAGAIN;
-	}
+		SEAMAX_PROBE4(i2c_chunk_send, in->traceId, chunk->byteIndex,
+			chunk->bytesToRead, chunk->responseCount);
+		if (!q->started) statsBegin(in, 0);
+		q->started = 1;
 
-	//Use to determine device type; bitbang or SPI
-	in->deviceType = pid;
+		SEAMAX_PROBE3(ftdi_transfer_begin, in->traceId, 0, chunk->byteIndex);
+		if (ftdi_write_data) ret = ftdi_write_data(in->ftdic, chunk->MPSSECommand, chunk->byteIndex);
+		SEAMAX_PROBE3(ftdi_transfer_end, in->traceId, 0, ret);
+		traceFrame(in, SEAMAX_TRACE_TX, chunk->MPSSECommand, chunk->byteIndex,
+			(ret < 0) ? -EIO : 0);
 
-	unsigned char direction[4] = { 0, 0, 0, 0 };
-	switch (in->deviceType)
-	{
-	case SDL_8126:
-		ftdi_set_bitmode(in->ftdic, 0xf0, BITMODE_MPSSE);
-		//Set ftdi chip in SPI mode
-		I2C_InitializeI2C(in);
-		SeaDacGetPIODirection(SeaMaxPointer, direction);
-		SeaDacSetPIODirection(SeaMaxPointer, direction);
-		break;
-	case SDL_8111:
-	case SDL_8112:
-		//Set ftdi chip in bit bang mode
-		ftdi_enable_bitbang(in->ftdic, 0xF0);
-		break;
-	case SDL_8113:
-		//Set ftdi chip in bit bang mode
-		ftdi_enable_bitbang(in->ftdic, 0x00);
-		break;
-	case SDL_8114:
-	case SDL_8115:
-		//Set ftdi chip in bit bang mode
-		ftdi_enable_bitbang(in->ftdic, 0xFF);
-		break;
+		if (ret < 0) q->error = -EIO;
+		else
+		{
+			q->sent += chunk->byteIndex;
+			chunk->inFlight = 1;
+		}
 	}
 
-	//Short delay after setting to bit bang mode
-	sleep(1);
+	if (previous->inFlight) I2C_CollectChunk(in, previous);
 
-	//if we got this far without any errors, it's ok to update local data
-	in->commMode = FTDI_DIRECT;
+	// Build on in the other chunk
+	previous->byteIndex = 0;
+	previous->bytesToRead = 0;
+	previous->responseCount = 0;
+	q->open = previous;
+}
 
-	return 0;
+
+//  --------------------------------------------------------------------------
+// ( Private function executes I2C queue.                                     )
+// Sends whatever is left and waits for every response.  Queues too long for
+// one chunk have already been partly sent by I2C_Reserve.
+//  --------------------------------------------------------------------------
+int I2C_ExecuteQueue(seaMaxModule* in)
+{
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
+	i2c_chunk* last = q->open;
+	int ret;
+
+	I2C_FlushQueue(in);
+	if (last->inFlight) I2C_CollectChunk(in, last);
+	ret = (q->error == -ENODEV) ? -EIO : q->error;
+
+	if (q->started)
+	{
+		SEAMAX_PROBE4(i2c_queue_execute, in->traceId, q->sent, q->received, ret);
+		if (q->sent > 0) statsSent(in, q->sent);
+		if (q->error) statsFailed(in, q->error);
+		else statsReceived(in, q->received, 0);
+	}
+
+	return ret;
 }
 
 
 //  --------------------------------------------------------------------------
-// ( Private function to close a SeaDAC Lite                                   )
+// ( Private function sets or clears a GPIO state and direction.              )
+// Direction can be a logical OR'ing of any of the GPIO values and their state.  For
+// instance, I2C_SetGPIO( (GPIO_0 | GPIO_1) , GPIO_1 ) sets the GPIO_0 and GPIO_1 pins
+// as outputs, with the GPIO_0 pin low and the GPIO_1 pin high.  All other GPIOs (2 & 3)
+// are configured as inputs.
 //  --------------------------------------------------------------------------
-void closeD2X(SeaMaxLin *SeaMaxPointer)
+void I2C_SetGPIO(seaMaxModule* in, unsigned char direction, unsigned char state)
 {
-	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
-	if (SeaMaxPointer == NULL) return; 
+	i2c_queue* q = (i2c_queue*)in->i2cQueue;
 
-	pf_ftdi_disable_bitbang ftdi_disable_bitbang = dlsym(in->libftdi, "ftdi_disable_bitbang");
-	pf_ftdi_usb_close ftdi_usb_close = dlsym(in->libftdi, "ftdi_usb_close");
-	pf_ftdi_deinit ftdi_deinit = dlsym(in->libftdi, "ftdi_deinit");
-	pf_ftdi_free ftdi_free = dlsym(in->libftdi, "ftdi_free");
+	I2C_Reserve(in, 6, 0);
 
-	if (ftdi_disable_bitbang) ftdi_disable_bitbang(in->ftdic);
-	if (ftdi_usb_close) ftdi_usb_close(in->ftdic);
-	if (ftdi_deinit) ftdi_deinit(in->ftdic);
-	if (ftdi_free) ftdi_free(in->ftdic);
+	// Clear the stored state of the GPIO
+	q->value &= 0x0F;
+	q->direction &= 0x0F;
+
+	// Set the state and direction
+	q->value |= (state << 4);
+	q->direction |= (direction << 4);
+	I2C_EMIT(q, 0x80);
+	I2C_EMIT(q, q->value);
+	I2C_EMIT(q, q->direction);
+	I2C_EMIT(q, 0x82);
+	I2C_EMIT(q, (state >> 4));
+	I2C_EMIT(q, (direction >> 4));
 }
 
 
-// ----------------------------------------------------------------------------
-/// \ingroup group_seamax_fun
-/// \brief	Read the entire PIO space of a SeaDAC Lite module
-///
-/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
-/// \param[out]	data
-///
-/// \retval		0	Success.
-/// \retval		-1	Invalid model number.
-/// \retval		-2	Unknown connection type.
+
+//  --------------------------------------------------------------------------
+// ( Private function waits for the chip to answer in its new mode.           )
+// In MPSSE mode an invalid opcode (0xAA) is answered with 0xFA 0xAA once the
+// engine runs.  In bit bang mode the pins are read until the ones we drive
+// (mask) read back the same three times in a row.
+//  --------------------------------------------------------------------------
+int D2X_WaitReady(seaMaxModule* in, unsigned char mask)
+{
+	unsigned long long deadline = statsNow() + READY_TIMEOUT_MS * 1000000ULL;
+	unsigned long long resend = 0;
+	unsigned char command = 0xAA, reply[64], pins, last = 0;
+	int ret, index, seen = 0, stable = 0;
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+	pf_ftdi_read_pins ftdi_read_pins = dlsym(in->libftdi, "ftdi_read_pins");
+	pf_ftdi_usb_purge_buffers ftdi_usb_purge_buffers = dlsym(in->libftdi, "ftdi_usb_purge_buffers");
+
+	if (in->deviceType == SDL_8126)
+	{
+		if (!ftdi_write_data || !ftdi_read_data) return -EIO;
+
+		while (statsNow() < deadline)
+		{
+			// An opcode sent before the engine started is lost, so repeat it
+			if (statsNow() >= resend)
+			{
+				if (ftdi_write_data(in->ftdic, &command, 1) != 1) return -EIO;
+				resend = statsNow() + 100000000ULL;
+			}
+
+			ret = ftdi_read_data(in->ftdic, reply, sizeof(reply));
+			if (ret < 0) return -EIO;
+			for (index = 0; index < ret; index++)
+			{
+				if (seen && reply[index] == command)
+				{
+					// Drop any echo of a repeated opcode
+					if (ftdi_usb_purge_buffers) ftdi_usb_purge_buffers(in->ftdic);
+					return 0;
+				}
+				seen = (reply[index] == 0xFA);
+			}
+			if (ret == 0) usleep(1000);
+		}
+	}
+	else
+	{
+		if (!ftdi_read_pins) return -EIO;
+
+		while (statsNow() < deadline)
+		{
+			if (ftdi_read_pins(in->ftdic, &pins) < 0) stable = 0;
+			else if (stable > 0 && ((pins ^ last) & mask) == 0) stable++;
+			else
+			{
+				last = pins;
+				stable = 1;
+			}
+			if (stable >= 3) return 0;
+			usleep(1000);
+		}
+	}
+
+	return -ETIMEDOUT;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function opens the module picked by the serial= and index=      )
+// ( options, or the first one of the product when neither was given.  It    )
+// ( returns libftdi's result, -3 meaning no such device.                    )
+// Once open the module is bound to its serial number, so a reconnect finds
+// the same module wherever it is plugged back in.  A module without one is
+// never reconnected.
+//  --------------------------------------------------------------------------
+int D2X_OpenDevice(seaMaxModule *in, int pid)
+{
+	pf_ftdi_usb_open ftdi_usb_open = dlsym(in->libftdi, "ftdi_usb_open");
+	pf_ftdi_usb_find_all ftdi_usb_find_all = dlsym(in->libftdi, "ftdi_usb_find_all");
+	pf_ftdi_list_free ftdi_list_free = dlsym(in->libftdi, "ftdi_list_free");
+	pf_ftdi_usb_get_strings ftdi_usb_get_strings = dlsym(in->libftdi, "ftdi_usb_get_strings");
+	pf_ftdi_usb_open_dev ftdi_usb_open_dev = dlsym(in->libftdi, "ftdi_usb_open_dev");
+	struct ftdi_device_list *list = NULL, *node;
+	char serial[SEADAC_SERIAL_LENGTH];
+	int ret, index;
+
+	if (!ftdi_usb_find_all || !ftdi_list_free || !ftdi_usb_open_dev)
+	{
+		if (in->usbSerial[0] != '\0' || in->usbIndex >= 0) return -3;
+		return ftdi_usb_open ? ftdi_usb_open(in->ftdic, VENDOR, pid) : -3;
+	}
+
+	ret = ftdi_usb_find_all(in->ftdic, &list, VENDOR, pid);
+	if (ret < 0) return ret;
+
+	for (node = list, index = 0, ret = -3; node != NULL; node = node->next, index++)
+	{
+		if (in->usbIndex >= 0 && index != in->usbIndex) continue;
+		if (!ftdi_usb_get_strings || ftdi_usb_get_strings(in->ftdic,
+			node->dev, NULL, 0, NULL, 0, serial, sizeof(serial)) < 0)
+			serial[0] = '\0';
+		if (in->usbSerial[0] != '\0' && strcmp(serial, in->usbSerial) != 0)
+			continue;
+
+		ret = ftdi_usb_open_dev(in->ftdic, node->dev);
+		if ((ret >= 0 || ret == -5) && serial[0] != '\0')
+		{
+			strcpy(in->usbSerial, serial);
+			in->usbIndex = -1;
+		}
+		break;
+	}
+
+	ftdi_list_free(&list);
+	return ret;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function switches a bit bang module between asynchronous and    )
+// ( synchronous mode, keeping its output mask.                               )
+//  --------------------------------------------------------------------------
+int D2X_SetSyncBitbang(seaMaxModule* in, int sync)
+{
+	pf_ftdi_set_bitmode ftdi_set_bitmode = dlsym(in->libftdi, "ftdi_set_bitmode");
+	pf_ftdi_usb_purge_buffers ftdi_usb_purge_buffers = dlsym(in->libftdi, "ftdi_usb_purge_buffers");
+
+	if (in->syncBitbang == sync) return 0;
+	if (!ftdi_set_bitmode) return -EIO;
+
+	if (ftdi_set_bitmode(in->ftdic, in->bitbangMask,
+		sync ? BITMODE_SYNCBB : BITMODE_BITBANG) < 0)
+		return -EIO;
+
+	// Drop samples an earlier write may have left behind
+	if (ftdi_usb_purge_buffers) ftdi_usb_purge_buffers(in->ftdic);
+
+	in->syncBitbang = sync;
+	return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function sets the USB latency timer (ms) and transfer chunks.    )
+//  --------------------------------------------------------------------------
+int D2X_SetUsbTuning(seaMaxModule *in, unsigned char latency, unsigned int chunk)
+{
+	pf_ftdi_set_latency_timer ftdi_set_latency_timer = dlsym(in->libftdi, "ftdi_set_latency_timer");
+	pf_ftdi_read_data_set_chunksize ftdi_read_data_set_chunksize = dlsym(in->libftdi, "ftdi_read_data_set_chunksize");
+	pf_ftdi_write_data_set_chunksize ftdi_write_data_set_chunksize = dlsym(in->libftdi, "ftdi_write_data_set_chunksize");
+
+	if (!ftdi_set_latency_timer || ftdi_set_latency_timer(in->ftdic, latency) < 0)
+		return -EIO;
+	if (ftdi_read_data_set_chunksize) ftdi_read_data_set_chunksize(in->ftdic, chunk);
+	if (ftdi_write_data_set_chunksize) ftdi_write_data_set_chunksize(in->ftdic, chunk);
+
+	in->latencyTimer = latency;
+	return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function applies the USB profile picked at open.                )
+// Short I2C and bit bang replies are held in the chip until the latency
+// timer runs out, so a low timer and small chunks suit request/response
+// use; bulk sweeps fill whole packets and prefer big chunks instead.
+//  --------------------------------------------------------------------------
+int D2X_ApplyProfile(seaMaxModule *in)
+{
+	switch (in->usbProfile)
+	{
+	case PROFILE_LATENCY:
+	case PROFILE_AUTO:
+		return D2X_SetUsbTuning(in, in->latencyTimer ? in->latencyTimer : 1,
+			LATENCY_CHUNK_BYTES);
+	case PROFILE_THROUGHPUT:
+		return D2X_SetUsbTuning(in, in->latencyTimer ? in->latencyTimer : 16,
+			THROUGHPUT_CHUNK_BYTES);
+	default:
+		// Keep libftdi's settings unless a timer was asked for
+		if (in->latencyTimer == 0) return 0;
+		return D2X_SetUsbTuning(in, in->latencyTimer, DEFAULT_CHUNK_BYTES);
+	}
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function times one USB round trip, in nanoseconds.              )
+// MPSSE modules echo an invalid opcode; bit bang modules take a one step
+// synchronous exchange that writes the pins back as they are.
+//  --------------------------------------------------------------------------
+long long D2X_RoundTrip(seaMaxModule *in)
+{
+	unsigned long long start, deadline;
+	unsigned char command = 0xAA, reply[2], pins, sample;
+	int ret, got;
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+	pf_ftdi_read_pins ftdi_read_pins = dlsym(in->libftdi, "ftdi_read_pins");
+
+	if (!ftdi_write_data || !ftdi_read_data || !ftdi_read_pins) return -EIO;
+
+	if (in->deviceType == SDL_8126)
+	{
+		start = statsNow();
+		deadline = start + RESPONSE_TIMEOUT_MS * 1000000ULL;
+		if (ftdi_write_data(in->ftdic, &command, 1) != 1) return -EIO;
+		for (got = 0; got < 2; got += ret)
+		{
+			ret = ftdi_read_data(in->ftdic, reply + got, 2 - got);
+			if (ret < 0) return -EIO;
+			if (ret == 0 && statsNow() > deadline) return -ETIMEDOUT;
+		}
+		if (reply[0] != 0xFA || reply[1] != command) return -EIO;
+		return statsNow() - start;
+	}
+
+	if (ftdi_read_pins(in->ftdic, &pins) < 0) return -EIO;
+	start = statsNow();
+	ret = SeaDacLinExchange((SeaMaxLin*)in, &pins, &sample, 1);
+	if (ret < 0) return ret;
+	return statsNow() - start;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function puts a reopened module back the way it was left.       )
+// The 8126 gets its MPSSE engine and I2C set up again, then the last output
+// and direction registers written, with the line drivers to match.  The bit
+// bang models get their mode and their last output byte.
+//  --------------------------------------------------------------------------
+int D2X_RestoreState(seaMaxModule *in)
+{
+	pf_ftdi_set_bitmode ftdi_set_bitmode = dlsym(in->libftdi, "ftdi_set_bitmode");
+	pf_ftdi_enable_bitbang ftdi_enable_bitbang = dlsym(in->libftdi, "ftdi_enable_bitbang");
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	unsigned char enable = 0x00, pins;
+	int ret, index;
+
+	if (!ftdi_set_bitmode || !ftdi_enable_bitbang || !ftdi_write_data) return -EIO;
+
+	if (in->deviceType == SDL_8126)
+	{
+		if (ftdi_set_bitmode(in->ftdic, 0xf0, BITMODE_MPSSE) < 0) return -EIO;
+		D2X_ApplyProfile(in);
+		ret = D2X_WaitReady(in, 0);
+		if (ret < 0) return ret;
+		if (I2C_InitializeI2C(in) < 0) return -EIO;
+
+		I2C_InitializeQueue(in);
+		if (in->pioCached & PIO_CACHED_OUTPUT)
+		{
+			I2C_WriteRegisters(in, 0xE8, 2, &in->pioOutput[0], 2);
+			I2C_WriteRegisters(in, 0xEA, 2, &in->pioOutput[2], 2);
+		}
+		if (in->pioCached & PIO_CACHED_DIRECTION)
+		{
+			I2C_WriteRegisters(in, 0xE8, 6, &in->pioDirection[0], 2);
+			I2C_WriteRegisters(in, 0xEA, 6, &in->pioDirection[2], 2);
+			for (index = 0; index < 4; index++)
+			{
+				if (in->pioDirection[index] == 0) enable |= (GPIO_0 << index);
+			}
+			I2C_SetGPIO(in, 0xFF, ~enable);
+		}
+		return I2C_ExecuteQueue(in);
+	}
+
+	if (ftdi_enable_bitbang(in->ftdic, in->bitbangMask) < 0) return -EIO;
+	in->syncBitbang = 0;
+	D2X_ApplyProfile(in);
+	ret = D2X_WaitReady(in, in->bitbangMask);
+	if (ret < 0) return ret;
+
+	if (in->bitbangOutput >= 0)
+	{
+		pins = (unsigned char)in->bitbangOutput;
+		if (ftdi_write_data(in->ftdic, &pins, 1) != 1) return -EIO;
+	}
+	return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function reopens a module after a USB error.                     )
+// The module is looked for by serial number until it answers or the
+// reconnect= time runs out, then its state is restored.  Without a serial
+// number the reopened device could be another board, so it fails at once
+// rather than restoring the cached outputs onto it.
+//  --------------------------------------------------------------------------
+int D2X_Reconnect(seaMaxModule *in)
+{
+	pf_ftdi_usb_close ftdi_usb_close = dlsym(in->libftdi, "ftdi_usb_close");
+	unsigned long long deadline = statsNow() + in->reconnectMs * 1000000ULL;
+	int ret;
+
+	if (in->ftdic == NULL || !ftdi_usb_close) return -EIO;
+	if (in->usbSerial[0] == '\0') return -EIO;
+
+	statsRetry(in);
+	SEAMAX_PROBE2(reconnect_begin, in->traceId, in->deviceType);
+
+	do
+	{
+		// The old handle is gone with the device; closing only frees it
+		ftdi_usb_close(in->ftdic);
+
+		pthread_mutex_lock(&d2xOpenLock);
+		ret = D2X_OpenDevice(in, in->deviceType);
+		pthread_mutex_unlock(&d2xOpenLock);
+
+		if (ret >= 0 || ret == -5)
+		{
+			ret = D2X_RestoreState(in);
+			if (ret >= 0) break;
+		}
+		else ret = -EIO;
+
+		usleep(RECONNECT_POLL_MS * 1000);
+	} while (statsNow() < deadline);
+
+	SEAMAX_PROBE2(reconnect_end, in->traceId, ret);
+	return (ret < 0) ? -EIO : 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function decides whether a failed call should be tried again.    )
+// Each call reconnects at most once (retried starts at 0), and not at all
+// when the module was opened with reconnect=0.
+//  --------------------------------------------------------------------------
+int D2X_Reconnected(seaMaxModule *in, int *retried)
+{
+	if (*retried || in->reconnectMs == 0) return 0;
+
+	*retried = 1;
+	return D2X_Reconnect(in) == 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function to parse SeaDAC Lite options ("i2c=400k&...").         )
+//  --------------------------------------------------------------------------
+int D2X_ParseOptions(seaMaxModule *in, const char *options)
+{
+	const char *value, *next;
+	double rate;
+	char *end;
+	int length;
+
+	in->i2cClock = 0;
+	in->intPin = 4;
+	in->usbSerial[0] = '\0';
+	in->usbIndex = -1;
+	in->usbProfile = PROFILE_DEFAULT;
+	in->latencyTimer = 0;
+	in->reconnectMs = RECONNECT_MS;
+
+	for (; *options != '\0'; options = next)
+	{
+		next = strchr(options, '&');
+		length = next ? next - options : (int)strlen(options);
+		next = next ? next + 1 : options + length;
+		if (length == 0) continue;
+
+		if (strncmp(options, "i2c=", 4) == 0)
+		{
+			value = options + 4;
+			rate = strtod(value, &end);
+			if (*end == 'k' || *end == 'K') rate *= 1e3, end++;
+			else if (*end == 'M') rate *= 1e6, end++;
+			if (strncasecmp(end, "hz", 2) == 0) end += 2;
+
+			// Written so NaN fails too
+			if (end != options + length || !(rate >= 1e3 && rate <= 1e6))
+			{
+				fprintf(stderr, "Bad I2C clock rate: %.*s\n", length, options);
+				return -EINVAL;
+			}
+			in->i2cClock = (unsigned int)rate;
+		}
+		else if (strncmp(options, "int=", 4) == 0)
+		{
+			// ACBUS 0-3 are driven as GPIO_4..7, so only 4-7 can be inputs
+			if (length != 5 || options[4] < '4' || options[4] > '7')
+			{
+				fprintf(stderr, "Bad INT pin: %.*s\n", length, options);
+				return -EINVAL;
+			}
+			in->intPin = options[4] - '0';
+		}
+		else if (strncmp(options, "serial=", 7) == 0)
+		{
+			if (length == 7 || length - 7 >= SEADAC_SERIAL_LENGTH)
+			{
+				fprintf(stderr, "Bad serial number: %.*s\n", length, options);
+				return -EINVAL;
+			}
+			memcpy(in->usbSerial, options + 7, length - 7);
+			in->usbSerial[length - 7] = '\0';
+		}
+		else if (strncmp(options, "profile=", 8) == 0)
+		{
+			value = options + 8;
+			length -= 8;
+			if (length == 7 && strncmp(value, "latency", 7) == 0)
+				in->usbProfile = PROFILE_LATENCY;
+			else if (length == 10 && strncmp(value, "throughput", 10) == 0)
+				in->usbProfile = PROFILE_THROUGHPUT;
+			else if (length == 4 && strncmp(value, "auto", 4) == 0)
+				in->usbProfile = PROFILE_AUTO;
+			else
+			{
+				fprintf(stderr, "Unknown USB profile: %.*s\n", length, value);
+				return -EINVAL;
+			}
+		}
+		else if (strncmp(options, "latency=", 8) == 0)
+		{
+			rate = strtol(options + 8, &end, 10);
+			if (length == 8 || end != options + length || rate < 1 || rate > 255)
+			{
+				fprintf(stderr, "Bad latency timer: %.*s\n", length, options);
+				return -EINVAL;
+			}
+			in->latencyTimer = (unsigned char)rate;
+		}
+		else if (strncmp(options, "reconnect=", 10) == 0)
+		{
+			rate = strtol(options + 10, &end, 10);
+			if (length == 10 || end != options + length || rate < 0 || rate > 60000)
+			{
+				fprintf(stderr, "Bad reconnect time: %.*s\n", length, options);
+				return -EINVAL;
+			}
+			in->reconnectMs = (unsigned int)rate;
+		}
+		else if (strncmp(options, "index=", 6) == 0)
+		{
+			in->usbIndex = strtol(options + 6, &end, 10);
+			if (length == 6 || end != options + length || in->usbIndex < 0)
+			{
+				fprintf(stderr, "Bad device index: %.*s\n", length, options);
+				return -EINVAL;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option: %.*s\n", length, options);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function to open a SeaDAC Lite                                   )
+//  --------------------------------------------------------------------------
+int openD2X(SeaMaxLin *SeaMaxPointer, char *devName)
+{
+	int ret, pid;
+	char *ptr;
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+
+	//Quick test to make sure nothing is already opened
+	if (in->hDevice > 0) return -EBUSY;
+
+	//Check user input device string
+	pid = strtol(devName, &ptr, 16);
+	if (!SDL_IsSupported(pid))
+	{
+		fprintf(stderr, "Device type is not supported\n");
+		return -ERANGE;
+	}
+	else if (*ptr != '\0' && *ptr != '?')
+	{
+		fprintf(stderr, "Bad device type argument\n");
+		return -EINVAL;
+	}
+
+	//Options follow the device type
+	ret = D2X_ParseOptions(in, (*ptr == '?') ? ptr + 1 : ptr);
+	if (ret < 0) return ret;
+
+	//If necessary, open the dynamic library
+	if (!in->libftdi)
+	{
+		in->libftdi = dlopen("libftdi.so", RTLD_LAZY);
+	}
+	// Check for failure to load library
+	if (!in->libftdi)
+	{
+		fprintf(stderr, "failed to load libftdi.so (%s)\n", dlerror());
+		return -EAGAIN;
+	}
+
+	// Allocate FTDI context stucture
+	pf_ftdi_new ftdi_new = dlsym(in->libftdi, "ftdi_new");
+	if (!ftdi_new || !(in->ftdic = ftdi_new()))
+	{
+		fprintf(stderr, "ftdi_new failed\n");
+		return -EAGAIN;
+	}
+
+	//Initialize the ftdi context structure
+	pf_ftdi_init ftdi_init = dlsym(in->libftdi, "ftdi_init");
+	if (!ftdi_init || ftdi_init(in->ftdic) < 0)
+	{
+		fprintf(stderr, "ftdi_init failed\n");
+		return -EAGAIN;
+	}
+
+	//Open ftdi device based on connection string passed in
+	pf_ftdi_usb_open ftdi_usb_open = dlsym(in->libftdi, "ftdi_usb_open");
+	if (!ftdi_usb_open)
+	{
+		fprintf(stderr, "ftdi_usb_open failed\n");
+		return -EAGAIN;
+	}
+
+	pf_ftdi_get_error_string ftdi_get_error_string = dlsym(in->libftdi, "ftdi_get_error_string");
+	pthread_mutex_lock(&d2xOpenLock);
+	ret = D2X_OpenDevice(in, pid);
+	pthread_mutex_unlock(&d2xOpenLock);
+	if (ret < 0 && ret != -5)
+	{
+		fprintf(stderr, "unable to open ftdi device: %d %d (%s)\n",
+			pid, ret, 
+			ftdi_get_error_string ? ftdi_get_error_string(in->ftdic) : "ERROR");
+
+		//The context is allocated again by the next open
+		pf_ftdi_free ftdi_free = dlsym(in->libftdi, "ftdi_free");
+		if (ftdi_free) ftdi_free(in->ftdic);
+		in->ftdic = NULL;
+		return -EEXIST;
+	}
+
+	//Pre-map the set_bitmode and enable_bitbang functions
+	pf_ftdi_set_bitmode ftdi_set_bitmode = dlsym(in->libftdi, "ftdi_set_bitmode");
+	if (!ftdi_set_bitmode)
+	{
+		fprintf(stderr, "ftdi_set_bitmode failed\n");
+		return -EAGAIN;
+	}
+	pf_ftdi_enable_bitbang ftdi_enable_bitbang = dlsym(in->libftdi, "ftdi_enable_bitbang");
+	if (!ftdi_enable_bitbang)
+	{
+		fprintf(stderr, "ftdi_enable_bitbang failed\n");
+		return -EAGAIN;
+	}
+
+	//Use to determine device type; bitbang or SPI
+	in->deviceType = pid;
+	in->bitbangOutput = -1;
+
+	//USB latency timer and transfer sizes; the defaults still work if unset
+	if (D2X_ApplyProfile(in) < 0)
+		fprintf(stderr, "unable to set the USB latency timer\n");
+
+	unsigned char direction[4] = { 0, 0, 0, 0 };
+	switch (in->deviceType)
+	{
+	case SDL_8126:
+		ftdi_set_bitmode(in->ftdic, 0xf0, BITMODE_MPSSE);
+		if (!in->i2cQueue) in->i2cQueue = calloc(1, sizeof(i2c_queue));
+		if (!in->i2cQueue)
+		{
+			closeD2X(SeaMaxPointer);
+			return -ENOMEM;
+		}
+
+		//The GPIO read in I2C_InitializeI2C needs a running MPSSE engine
+		ret = D2X_WaitReady(in, 0);
+		if (ret < 0)
+		{
+			fprintf(stderr, "SeaDAC Lite did not enter MPSSE mode\n");
+			closeD2X(SeaMaxPointer);
+			return ret;
+		}
+
+		//Set ftdi chip in SPI mode
+		if (I2C_InitializeI2C(in) < 0)
+		{
+			fprintf(stderr, "unable to set up I2C\n");
+			closeD2X(SeaMaxPointer);
+			return -EIO;
+		}
+		in->pioCached = 0;
+
+		//The PIO calls below need to see an open module.  Directions that
+		//couldn't be read aren't known, so none are written back.
+		in->commMode = FTDI_DIRECT;
+		ret = SeaDacGetPIODirection(SeaMaxPointer, direction);
+		if (ret < 0)
+		{
+			if (in->i2cClock != 0)
+				fprintf(stderr, "no I2C acknowledge at %u Hz\n", in->i2cClock);
+			else fprintf(stderr, "unable to read the PIO directions\n");
+			in->commMode = NO_CONNECT;
+			closeD2X(SeaMaxPointer);
+			return -EIO;
+		}
+		SeaDacSetPIODirection(SeaMaxPointer, direction);
+		break;
+	case SDL_8111:
+	case SDL_8112:
+		in->bitbangMask = 0xF0;
+		break;
+	case SDL_8113:
+		in->bitbangMask = 0x00;
+		break;
+	case SDL_8114:
+	case SDL_8115:
+		in->bitbangMask = 0xFF;
+		break;
+	}
+
+	if (in->deviceType != SDL_8126)
+	{
+		//Set ftdi chip in bit bang mode
+		ftdi_enable_bitbang(in->ftdic, in->bitbangMask);
+		in->syncBitbang = 0;
+		ret = D2X_WaitReady(in, in->bitbangMask);
+	}
+
+	//Bit bang modes are ready once the pins we drive read back steady
+	if (in->deviceType != SDL_8126 && ret < 0)
+	{
+		fprintf(stderr, "SeaDAC Lite did not enter bit bang mode\n");
+		closeD2X(SeaMaxPointer);
+		return ret;
+	}
+
+	//if we got this far without any errors, it's ok to update local data
+	in->commMode = FTDI_DIRECT;
+
+	//Measure rather than guess the best latency timer
+	if (in->usbProfile == PROFILE_AUTO)
+	{
+		ret = SeaDacCalibrate(SeaMaxPointer);
+		if (ret < 0) fprintf(stderr, "USB calibration failed (%d)\n", ret);
+	}
+
+	return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function to close a SeaDAC Lite                                   )
+//  --------------------------------------------------------------------------
+void closeD2X(SeaMaxLin *SeaMaxPointer)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	if (SeaMaxPointer == NULL) return; 
+
+	pf_ftdi_disable_bitbang ftdi_disable_bitbang = dlsym(in->libftdi, "ftdi_disable_bitbang");
+	pf_ftdi_usb_close ftdi_usb_close = dlsym(in->libftdi, "ftdi_usb_close");
+	pf_ftdi_deinit ftdi_deinit = dlsym(in->libftdi, "ftdi_deinit");
+	pf_ftdi_free ftdi_free = dlsym(in->libftdi, "ftdi_free");
+
+	if (ftdi_disable_bitbang) ftdi_disable_bitbang(in->ftdic);
+	if (ftdi_usb_close) ftdi_usb_close(in->ftdic);
+	if (ftdi_deinit) ftdi_deinit(in->ftdic);
+	if (ftdi_free) ftdi_free(in->ftdic);
+
+	free(in->i2cQueue);
+	in->i2cQueue = NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private functions giving SeaDAC Lite modules a transport.  They carry    )
+// ( raw bytes to and from the chip; no Modbus frame is ever sent this way.  )
+//  --------------------------------------------------------------------------
+static int openD2XTransport(seaMaxModule *in, char *devName)
+{
+	return openD2X((SeaMaxLin*)in, devName);
+}
+
+static int sendD2X(seaMaxModule *in, struct iovec *frame, int count)
+{
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	unsigned char buffer[256];
+	int length = frameLength(frame, count);
+
+	if (!ftdi_write_data) return -EIO;
+	if (length > sizeof(buffer)) return -EINVAL;
+
+	frameCopy(frame, count, buffer, length);
+	return ftdi_write_data(in->ftdic, buffer, length);
+}
+
+static int receiveD2X(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+	unsigned char buffer[256];
+	int ret;
+
+	*length = 0;
+	if (!ftdi_read_data) return -EIO;
+	if (expected > sizeof(buffer)) expected = sizeof(buffer);
+
+	while (*length < expected)
+	{
+		ret = ftdi_read_data(in->ftdic, buffer + *length, expected - *length);
+		if (ret < 0) return -EIO;
+		if (ret == 0 && statsNow() > deadline) break;
+		*length += ret;
+	}
+
+	frameFill(frame, count, buffer, *length);
+	return 0;
+}
+
+static void closeD2XTransport(seaMaxModule *in)
+{
+	//A failed open has already released what it had
+	if (in->commMode == FTDI_DIRECT) closeD2X((SeaMaxLin*)in);
+}
+
+static int pollFdD2X(seaMaxModule *in)
+{
+	return -1;
+}
+
+const seamax_transport_s d2xTransport =
+{
+	"sealevel_d2x://", openD2XTransport, sendD2X, receiveD2X,
+	closeD2XTransport, pollFdD2X
+};
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Read the entire PIO space of a SeaDAC Lite module
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[out]	data
+///
+/// \retval		0	Success.
+/// \retval		-1	Invalid model number.
+/// \retval		-2	Unknown connection type.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// Reads the entire PIO space, inputs and outputs alike.
+///
+/// \warning	Sufficient data must be allocated for data before calling
+///	this function.  For instance, the 8126 has 32 bits of PIO, therefore
+/// data should be allocated with 4 bytes of data before calling this function.
+///
+/// \note	Only available for SeaDAC 8126.
+// ----------------------------------------------------------------------------
+int SeaDacGetPIO(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	int ret, retried = 0;
+
+	if (in->commMode == FTDI_DIRECT)
+	{
+		if (in->deviceType == SDL_8126)
+		{
+			int index = 0;
+			unsigned char /*portdata,*/ direction[4], inputState[4], outputState[4];
+
+			do
+			{
+				I2C_InitializeQueue(in);
+
+				// Read the direction ports (command registers 6 & 7)
+				I2C_ReadRegisters(in, 0xE8, 6, &direction[0], 2);
+				I2C_ReadRegisters(in, 0xEA, 6, &direction[2], 2);
+
+				// Read the input port states (command registers 0 & 1)
+				I2C_ReadRegisters(in, 0xE8, 0, &inputState[0], 2);
+				I2C_ReadRegisters(in, 0xEA, 0, &inputState[2], 2);
+
+				// Read the output port states (command registers 2 & 3)
+				I2C_ReadRegisters(in, 0xE8, 2, &outputState[0], 2);
+				I2C_ReadRegisters(in, 0xEA, 2, &outputState[2], 2);
+
+				ret = I2C_ExecuteQueue(in);
+			} while (ret == -EIO && D2X_Reconnected(in, &retried));
+			if (ret < 0) return ret;
+
+			for (; index < 4; index++)
+			{
+				data[index] = inputState[index] & direction[index];
+				data[index] |= (outputState[index] & ~direction[index]);
+			}
+
+			memcpy(in->pioDirection, direction, 4);
+			memcpy(in->pioOutput, outputState, 4);
+			in->pioCached |= PIO_CACHED_DIRECTION | PIO_CACHED_OUTPUT;
+
+
+			return 4;
+		}
+		else return -1;
+	}
+	else return -2;
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Write the entire PIO space of a SeaDAC Lite module
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in]	data
+///
+/// \retval		0	Success.
+/// \retval		-1	Invalid model number.
+/// \retval		-2	Unknown connection type.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// Writes the entire PIO space
+///
+/// \note	PIO space writes will not affect those pins marked as inputs.
+/// \note	Only available for SeaDAC 8126.
+// ----------------------------------------------------------------------------
+int SeaDacSetPIO(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	int ret, retried = 0;
+
+	if (in->commMode == FTDI_DIRECT)
+	{
+		if (in->deviceType == SDL_8126)
+		{
+			do
+			{
+				I2C_InitializeQueue(in);
+
+				// Write the output ports (command registers 2 & 3)
+				I2C_WriteRegisters(in, 0xE8, 2, &data[0], 2);
+				I2C_WriteRegisters(in, 0xEA, 2, &data[2], 2);
+
+				ret = I2C_ExecuteQueue(in);
+			} while (ret == -EIO && D2X_Reconnected(in, &retried));
+			if (ret < 0)
+			{
+				in->pioCached &= ~PIO_CACHED_OUTPUT;
+				return ret;
+			}
+
+			memcpy(in->pioOutput, data, 4);
+			in->pioCached |= PIO_CACHED_OUTPUT;
+
+			return 0;
+		}
+		else return -1;
+	}
+	else return -2;
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Sets the PIO direction 
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in]	data
+///
+/// \retval		0	Success.
+/// \retval		-1	Invalid model number.
+/// \retval		-2	Unknown connection type.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// \note	Only available for SeaDAC 8126.
+// ----------------------------------------------------------------------------
+int SeaDacSetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	int ret, retried = 0;
+
+	if (in->commMode == FTDI_DIRECT)
+	{
+		if (in->deviceType == SDL_8126)
+		{
+			unsigned char enable = 0x00, ON = 0xFF, OFF = 0x00, banks[4];
+			int index;
+
+			do
+			{
+				I2C_InitializeQueue(in);
+
+				// Write entire banks as either outputs or inputs to command registers 6 & 7
+				// on both Philips PCA9535 chips
+				for (index = 0; index < 4; index++) banks[index] = (data[index] == 0) ? OFF : ON;
+				I2C_WriteRegisters(in, 0xE8, 6, &banks[0], 2);
+				I2C_WriteRegisters(in, 0xEA, 6, &banks[2], 2);
+
+				// Enable the line driver directions
+				if (data[0] == 0) enable |= GPIO_0;
+				if (data[1] == 0) enable |= GPIO_1;
+				if (data[2] == 0) enable |= GPIO_2;
+				if (data[3] == 0) enable |= GPIO_3;
+
+				I2C_SetGPIO(in, 0xFF, ~enable);
+
+				ret = I2C_ExecuteQueue(in);
+			} while (ret == -EIO && D2X_Reconnected(in, &retried));
+			if (ret < 0)
+			{
+				in->pioCached &= ~PIO_CACHED_DIRECTION;
+				return ret;
+			}
+
+			memcpy(in->pioDirection, banks, 4);
+			in->pioCached |= PIO_CACHED_DIRECTION;
+
+			return 0;
+		}
+		else return -1;
+	}
+	else return -2;
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Reads the PIO direction 
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in]	data
+///
+/// \retval		0	Success.
+/// \retval		-1	Invalid model number.
+/// \retval		-2	Unknown connection type.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// \note	Only available for SeaDAC 8126.
+// ----------------------------------------------------------------------------
+int SeaDacGetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	int ret, retried = 0;
+
+	if (in->commMode == FTDI_DIRECT)
+	{
+		if (in->deviceType == SDL_8126)
+		{
+			do
+			{
+				I2C_InitializeQueue(in);
+
+				// Reads bank direction as either outputs or inputs to command registers 6 & 7
+				// on both Philips PCA9535 chips
+				I2C_ReadRegisters(in, 0xE8, 6, &data[0], 2);
+				I2C_ReadRegisters(in, 0xEA, 6, &data[2], 2);
+
+				ret = I2C_ExecuteQueue(in);
+			} while (ret == -EIO && D2X_Reconnected(in, &retried));
+			if (ret < 0) return ret;
+
+			memcpy(in->pioDirection, data, 4);
+			in->pioCached |= PIO_CACHED_DIRECTION;
+
+			return 0;
+		}
+		else return -1;
+	}
+	else return -2;
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Read the entire PIO space of a SeaDAC Lite module, inputs only
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[out]	data
+///
+/// \retval		4	Success.
+/// \retval		-1	Invalid model number.
+/// \retval		-2	Unknown connection type.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// Returns the same data as \a SeaDacGetPIO, but only the input registers are
+/// read from the module.  Directions and outputs come from copies kept when
+/// they were last set or read, and an expander with no input banks is not
+/// read at all.  The first call after opening does a full \a SeaDacGetPIO to
+/// fill those copies.
+///
+/// \note	Only available for SeaDAC 8126.
+// ----------------------------------------------------------------------------
+int SeaDacGetInputs(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	int ret, retried = 0;
+
+	if (in->commMode == FTDI_DIRECT)
+	{
+		if (in->deviceType == SDL_8126)
+		{
+			int index = 0;
+			unsigned char inputState[4] = { 0, 0, 0, 0 };
+
+			if ((in->pioCached & (PIO_CACHED_DIRECTION | PIO_CACHED_OUTPUT)) !=
+				(PIO_CACHED_DIRECTION | PIO_CACHED_OUTPUT))
+				return SeaDacGetPIO(SeaMaxPointer, data);
+
+			do
+			{
+				I2C_InitializeQueue(in);
+
+				// Read the input port states (command registers 0 & 1), skipping
+				// a chip whose banks are both outputs
+				if (in->pioDirection[0] | in->pioDirection[1])
+					I2C_ReadRegisters(in, 0xE8, 0, &inputState[0], 2);
+				if (in->pioDirection[2] | in->pioDirection[3])
+					I2C_ReadRegisters(in, 0xEA, 0, &inputState[2], 2);
+
+				ret = I2C_ExecuteQueue(in);
+			} while (ret == -EIO && D2X_Reconnected(in, &retried));
+			if (ret < 0) return ret;
+
+			for (; index < 4; index++)
+			{
+				data[index] = inputState[index] & in->pioDirection[index];
+				data[index] |= (in->pioOutput[index] & ~in->pioDirection[index]);
+			}
+
+			return 4;
+		}
+		else return -1;
+	}
+	else return -2;
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Wait for an input of a SeaDAC Lite module to change
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[out]	*event           Where to store the change.
+/// \param[in]	timeout          Milliseconds to wait, or -1 to wait forever.
+///                              0 checks once.
+///
+/// \retval		0	An input changed; \a event is filled in.
+/// \retval		-1	Invalid model number.
+/// \retval		-2	Unknown connection type.
+/// \retval		-EINVAL	Null event.
+/// \retval		-ETIMEDOUT	No change within the timeout.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// Rather than scanning the I/O expanders, this samples only their shared
+/// (active low) INT line, which costs a two byte command and a one byte
+/// reply per USB round trip.  The input registers are read only once INT
+/// asserts, which also clears it.  Changes are reported relative to the state
+/// returned by the previous event; the first call takes the current state as
+/// its starting point.  Outputs and pins set as outputs never raise events.
+///
+/// \note	Only available for SeaDAC 8126.  The INT line is sampled on ACBUS
+/// bit 4 unless the module was opened with the int= option.
+// ----------------------------------------------------------------------------
+int SeaDacWaitForChange(SeaMaxLin *SeaMaxPointer, seadac_pio_event_s *event,
+	int timeout)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	unsigned char command[2], pins, state[4];
+	unsigned long long deadline, replyBy, seen;
+	int ret, index, changed, retried = 0;
+
+	if (event == NULL) return -EINVAL;
+	if (in->commMode != FTDI_DIRECT) return -2;
+	if (in->deviceType != SDL_8126) return -1;
+
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+	if (!ftdi_write_data || !ftdi_read_data) return -EIO;
+
+	// The first call only records where changes are counted from
+	if (!(in->pioCached & PIO_CACHED_EVENT))
+	{
+		ret = SeaDacGetInputs(SeaMaxPointer, in->pioLast);
+		if (ret < 0) return ret;
+		in->pioCached |= PIO_CACHED_EVENT;
+	}
+
+	deadline = statsNow() + (unsigned long long)timeout * 1000000ULL;
+
+	for (;;)
+	{
+		// Read the high GPIO byte (Command 0x83) and send it back now (0x87).
+		// The reply is collected even past the deadline, so every call
+		// takes at least one sample and none is left behind unread.
+		command[0] = 0x83;
+		command[1] = 0x87;
+		ret = ftdi_write_data(in->ftdic, command, 2);
+		if (ret == 2)
+		{
+			replyBy = statsNow() + RESPONSE_TIMEOUT_MS * 1000000ULL;
+			do ret = ftdi_read_data(in->ftdic, &pins, 1);
+			while (ret == 0 && statsNow() < replyBy);
+		}
+		else ret = -1;
+		if (ret <= 0)
+		{
+			// An INT edge missed while away shows up in the next compare
+			if (D2X_Reconnected(in, &retried)) continue;
+			return -EIO;
+		}
+
+		seen = statsNow();
+
+		if (!(pins & (1 << in->intPin)))
+		{
+			ret = SeaDacGetInputs(SeaMaxPointer, state);
+			if (ret < 0) return ret;
+
+			for (changed = 0, index = 0; index < 4; index++)
+			{
+				event->changed[index] = (state[index] ^ in->pioLast[index]) &
+					in->pioDirection[index];
+				changed |= event->changed[index];
+			}
+
+			memcpy(in->pioLast, state, 4);
+			if (changed)
+			{
+				event->timestamp_ns = seen;
+				memcpy(event->state, state, 4);
+				return 0;
+			}
+		}
+
+		if (timeout >= 0 && seen >= deadline) return -ETIMEDOUT;
+	}
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function adds a step to a transaction.                           )
+//  --------------------------------------------------------------------------
+int D2X_TxnAppend(SeaDacTxn *txn, const seadac_txn_op_s *op)
+{
+	seadac_txn_op_s *ops;
+	int size;
+
+	if (txn->count == txn->size)
+	{
+		size = (txn->size > 0) ? txn->size * 2 : 16;
+		ops = realloc(txn->ops, size * sizeof(seadac_txn_op_s));
+		if (ops == NULL) return -ENOMEM;
+		txn->ops = ops;
+		txn->size = size;
+	}
+
+	txn->ops[txn->count++] = *op;
+	return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function keeps the cached 8126 registers in step with a          )
+// ( transaction's writes.  A failed transaction may have written any of      )
+// ( them, so those copies are dropped instead.                               )
+//  --------------------------------------------------------------------------
+void D2X_TxnUpdateCache(seaMaxModule *in, SeaDacTxn *txn, int failed)
+{
+	seadac_txn_op_s *op;
+	int index, i, reg, bank;
+
+	for (index = 0; index < txn->count; index++)
+	{
+		op = &txn->ops[index];
+		if (op->type != TXN_WRITE) continue;
+		if (op->address != 0xE8 && op->address != 0xEA) continue;
+
+		for (i = 0; i < op->count; i++)
+		{
+			// The PCA9535 steps between the two registers of a pair
+			reg = (op->reg & ~1) | ((op->reg + i) & 1);
+			bank = ((op->address == 0xEA) ? 2 : 0) + (reg & 1);
+
+			if (reg == 2 || reg == 3)
+			{
+				if (failed) in->pioCached &= ~PIO_CACHED_OUTPUT;
+				else in->pioOutput[bank] = op->data[i];
+			}
+			else if (reg == 6 || reg == 7)
+			{
+				if (failed) in->pioCached &= ~PIO_CACHED_DIRECTION;
+				else in->pioDirection[bank] = op->data[i];
+			}
+		}
+	}
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Pick the fastest USB latency timer for a SeaDAC Lite module
 ///
-/// Reads the entire PIO space, inputs and outputs alike.
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
 ///
-/// \warning	Sufficient data must be allocated for data before calling
-///	this function.  For instance, the 8126 has 32 bits of PIO, therefore
-/// data should be allocated with 4 bytes of data before calling this function.
+/// \return int      The latency timer chosen, in ms, or an error code.
+/// \retval >0       Latency timer now in use.
+/// \retval -2       Unknown connection type.
+/// \retval -EIO     USB transfer failed.
+/// \retval -ETIMEDOUT  The module stopped answering.
 ///
-/// \note	Only available for SeaDAC 8126.
+/// The chip holds short replies until its latency timer runs out (16 ms by
+/// default), which bounds every request/response exchange.  Each candidate
+/// timer is set in turn, a few round trips are timed at it, and the one
+/// with the lowest median is kept, along with the small transfer chunks of
+/// the low latency profile.  Opening with "profile=auto" does the same.
+///
+/// \note	The bit bang models are left in synchronous mode, as after
+/// \a SeaDacLinExchange.
 // ----------------------------------------------------------------------------
-int SeaDacGetPIO(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+int SeaDacCalibrate(SeaMaxLin *SeaMaxPointer)
 {
+	static const unsigned char timers[] = { 1, 2, 4, 8, 16 };
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	long long rounds[CALIBRATION_ROUNDS], medians[sizeof(timers)], fastest = -1, swap;
+	int timer, round, index, ret, chosen = 1;
 
-	if (in->commMode == FTDI_DIRECT)
+	if (in->commMode != FTDI_DIRECT) return -2;
+
+	for (timer = 0; timer < (int)sizeof(timers); timer++)
 	{
-		if (in->deviceType == SDL_8126)
+		ret = D2X_SetUsbTuning(in, timers[timer], LATENCY_CHUNK_BYTES);
+		if (ret < 0) return ret;
+
+		for (round = 0; round < CALIBRATION_ROUNDS; round++)
 		{
-			int index = 0;
-			unsigned char /*portdata,*/ direction[4], inputState[4], outputState[4];
+			rounds[round] = D2X_RoundTrip(in);
+			if (rounds[round] < 0) return (int)rounds[round];
+
+			// Keep the rounds sorted to read off the median
+			for (index = round; index > 0 && rounds[index - 1] > rounds[index]; index--)
+			{
+				swap = rounds[index];
+				rounds[index] = rounds[index - 1];
+				rounds[index - 1] = swap;
+			}
+		}
 
-			I2C_InitializeQueue(in);
+		medians[timer] = rounds[CALIBRATION_ROUNDS / 2];
+		if (fastest < 0 || medians[timer] < fastest) fastest = medians[timer];
+	}
 
-			// Read the direction ports (command registers 6 & 7)
-			I2C_ReadRegister(0xE8, 6, &direction[0]);
-			I2C_ReadRegister(0xE8, 7, &direction[1]);
-			I2C_ReadRegister(0xEA, 6, &direction[2]);
-			I2C_ReadRegister(0xEA, 7, &direction[3]);
+	// A longer timer sends fewer empty packets, so it wins near ties (5%)
+	for (timer = 0; timer < (int)sizeof(timers); timer++)
+	{
+		if (medians[timer] * 20 <= fastest * 21) chosen = timers[timer];
+	}
 
-			// Read the input port states (command registers 0 & 1)
-			I2C_ReadRegister(0xE8, 0, &inputState[0]);
-			I2C_ReadRegister(0xE8, 1, &inputState[1]);
-			I2C_ReadRegister(0xEA, 0, &inputState[2]);
-			I2C_ReadRegister(0xEA, 1, &inputState[3]);
+	ret = D2X_SetUsbTuning(in, chosen, LATENCY_CHUNK_BYTES);
+	if (ret < 0) return ret;
 
-			// Read the output port states (command registers 2 & 3)
-			I2C_ReadRegister(0xE8, 2, &outputState[0]);
-			I2C_ReadRegister(0xE8, 3, &outputState[1]);
-			I2C_ReadRegister(0xEA, 2, &outputState[2]);
-			I2C_ReadRegister(0xEA, 3, &outputState[3]);
+	return chosen;
+}
 
-			I2C_ExecuteQueue(in);
 
-			for (; index < 4; index++)
-			{
-				data[index] = inputState[index] & direction[index];
-				data[index] |= (outputState[index] & ~direction[index]);
-			}
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	List the SeaDAC Lite modules attached to this host
+///
+/// \param[out] *devices   Where to store the modules found.
+/// \param[in] maximum     Number of entries \a devices can hold.
+///
+/// \return int       Number of modules attached, or an error code.
+/// \retval >=0       Modules found; only the first \a maximum are stored.
+/// \retval -EINVAL   Null list with a non-zero maximum.
+/// \retval -EAGAIN   libftdi.so could not be loaded or initialized.
+///
+/// Every supported product ID is searched.  The serial and index of an entry
+/// can be passed to \a SeaMaxLinOpen to open that exact module, e.g.
+/// "sealevel_d2x://8111?serial=A1B2C3" or "sealevel_d2x://8111?index=3".
+/// Modules of the same product are listed in the order index= counts them.
+/// The bus location is only known when libftdi is built on libusb-1.0.
+// ----------------------------------------------------------------------------
+int SeaDacEnumerate(seadac_device_info_s *devices, int maximum)
+{
+	static const int products[] = { SDL_8111, SDL_8112, SDL_8113, SDL_8114,
+		SDL_8115, SDL_8126 };
+	struct ftdi_device_list *list, *node;
+	seadac_device_info_s *info;
+	ftdi_context ftdic = NULL;
+	void *libftdi;
+	int count = 0, product, index, ret;
+
+	if (devices == NULL && maximum > 0) return -EINVAL;
+
+	libftdi = dlopen("libftdi.so", RTLD_LAZY);
+	if (!libftdi)
+	{
+		fprintf(stderr, "failed to load libftdi.so (%s)\n", dlerror());
+		return -EAGAIN;
+	}
 
+	pf_ftdi_new ftdi_new = dlsym(libftdi, "ftdi_new");
+	pf_ftdi_free ftdi_free = dlsym(libftdi, "ftdi_free");
+	pf_ftdi_usb_find_all ftdi_usb_find_all = dlsym(libftdi, "ftdi_usb_find_all");
+	pf_ftdi_list_free ftdi_list_free = dlsym(libftdi, "ftdi_list_free");
+	pf_ftdi_usb_get_strings ftdi_usb_get_strings = dlsym(libftdi, "ftdi_usb_get_strings");
+	pf_libusb_get_bus_number libusb_get_bus_number = NULL;
+	pf_libusb_get_device_address libusb_get_device_address = NULL;
+
+	// Only libftdi 1.x lists libusb-1.0 devices, which say where they are
+	// plugged in.  libusb-0.1 has no way to ask, so the location stays empty.
+	if (dlsym(libftdi, "ftdi_get_library_version"))
+	{
+		libusb_get_bus_number = dlsym(libftdi, "libusb_get_bus_number");
+		libusb_get_device_address = dlsym(libftdi, "libusb_get_device_address");
+	}
 
-			return 4;
+	if (!ftdi_new || !ftdi_free || !ftdi_usb_find_all || !ftdi_list_free ||
+		!(ftdic = ftdi_new()))
+	{
+		dlclose(libftdi);
+		return -EAGAIN;
+	}
+
+	// The scan goes through libusb's global device list
+	pthread_mutex_lock(&d2xOpenLock);
+	for (product = 0; product < (int)(sizeof(products) / sizeof(products[0])); product++)
+	{
+		list = NULL;
+		ret = ftdi_usb_find_all(ftdic, &list, VENDOR, products[product]);
+		if (ret < 0) continue;
+
+		for (node = list, index = 0; node != NULL; node = node->next, index++, count++)
+		{
+			if (count >= maximum) continue;
+
+			info = &devices[count];
+			memset(info, 0, sizeof(seadac_device_info_s));
+			info->product = products[product];
+			info->index = index;
+
+			// Strings may be unreadable when another process has the module
+			if (ftdi_usb_get_strings) ftdi_usb_get_strings(ftdic, node->dev,
+				NULL, 0, info->description, sizeof(info->description),
+				info->serial, sizeof(info->serial));
+
+			if (node->dev && libusb_get_bus_number && libusb_get_device_address)
+			{
+				snprintf(info->location, sizeof(info->location), "%03u/%03u",
+					libusb_get_bus_number(node->dev),
+					libusb_get_device_address(node->dev));
+			}
 		}
-		else return -1;
+
+		ftdi_list_free(&list);
 	}
-	else return -2;
+	pthread_mutex_unlock(&d2xOpenLock);
+
+	ftdi_free(ftdic);
+	dlclose(libftdi);
+	return count;
+}
+
+
+// ----------------------------------------------------------------------------
+// One module being opened by SeaDacOpenAll.
+// ----------------------------------------------------------------------------
+typedef struct d2x_open_s
+{
+	SeaMaxLin *module;
+	char name[320];			//Device string for SeaMaxLinOpen.
+	int result;
+	int threaded;			//Opened from its own thread.
+	pthread_t thread;
+} d2x_open_s;
+
+
+//  --------------------------------------------------------------------------
+// ( Private thread function opens one module for SeaDacOpenAll.              )
+//  --------------------------------------------------------------------------
+void *D2X_OpenThread(void *arg)
+{
+	d2x_open_s *job = (d2x_open_s*)arg;
+
+	job->result = SeaMaxLinOpen(job->module, job->name);
+	return NULL;
 }
 
 
 // ----------------------------------------------------------------------------
 /// \ingroup group_seamax_fun
-/// \brief	Write the entire PIO space of a SeaDAC Lite module
-///
-/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
-/// \param[in]	data
+/// \brief	Open every attached SeaDAC Lite module at once
 ///
-/// \retval		0	Success.
-/// \retval		-1	Invalid model number.
-/// \retval		-2	Unknown connection type.
+/// \param[in] product     Product to open (e.g. 0x8111), or 0 for all.
+/// \param[in] *options    SeaDAC Lite options for each module, or NULL.
+/// \param[out] **modules  Where to store the open modules.
+/// \param[in] maximum     Number of entries \a modules can hold.
 ///
-/// Writes the entire PIO space
+/// \return int       Number of modules opened, or an error code.
+/// \retval >=0       Modules opened, stored at the start of \a modules.
+/// \retval -EINVAL   Null list, or a maximum below 1.
+/// \retval -ENOMEM   Low memory.
+/// \retval -EAGAIN   libftdi.so could not be loaded or initialized.
 ///
-/// \note	PIO space writes will not affect those pins marked as inputs.
-/// \note	Only available for SeaDAC 8126.
+/// The first \a maximum modules of \a product found by \a SeaDacEnumerate are
+/// each opened by serial number (by index when they have none) from their own
+/// thread, so a fleet opens in about the time of one module.  \a options
+/// takes the same form as in \a SeaMaxLinOpen, e.g. "i2c=400k".  Modules that
+/// fail to open are left out.
+/// Each module returned must be closed and destroyed by the caller.
 // ----------------------------------------------------------------------------
-int SeaDacSetPIO(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+int SeaDacOpenAll(int product, const char *options, SeaMaxLin **modules,
+	int maximum)
 {
-	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	seadac_device_info_s *devices;
+	d2x_open_s *opens;
+	int found, listed, count = 0, opened = 0, index;
 
-	if (in->commMode == FTDI_DIRECT)
+	if (modules == NULL || maximum < 1) return -EINVAL;
+
+	// Every model is listed, so count them all before picking ours
+	found = SeaDacEnumerate(NULL, 0);
+	if (found <= 0) return found;
+
+	devices = calloc(found, sizeof(seadac_device_info_s));
+	opens = calloc(maximum, sizeof(d2x_open_s));
+	if (devices == NULL || opens == NULL)
 	{
-		if (in->deviceType == SDL_8126)
+		free(devices);
+		free(opens);
+		return -ENOMEM;
+	}
+
+	// Modules may come or go in between
+	listed = SeaDacEnumerate(devices, found);
+	if (listed > found) listed = found;
+
+	for (index = 0; index < listed && count < maximum; index++)
+	{
+		if (product != 0 && devices[index].product != product) continue;
+
+		if (devices[index].serial[0] != '\0')
+			snprintf(opens[count].name, sizeof(opens[count].name),
+				"sealevel_d2x://%x?serial=%s", devices[index].product,
+				devices[index].serial);
+		else
+			snprintf(opens[count].name, sizeof(opens[count].name),
+				"sealevel_d2x://%x?index=%d", devices[index].product,
+				devices[index].index);
+
+		if (options != NULL && *options != '\0')
 		{
-			int index = 0;
+			strncat(opens[count].name, "&",
+				sizeof(opens[count].name) - strlen(opens[count].name) - 1);
+			strncat(opens[count].name, options,
+				sizeof(opens[count].name) - strlen(opens[count].name) - 1);
+		}
 
-			I2C_InitializeQueue(in);
+		opens[count].module = SeaMaxLinCreate();
+		if (opens[count].module == NULL) break;
 
-			// Write the output ports (command registers 2 & 3)
-			I2C_WriteRegister(0xE8, 2, data[index++]);
-			I2C_WriteRegister(0xE8, 3, data[index++]);
-			I2C_WriteRegister(0xEA, 2, data[index++]);
-			I2C_WriteRegister(0xEA, 3, data[index++]);
+		// Without a thread the module is simply opened here
+		opens[count].threaded = (pthread_create(&opens[count].thread, NULL,
+			D2X_OpenThread, &opens[count]) == 0);
+		if (!opens[count].threaded) D2X_OpenThread(&opens[count]);
+		count++;
+	}
 
-			I2C_ExecuteQueue(in);
+	for (index = 0; index < count; index++)
+	{
+		if (opens[index].threaded) pthread_join(opens[index].thread, NULL);
 
-			return 0;
-		}
-		else return -1;
+		if (opens[index].result < 0) SeaMaxLinDestroy(opens[index].module);
+		else modules[opened++] = opens[index].module;
 	}
-	else return -2;
+
+	free(devices);
+	free(opens);
+	return (listed < 0) ? listed : opened;
 }
 
 
 // ----------------------------------------------------------------------------
 /// \ingroup group_seamax_fun
-/// \brief	Sets the PIO direction 
+/// \brief	Allocate an empty SeaDAC Lite transaction
 ///
-/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
-/// \param[in]	data
+/// \return SeaDacTxn*   The new transaction, or NULL if out of memory.
 ///
-/// \retval		0	Success.
-/// \retval		-1	Invalid model number.
-/// \retval		-2	Unknown connection type.
+/// A transaction records I/O expander register reads and writes and GPIO
+/// changes, and \a SeaDacTxnExecute carries them all out in one USB
+/// exchange.  It is kept after it executes, so a control loop can build it
+/// once and execute it every cycle.
 ///
 /// \note	Only available for SeaDAC 8126.
 // ----------------------------------------------------------------------------
-int SeaDacSetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+SeaDacTxn *SeaDacTxnCreate(void)
 {
-	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	return (SeaDacTxn*)calloc(1, sizeof(SeaDacTxn));
+}
 
-	if (in->commMode == FTDI_DIRECT)
-	{
-		if (in->deviceType == SDL_8126)
-		{
-			unsigned char enable = 0x00, ON = 0xFF, OFF = 0x00;
 
-			I2C_InitializeQueue(in);
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Release a SeaDAC Lite transaction
+///
+/// \param[in] *txn    A transaction from \a SeaDacTxnCreate.
+///
+/// \retval		0	Successfully de-allocated memory.
+// ----------------------------------------------------------------------------
+int SeaDacTxnDestroy(SeaDacTxn *txn)
+{
+	if (txn == NULL) return 0;
+
+	free(txn->ops);
+	free(txn);
+	return 0;
+}
+
 
-			// Write entire banks as either outputs or inputs to command registers 6 & 7
-			// on both Philips PCA9535 chips
-			I2C_WriteRegister(0xE8, 6, (data[0] == 0) ? OFF : ON);
-			I2C_WriteRegister(0xE8, 7, (data[1] == 0) ? OFF : ON);
-			I2C_WriteRegister(0xEA, 6, (data[2] == 0) ? OFF : ON);
-			I2C_WriteRegister(0xEA, 7, (data[3] == 0) ? OFF : ON);
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Remove every step from a SeaDAC Lite transaction
+///
+/// \param[in] *txn    A transaction from \a SeaDacTxnCreate.
+///
+/// \retval		0	Success.
+/// \retval		-EINVAL	Null transaction.
+// ----------------------------------------------------------------------------
+int SeaDacTxnClear(SeaDacTxn *txn)
+{
+	if (txn == NULL) return -EINVAL;
 
-			// Enable the line driver directions
-			if (data[0] == 0) enable |= GPIO_0;
-			if (data[1] == 0) enable |= GPIO_1;
-			if (data[2] == 0) enable |= GPIO_2;
-			if (data[3] == 0) enable |= GPIO_3;
+	txn->count = 0;
+	return 0;
+}
 
-			I2C_SetGPIO(0xFF, ~enable);
 
-			I2C_ExecuteQueue(in);
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Add a register read to a SeaDAC Lite transaction
+///
+/// \param[in] *txn      A transaction from \a SeaDacTxnCreate.
+/// \param[in] address   I2C address of the I/O expander (0xE8 or 0xEA).
+/// \param[in] reg       First register to read.
+/// \param[out] *data    Where to store the registers.
+/// \param[in] count     Number of registers to read.
+///
+/// \retval		0	Success.
+/// \retval		-EINVAL	Null transaction or buffer, or a count below 1.
+/// \retval		-ENOMEM	Out of memory.
+///
+/// The registers are read into \a data when the transaction executes, so the
+/// buffer must stay valid for as long as the transaction is used.  The PCA9535
+/// steps to the other register of a pair after each byte; a read of two from
+/// register 0 returns both input ports.
+// ----------------------------------------------------------------------------
+int SeaDacTxnRead(SeaDacTxn *txn, unsigned char address, unsigned char reg,
+	unsigned char *data, int count)
+{
+	seadac_txn_op_s op = { TXN_READ, address, reg, 0, 0, data, count };
 
-			return 0;
-		}
-		else return -1;
-	}
-	else return -2;
+	if (txn == NULL || data == NULL || count < 1) return -EINVAL;
+	return D2X_TxnAppend(txn, &op);
 }
 
 
 // ----------------------------------------------------------------------------
 /// \ingroup group_seamax_fun
-/// \brief	Reads the PIO direction 
+/// \brief	Add a register write to a SeaDAC Lite transaction
+///
+/// \param[in] *txn      A transaction from \a SeaDacTxnCreate.
+/// \param[in] address   I2C address of the I/O expander (0xE8 or 0xEA).
+/// \param[in] reg       First register to write.
+/// \param[in] *data     Values to write.
+/// \param[in] count     Number of registers to write.
+///
+/// \retval		0	Success.
+/// \retval		-EINVAL	Null transaction or buffer, or a count below 1.
+/// \retval		-ENOMEM	Out of memory.
+///
+/// \a data is read when the transaction executes, not when the write is
+/// added, so a reused transaction writes whatever the buffer holds then.
+///
+/// \note	Writing the direction registers (6 and 7) does not turn the line
+/// drivers around; add a \a SeaDacTxnSetGPIO step for that.
+// ----------------------------------------------------------------------------
+int SeaDacTxnWrite(SeaDacTxn *txn, unsigned char address, unsigned char reg,
+	unsigned char *data, int count)
+{
+	seadac_txn_op_s op = { TXN_WRITE, address, reg, 0, 0, data, count };
+
+	if (txn == NULL || data == NULL || count < 1) return -EINVAL;
+	return D2X_TxnAppend(txn, &op);
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Add a GPIO change to a SeaDAC Lite transaction
+///
+/// \param[in] *txn       A transaction from \a SeaDacTxnCreate.
+/// \param[in] direction  GPIO directions, a bit set for an output.
+/// \param[in] state      GPIO levels.
+///
+/// \retval		0	Success.
+/// \retval		-EINVAL	Null transaction.
+/// \retval		-ENOMEM	Out of memory.
+///
+/// On the 8126, GPIO 0-3 enable the line drivers of the four banks; clear a
+/// bank's bit to drive it as an output, as \a SeaDacSetPIODirection does.
+// ----------------------------------------------------------------------------
+int SeaDacTxnSetGPIO(SeaDacTxn *txn, unsigned char direction, unsigned char state)
+{
+	seadac_txn_op_s op = { TXN_GPIO, 0, 0, direction, state, NULL, 0 };
+
+	if (txn == NULL) return -EINVAL;
+	return D2X_TxnAppend(txn, &op);
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief	Carry out a SeaDAC Lite transaction
 ///
 /// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
-/// \param[in]	data
+/// \param[in] *txn              A transaction from \a SeaDacTxnCreate.
 ///
 /// \retval		0	Success.
 /// \retval		-1	Invalid model number.
 /// \retval		-2	Unknown connection type.
+/// \retval		-EINVAL	Null transaction.
+/// \retval		-EIO	USB transfer failed.
+/// \retval		-ENXIO	An I/O expander did not acknowledge.
+///
+/// The steps are sent in the order they were added, in a single USB exchange
+/// (very long transactions are split, but still pipelined), and the reads
+/// are stored once the responses arrive.  On failure some of the read
+/// buffers may already have been updated.
 ///
 /// \note	Only available for SeaDAC 8126.
 // ----------------------------------------------------------------------------
-int SeaDacGetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data)
+int SeaDacTxnExecute(SeaMaxLin *SeaMaxPointer, SeaDacTxn *txn)
 {
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	seadac_txn_op_s *op;
+	int ret, index, retried = 0;
 
-	if (in->commMode == FTDI_DIRECT)
+	if (txn == NULL) return -EINVAL;
+	if (in->commMode != FTDI_DIRECT) return -2;
+	if (in->deviceType != SDL_8126) return -1;
+
+	do
 	{
-		if (in->deviceType == SDL_8126)
-		{
-			I2C_InitializeQueue(in);
+		I2C_InitializeQueue(in);
 
-			// Reads bank direction as either outputs or inputs to command registers 6 & 7
-			// on both Philips PCA9535 chips
-			I2C_ReadRegister(0xE8, 6, &data[0]);
-			I2C_ReadRegister(0xE8, 7, &data[1]);
-			I2C_ReadRegister(0xEA, 6, &data[2]);
-			I2C_ReadRegister(0xEA, 7, &data[3]);
+		for (index = 0; index < txn->count; index++)
+		{
+			op = &txn->ops[index];
+			switch (op->type)
+			{
+			case TXN_READ:
+				I2C_ReadRegisters(in, op->address, op->reg, op->data, op->count);
+				break;
+			case TXN_WRITE:
+				I2C_WriteRegisters(in, op->address, op->reg, op->data, op->count);
+				break;
+			case TXN_GPIO:
+				I2C_SetGPIO(in, op->direction, op->state);
+				break;
+			}
+		}
 
-			I2C_ExecuteQueue(in);
+		ret = I2C_ExecuteQueue(in);
+	} while (ret == -EIO && D2X_Reconnected(in, &retried));
+	D2X_TxnUpdateCache(in, txn, ret < 0);
 
-			return 0;
-		}
-		else return -1;
-	}
-	else return -2;
+	return ret;
 }
 
 
@@ -775,7 +2572,7 @@ int SeaDacGetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data)
 // ----------------------------------------------------------------------------
 int SeaDacLinRead(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 {
-	int ret = 0;
+	int ret = 0, retried = 0;
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
 	pf_ftdi_read_pins ftdi_read_pins = dlsym(in->libftdi, "ftdi_read_pins");
 	pf_ftdi_get_error_string ftdi_get_error_string = dlsym(in->libftdi, "ftdi_get_error_string");
@@ -791,7 +2588,16 @@ int SeaDacLinRead(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 	}
 
 	//Read data from device
-	ret = ftdi_read_pins(in->ftdic, data);
+	do
+	{
+		statsBegin(in, 0);
+		SEAMAX_PROBE3(ftdi_transfer_begin, in->traceId, 1, numBytes);
+		ret = ftdi_read_pins(in->ftdic, data);
+		SEAMAX_PROBE3(ftdi_transfer_end, in->traceId, 1, ret);
+		traceFrame(in, SEAMAX_TRACE_RX, data, (ret < 0) ? 0 : numBytes,
+			(ret < 0) ? -EIO : 0);
+		if (ret < 0) statsFailed(in, -EIO);
+	} while (ret < 0 && D2X_Reconnected(in, &retried));
 	if (ret < 0)
 	{
 		fprintf(stderr, "read failed, error %d (%s)\n", ret,
@@ -799,6 +2605,9 @@ int SeaDacLinRead(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 		return -EIO;
 	}
 
+	statsSent(in, 0);
+	statsReceived(in, numBytes, 0);
+
 	return ret;
 }
 
@@ -821,7 +2630,7 @@ int SeaDacLinRead(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 // ----------------------------------------------------------------------------
 int SeaDacLinWrite(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 {
-	int ret = 0;
+	int ret = 0, retried = 0;
 	unsigned char buf[1];
 
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
@@ -832,6 +2641,10 @@ int SeaDacLinWrite(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 	if (numBytes > 2)
 		return -ERANGE;
 
+	//Leave synchronous mode (SeaDacLinExchange), which would sample each byte
+	if (in->deviceType != SDL_8126 && D2X_SetSyncBitbang(in, 0) < 0)
+		return -EIO;
+
 	memcpy(buf, data, numBytes);
 
 	if (!ftdi_write_data)
@@ -841,7 +2654,15 @@ int SeaDacLinWrite(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 	}
 
 	//Write data to device
-	ret = ftdi_write_data(in->ftdic, buf, numBytes);
+	do
+	{
+		statsBegin(in, 0);
+		SEAMAX_PROBE3(ftdi_transfer_begin, in->traceId, 0, numBytes);
+		ret = ftdi_write_data(in->ftdic, buf, numBytes);
+		SEAMAX_PROBE3(ftdi_transfer_end, in->traceId, 0, ret);
+		traceFrame(in, SEAMAX_TRACE_TX, buf, numBytes, (ret < 0) ? -EIO : 0);
+		if (ret < 0) statsFailed(in, -EIO);
+	} while (ret < 0 && D2X_Reconnected(in, &retried));
 	if (ret < 0)
 	{
 		fprintf(stderr, "write failed, error %d (%s)\n", ret,
@@ -849,5 +2670,133 @@ int SeaDacLinWrite(SeaMaxLin *SeaMaxPointer, unsigned char *data, int numBytes)
 		return -EIO;
 	}
 
+	//Kept to put the pins back if the module is reconnected
+	if (ret > 0) in->bitbangOutput = buf[0];
+
+	statsSent(in, ret);
+	statsReceived(in, 0, 0);
+
+	return ret;
+}
+
+
+//  --------------------------------------------------------------------------
+// ( Private function carries out one synchronous bit bang exchange.         )
+//  --------------------------------------------------------------------------
+int D2X_Exchange(seaMaxModule *in, unsigned char *out, unsigned char *data,
+	int count)
+{
+	unsigned char buffer[EXCHANGE_CHUNK_BYTES];
+	unsigned long long deadline;
+	int ret, sent = 0, got, length, step, index;
+
+	pf_ftdi_write_data ftdi_write_data = dlsym(in->libftdi, "ftdi_write_data");
+	pf_ftdi_read_data ftdi_read_data = dlsym(in->libftdi, "ftdi_read_data");
+	if (!ftdi_write_data || !ftdi_read_data) return -EIO;
+
+	ret = D2X_SetSyncBitbang(in, 1);
+	if (ret < 0) return ret;
+
+	statsBegin(in, 0);
+
+	// Each sample is taken just before its byte is output, so the last step
+	// is written twice to sample the pins after it.  Stream position 0 is
+	// then the state before the sequence, and i + 1 the state after out[i].
+	for (step = 0; step <= count; step += length)
+	{
+		length = count + 1 - step;
+		if (length > EXCHANGE_CHUNK_BYTES) length = EXCHANGE_CHUNK_BYTES;
+
+		for (index = 0; index < length; index++)
+			buffer[index] = out[(step + index < count) ? step + index : count - 1];
+
+		SEAMAX_PROBE3(ftdi_transfer_begin, in->traceId, 0, length);
+		ret = ftdi_write_data(in->ftdic, buffer, length);
+		SEAMAX_PROBE3(ftdi_transfer_end, in->traceId, 0, ret);
+		traceFrame(in, SEAMAX_TRACE_TX, buffer, length, (ret < 0) ? -EIO : 0);
+		if (ret != length)
+		{
+			statsFailed(in, -EIO);
+			return -EIO;
+		}
+		sent += length;
+
+		deadline = statsNow() + RESPONSE_TIMEOUT_MS * 1000000ULL;
+		SEAMAX_PROBE3(ftdi_transfer_begin, in->traceId, 1, length);
+		for (got = 0; got < length; got += ret)
+		{
+			ret = ftdi_read_data(in->ftdic, buffer + got, length - got);
+			if (ret < 0 || (ret == 0 && statsNow() > deadline)) break;
+		}
+		SEAMAX_PROBE3(ftdi_transfer_end, in->traceId, 1, (ret < 0) ? ret : got);
+		traceFrame(in, SEAMAX_TRACE_RX, buffer, got,
+			(ret < 0) ? -EIO : ((got < length) ? -ETIMEDOUT : 0));
+		if (got < length)
+		{
+			// Samples still on their way would land in the next exchange;
+			// forgetting the mode makes the next call set it and purge them
+			in->syncBitbang = -1;
+			statsFailed(in, (ret < 0) ? -EIO : -ETIMEDOUT);
+			return (ret < 0) ? -EIO : -ETIMEDOUT;
+		}
+
+		for (index = 0; index < length; index++)
+		{
+			if (step + index > 0) data[step + index - 1] = buffer[index];
+		}
+	}
+
+	statsSent(in, sent);
+	statsReceived(in, sent, 0);
+
+	//Kept to put the pins back if the module is reconnected
+	in->bitbangOutput = out[count - 1];
+
+	return count;
+}
+
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Write a sequence of outputs and capture the inputs at each step.
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in] *out              Output states to apply, one byte per step.
+/// \param[out] *data            Pin states sampled at each step.
+/// \param[in] count             Number of steps.
+///
+/// \return int      Error code.
+/// \retval >0       Number of steps carried out.
+/// \retval -1       Invalid model number.
+/// \retval -2       Unknown connection type.
+/// \retval -EINVAL  Null buffer or a count below 1.
+/// \retval -EIO     USB transfer failed.
+/// \retval -ETIMEDOUT  The samples did not all arrive.
+///
+/// The module is put in synchronous bit bang mode, where every byte written
+/// to the pins also clocks a sample of them back.  A step costs one byte each
+/// way, so a whole sequence takes a single USB exchange (long ones are split
+/// into chunks the chip can buffer) instead of a write and a read per step.
+/// \a data[i] holds the pins after \a out[i] was applied, in the same layout
+/// as \a SeaDacLinRead.
+///
+/// The module stays in synchronous mode until the next \a SeaDacLinWrite.
+///
+/// \note	Only available for the bit bang models (8111 to 8115).
+// ----------------------------------------------------------------------------
+int SeaDacLinExchange(SeaMaxLin *SeaMaxPointer, unsigned char *out,
+	unsigned char *data, int count)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	int ret, retried = 0;
+
+	if (out == NULL || data == NULL || count < 1) return -EINVAL;
+	if (in->commMode != FTDI_DIRECT) return -2;
+	if (in->deviceType == SDL_8126) return -1;
+
+	// A sequence cut short by a lost module is run again from the start
+	do ret = D2X_Exchange(in, out, data, count);
+	while (ret == -EIO && D2X_Reconnected(in, &retried));
+
 	return ret;
 }
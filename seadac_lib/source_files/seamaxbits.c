@@ -0,0 +1,444 @@
+/*
+ * seamaxbits.c
+ * SeaMAX for Linux
+ *
+ * This code implements packing and unpacking of coils and discrete inputs:
+ * between the bytes MODBUS carries them in, eight to a byte with the first
+ * address in the least significant bit, and one byte per channel.  On x86
+ * there are SSE2, AVX2 and BMI2 (pdep/pext) kernels alongside the portable
+ * one, and the best the processor has is picked the first time bits are
+ * packed or unpacked.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITS_X86
+#include <immintrin.h>
+#endif
+
+#include "seamaxlin.h"
+
+// Most coils or discrete inputs one request reads.  MODBUS allows 2000, but
+// an RTU response must stay under 220 bytes (214 data bytes) and a TCP one
+// within 255, so this is the most every transport can frame.
+#define BITS_MAX_READ	1712
+
+// Most coils one MODBUS request writes
+#define BITS_MAX_WRITE	1968
+
+// ----------------------------------------------------------------------------
+// A pair of kernels.  Each takes a count of channels; a partial last byte is
+// packed with its unused bits clear.
+// ----------------------------------------------------------------------------
+typedef struct bits_kernel
+{
+	seamax_bits_t which;
+	void (*unpack)(const unsigned char *packed, unsigned char *bits, int count);
+	void (*pack)(const unsigned char *bits, unsigned char *packed, int count);
+} bits_kernel;
+
+//  --------------------------------------------------------------------------
+// ( Private functions to unpack and pack a bit at a time.                    )
+// The vector kernels finish their last few channels with these.
+//  --------------------------------------------------------------------------
+static void unpackScalar(const unsigned char *packed, unsigned char *bits,
+	int count)
+{
+	int index;
+
+	for (index = 0; index < count; index++)
+		bits[index] = (packed[index / 8] >> (index % 8)) & 1;
+}
+
+static void packScalar(const unsigned char *bits, unsigned char *packed,
+	int count)
+{
+	int index;
+
+	memset(packed, 0, (count + 7) / 8);
+	for (index = 0; index < count; index++)
+		if (bits[index]) packed[index / 8] |= 1 << (index % 8);
+}
+
+#ifdef BITS_X86
+
+//  --------------------------------------------------------------------------
+// ( Private functions to unpack and pack sixteen channels at a time.         )
+// Unpacking spreads each packed byte over eight lanes and tests one bit in
+// each; packing gathers the lanes that aren't zero with a byte movemask.
+//  --------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static void unpackSSE2(const unsigned char *packed, unsigned char *bits,
+	int count)
+{
+	const __m128i select = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1,
+		-128, 64, 32, 16, 8, 4, 2, 1);
+	const __m128i one = _mm_set1_epi8(1);
+	__m128i spread;
+	int index;
+
+	for (index = 0; index + 16 <= count; index += 16)
+	{
+		spread = _mm_cvtsi32_si128(packed[index / 8] |
+			(packed[index / 8 + 1] << 8));
+		spread = _mm_unpacklo_epi8(spread, spread);
+		spread = _mm_unpacklo_epi16(spread, spread);
+		spread = _mm_unpacklo_epi32(spread, spread);
+		spread = _mm_cmpeq_epi8(_mm_and_si128(spread, select), select);
+		_mm_storeu_si128((__m128i*)&bits[index],
+			_mm_and_si128(spread, one));
+	}
+	unpackScalar(&packed[index / 8], &bits[index], count - index);
+}
+
+__attribute__((target("sse2")))
+static void packSSE2(const unsigned char *bits, unsigned char *packed,
+	int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int mask;
+	int index;
+
+	for (index = 0; index + 16 <= count; index += 16)
+	{
+		mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i*)&bits[index]), zero));
+		packed[index / 8] = mask;
+		packed[index / 8 + 1] = mask >> 8;
+	}
+	packScalar(&bits[index], &packed[index / 8], count - index);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private functions to unpack and pack thirty-two channels at a time.      )
+// As the SSE2 ones, with a byte shuffle to spread four packed bytes.
+//  --------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void unpackAVX2(const unsigned char *packed, unsigned char *bits,
+	int count)
+{
+	const __m256i spreader = _mm256_set_epi8(
+		3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+		1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i select = _mm256_set1_epi64x(0x8040201008040201LL);
+	const __m256i one = _mm256_set1_epi8(1);
+	__m256i spread;
+	unsigned int word;
+	int index;
+
+	for (index = 0; index + 32 <= count; index += 32)
+	{
+		memcpy(&word, &packed[index / 8], 4);
+		spread = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spreader);
+		spread = _mm256_cmpeq_epi8(_mm256_and_si256(spread, select),
+			select);
+		_mm256_storeu_si256((__m256i*)&bits[index],
+			_mm256_and_si256(spread, one));
+	}
+	unpackScalar(&packed[index / 8], &bits[index], count - index);
+}
+
+__attribute__((target("avx2")))
+static void packAVX2(const unsigned char *bits, unsigned char *packed,
+	int count)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	unsigned int mask;
+	int index;
+
+	for (index = 0; index + 32 <= count; index += 32)
+	{
+		mask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i*)&bits[index]), zero));
+		memcpy(&packed[index / 8], &mask, 4);
+	}
+	packScalar(&bits[index], &packed[index / 8], count - index);
+}
+
+#ifdef __x86_64__
+
+//  --------------------------------------------------------------------------
+// ( Private functions to unpack and pack eight channels at a time.           )
+// pdep puts each packed bit in the low bit of its own byte; for pext, a
+// channel byte that isn't zero is first folded into its high bit.
+//  --------------------------------------------------------------------------
+__attribute__((target("bmi2")))
+static void unpackBMI2(const unsigned char *packed, unsigned char *bits,
+	int count)
+{
+	unsigned long long spread;
+	int index;
+
+	for (index = 0; index + 8 <= count; index += 8)
+	{
+		spread = _pdep_u64(packed[index / 8], 0x0101010101010101ULL);
+		memcpy(&bits[index], &spread, 8);
+	}
+	unpackScalar(&packed[index / 8], &bits[index], count - index);
+}
+
+__attribute__((target("bmi2")))
+static void packBMI2(const unsigned char *bits, unsigned char *packed,
+	int count)
+{
+	const unsigned long long low = 0x7F7F7F7F7F7F7F7FULL;
+	unsigned long long lanes;
+	int index;
+
+	for (index = 0; index + 8 <= count; index += 8)
+	{
+		memcpy(&lanes, &bits[index], 8);
+		lanes |= (lanes & low) + low;
+		packed[index / 8] = _pext_u64(lanes, ~low);
+	}
+	packScalar(&bits[index], &packed[index / 8], count - index);
+}
+
+#endif
+#endif
+
+static const bits_kernel bitKernels[] =
+{
+	{ SEAMAX_BITS_SCALAR, unpackScalar, packScalar },
+#ifdef BITS_X86
+	{ SEAMAX_BITS_SSE2, unpackSSE2, packSSE2 },
+	{ SEAMAX_BITS_AVX2, unpackAVX2, packAVX2 },
+#ifdef __x86_64__
+	{ SEAMAX_BITS_BMI2, unpackBMI2, packBMI2 },
+#endif
+#endif
+};
+
+// The kernels in use, NULL until the first call picks them
+static const bits_kernel *bitKernel = NULL;
+
+//  --------------------------------------------------------------------------
+// ( Private function to tell whether this processor can run a kernel.        )
+//  --------------------------------------------------------------------------
+static int bitsSupported(seamax_bits_t which)
+{
+#ifdef BITS_X86
+	__builtin_cpu_init();
+	if (which == SEAMAX_BITS_SSE2) return __builtin_cpu_supports("sse2");
+	if (which == SEAMAX_BITS_AVX2) return __builtin_cpu_supports("avx2");
+	if (which == SEAMAX_BITS_BMI2) return __builtin_cpu_supports("bmi2");
+#endif
+	return which == SEAMAX_BITS_SCALAR;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function returning the kernels to use, picking them if need be.  )
+// Threads racing the first call all pick the same, so the race is harmless.
+//  --------------------------------------------------------------------------
+static const bits_kernel *bitsKernel(void)
+{
+	const bits_kernel *kernel = __atomic_load_n(&bitKernel, __ATOMIC_ACQUIRE);
+	int index;
+
+	if (kernel != NULL) return kernel;
+
+	//BMI2 is left to be asked for: pdep and pext are slow on older AMD parts
+	kernel = &bitKernels[0];
+	for (index = 0; index < sizeof(bitKernels) / sizeof(bitKernels[0]);
+		index++)
+	{
+		if (bitKernels[index].which != SEAMAX_BITS_BMI2 &&
+			bitsSupported(bitKernels[index].which))
+			kernel = &bitKernels[index];
+	}
+
+	__atomic_store_n(&bitKernel, kernel, __ATOMIC_RELEASE);
+	return kernel;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Choose how bits are packed and unpacked.
+/// By default the fastest kernel the processor has is picked: AVX2, else SSE2,
+/// else the portable one.  The BMI2 kernel (pdep and pext) is only used when
+/// asked for, as those instructions are slow on AMD processors before Zen 3.
+/// Applies to every module and thread from the next call on.
+///
+/// \param[in] kernel  The kernel wanted, or \a SEAMAX_BITS_AUTO.
+///
+/// \return int     The kernel now in use.
+/// \retval -EINVAL Unknown kernel.
+/// \retval -ENODEV This processor (or build) can't run it.
+// ----------------------------------------------------------------------------
+int SeaMaxLinSetBitKernel(seamax_bits_t kernel)
+{
+	int index;
+
+	if (kernel == SEAMAX_BITS_AUTO)
+	{
+		__atomic_store_n(&bitKernel, NULL, __ATOMIC_RELEASE);
+		return bitsKernel()->which;
+	}
+
+	if (kernel != SEAMAX_BITS_SCALAR && kernel != SEAMAX_BITS_SSE2 &&
+		kernel != SEAMAX_BITS_AVX2 && kernel != SEAMAX_BITS_BMI2)
+		return -EINVAL;
+
+	for (index = 0; index < sizeof(bitKernels) / sizeof(bitKernels[0]);
+		index++)
+	{
+		if (bitKernels[index].which != kernel) continue;
+		if (!bitsSupported(kernel)) break;
+
+		__atomic_store_n(&bitKernel, &bitKernels[index], __ATOMIC_RELEASE);
+		return kernel;
+	}
+
+	return -ENODEV;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Unpack coils or discrete inputs to one byte per channel.
+/// packed holds them as \a SeaMaxLinRead returns them: eight to a byte, the
+/// first in the least significant bit.  Each channel's byte is set to 1 if
+/// it is on and 0 if it is off.
+///
+/// \param[in] *packed   The packed bits, (count + 7) / 8 bytes.
+/// \param[out] *bits    One byte per channel, count bytes.
+/// \param[in] count     Number of channels.
+///
+/// \return int      Error code.
+/// \retval >=0      Number of channels unpacked.
+/// \retval -EINVAL  Null buffer or negative count.
+// ----------------------------------------------------------------------------
+int SeaMaxLinUnpackBits(const unsigned char *packed, unsigned char *bits,
+	int count)
+{
+	if (packed == NULL || bits == NULL || count < 0) return -EINVAL;
+
+	bitsKernel()->unpack(packed, bits, count);
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Pack one byte per channel into coils, as \a SeaMaxLinWrite takes.
+/// A channel is on if its byte isn't zero.  The unused bits of a partial last
+/// byte are cleared.
+///
+/// \param[in] *bits     One byte per channel, count bytes.
+/// \param[out] *packed  The packed bits, (count + 7) / 8 bytes.
+/// \param[in] count     Number of channels.
+///
+/// \return int      Error code.
+/// \retval >=0      Number of bytes packed.
+/// \retval -EINVAL  Null buffer or negative count.
+// ----------------------------------------------------------------------------
+int SeaMaxLinPackBits(const unsigned char *bits, unsigned char *packed,
+	int count)
+{
+	if (packed == NULL || bits == NULL || count < 0) return -EINVAL;
+
+	bitsKernel()->pack(bits, packed, count);
+	return (count + 7) / 8;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Read coils or discrete inputs, one byte per channel.
+/// As \a SeaMaxLinRead, but each channel comes back in a byte of its own, 1
+/// for on and 0 for off, unpacked by the kernel \a SeaMaxLinSetBitKernel
+/// chose.
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in] slaveId           Address of the device you wish to read.
+/// \param[in] type              COILS or D_INPUTS.
+/// \param[in] starting_address  Where to start the read; MODBUS is base 1.
+/// \param[in] range             How many channels to read, at most 1712:
+///                              the most an RTU response can carry.
+/// \param[out] *bits            One byte per channel, range bytes.
+///
+/// \return int      Error code.
+/// \retval >0       Number of channels read.
+/// \retval -EBADF   No module open or write error.
+/// \retval -EINVAL  Null buffer, bad type or range.
+/// \retval -ENOMEM  Low memory.
+/// \retval -ENODEV  Didn't receive response.
+/// \retval -EFAULT  MODBUS exception.  First byte of bits contains exception.
+// ----------------------------------------------------------------------------
+int SeaMaxLinReadBits(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
+	seaio_type_t type, address_loc_t starting_address,
+	address_range_t range, unsigned char *bits)
+{
+	unsigned char packed[(BITS_MAX_READ + 7) / 8];
+	int error = 0;
+
+	//Possible goof ups.
+	if (bits == NULL) return -EINVAL;
+	if (type != COILS && type != D_INPUTS) return -EINVAL;
+	if (range < 1 || range > BITS_MAX_READ) return -EINVAL;
+
+	error = SeaMaxLinRead(SeaMaxPointer, slaveId, type, starting_address,
+		range, packed);
+	if (error == -EFAULT) bits[0] = packed[0];
+	if (error < 0) return error;
+
+	//A short response leaves the channels past its end off
+	if (error < (range + 7) / 8)
+		memset(&packed[error], 0, (range + 7) / 8 - error);
+
+	bitsKernel()->unpack(packed, bits, range);
+	return range;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Write coils from one byte per channel.
+/// As \a SeaMaxLinWrite to COILS, but each channel is given in a byte of its
+/// own: on if it isn't zero.  They are packed by the kernel
+/// \a SeaMaxLinSetBitKernel chose.
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in] slaveId           Address of the device you wish to write.
+/// \param[in] starting_address  Where to start the write; MODBUS is base 1.
+/// \param[in] range             How many coils to write, at most 1968.
+/// \param[in] *bits             One byte per coil, range bytes.
+///
+/// \return int      Error code.
+/// \retval >0       Number of coils written.
+/// \retval -EBADF   No module open or write error.
+/// \retval -EINVAL  Null buffer or bad range.
+/// \retval -ENOMEM  Low memory.
+/// \retval -ENODEV  Didn't receive response.
+/// \retval -EFAULT  MODBUS exception.
+// ----------------------------------------------------------------------------
+int SeaMaxLinWriteBits(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
+	address_loc_t starting_address, address_range_t range,
+	const unsigned char *bits)
+{
+	unsigned char packed[(BITS_MAX_WRITE + 7) / 8];
+	int error = 0;
+
+	//Possible goof ups.
+	if (bits == NULL) return -EINVAL;
+	if (range < 1 || range > BITS_MAX_WRITE) return -EINVAL;
+
+	bitsKernel()->pack(bits, packed, range);
+	error = SeaMaxLinWrite(SeaMaxPointer, slaveId, COILS, starting_address,
+		range, packed);
+	if (error < 0) return error;
+
+	return range;
+}
@@ -0,0 +1,583 @@
+/*
+ * seamaxexecutor.c
+ * SeaMAX for Linux
+ *
+ * This code implements the multi-bus executor.  Every bus (a module opened on
+ * its own serial line or socket) gets a thread that does nothing but take
+ * requests off the bus's queue and run them, one at a time as the bus
+ * demands, so any number of buses are driven at once from a single caller.
+ *
+ * What the application does with a response is kept off the bus threads: a
+ * finished request that has a callback is handed to a pool of workers, each
+ * with its own deque.  A bus always hands its requests to the same worker;
+ * a worker that runs out of its own takes the newest of another's, so one
+ * slow callback holds up neither its bus nor the callbacks queued behind it.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <termios.h>
+#include <pthread.h>
+
+#include "seamaxlin.h"
+
+// Most buses one executor drives
+#define EXECUTOR_BUSES		256
+
+// Starting size of a worker's deque; it grows as needed
+#define EXECUTOR_DEQUE		64
+
+struct seamax_executor_s;
+
+// ----------------------------------------------------------------------------
+// A submitted request, queued on its bus and then, if it has a callback, on a
+// worker's deque.
+// ----------------------------------------------------------------------------
+typedef struct executor_task
+{
+	struct executor_task *next;
+	seamax_op_s *op;
+	seamax_done_t done;
+	void *context;
+} executor_task;
+
+// ----------------------------------------------------------------------------
+// One bus: its module, its thread and the requests waiting for it.  The
+// counters are only written by the bus thread.
+// ----------------------------------------------------------------------------
+typedef struct executor_bus
+{
+	struct seamax_executor_s *executor;
+	SeaMaxLin *module;
+	int worker;			//Deque the bus's callbacks go to.
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	executor_task *head, *tail;	//Waiting requests, oldest first.
+	unsigned int queued;
+	int stopping;
+
+	unsigned long long started;	//statsNow() when the bus was added.
+	unsigned long long completed;
+	unsigned long long failed;
+	unsigned long long busyNs;
+} executor_bus;
+
+// ----------------------------------------------------------------------------
+// One callback worker and its deque, a ring of finished requests.  The owner
+// takes from the front, other workers steal from the back.
+// ----------------------------------------------------------------------------
+typedef struct executor_worker
+{
+	struct seamax_executor_s *executor;
+	int index;
+	pthread_t thread;
+	int running;
+	pthread_mutex_t lock;
+	executor_task **tasks;
+	int capacity, first, count;
+} executor_worker;
+
+struct seamax_executor_s
+{
+	pthread_mutex_t lock;		//Adding buses and all sleeping below.
+	pthread_cond_t work;		//Idle workers wait here ...
+	pthread_cond_t idle;		//... and SeaMaxExecutorWait here.
+	executor_bus *buses[EXECUTOR_BUSES];
+	int busCount;
+	executor_worker *workers;
+	int workerCount;
+	int ready;			//Tasks on the deques; may dip below 0.
+	unsigned int sleepers;		//Workers waiting on work.
+	unsigned int pending;		//Submitted and not yet finished.
+	int stopping;
+};
+
+//  --------------------------------------------------------------------------
+// ( Private function to retire a task once its request and callback are done )
+//  --------------------------------------------------------------------------
+static void taskFinish(SeaMaxExecutor *executor, executor_task *task)
+{
+	free(task);
+
+	if (__atomic_sub_fetch(&executor->pending, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		pthread_mutex_lock(&executor->lock);
+		pthread_cond_broadcast(&executor->idle);
+		pthread_mutex_unlock(&executor->lock);
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to put a finished request on a worker's deque.          )
+//  --------------------------------------------------------------------------
+static int dequePush(executor_worker *worker, executor_task *task)
+{
+	SeaMaxExecutor *executor = worker->executor;
+	executor_task **tasks;
+	int index;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->count == worker->capacity)
+	{
+		tasks = malloc(2 * worker->capacity * sizeof(executor_task*));
+		if (tasks == NULL)
+		{
+			pthread_mutex_unlock(&worker->lock);
+			return -ENOMEM;
+		}
+
+		//Unwrap the ring into the start of the new one
+		for (index = 0; index < worker->count; index++)
+			tasks[index] = worker->tasks[(worker->first + index) %
+				worker->capacity];
+		free(worker->tasks);
+		worker->tasks = tasks;
+		worker->capacity *= 2;
+		worker->first = 0;
+	}
+
+	worker->tasks[(worker->first + worker->count) % worker->capacity] = task;
+	worker->count++;
+	pthread_mutex_unlock(&worker->lock);
+
+	//Wake a worker only if one is asleep; the counts are ordered so that a
+	//worker about to sleep either sees this task or is seen here
+	__atomic_add_fetch(&executor->ready, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&executor->sleepers, __ATOMIC_SEQ_CST) > 0)
+	{
+		pthread_mutex_lock(&executor->lock);
+		pthread_cond_signal(&executor->work);
+		pthread_mutex_unlock(&executor->lock);
+	}
+
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to take a task from a deque: the oldest for its owner,  )
+// ( the newest for a thief.                                                  )
+//  --------------------------------------------------------------------------
+static executor_task *dequeTake(executor_worker *worker, int steal)
+{
+	executor_task *task = NULL;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->count > 0)
+	{
+		worker->count--;
+		if (steal)
+			task = worker->tasks[(worker->first + worker->count) %
+				worker->capacity];
+		else
+		{
+			task = worker->tasks[worker->first];
+			worker->first = (worker->first + 1) % worker->capacity;
+		}
+	}
+	pthread_mutex_unlock(&worker->lock);
+
+	if (task != NULL)
+		__atomic_sub_fetch(&worker->executor->ready, 1, __ATOMIC_SEQ_CST);
+	return task;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function run by each callback worker.                            )
+//  --------------------------------------------------------------------------
+static void *workerLoop(void *arg)
+{
+	executor_worker *self = (executor_worker*)arg;
+	SeaMaxExecutor *executor = self->executor;
+	executor_task *task;
+	int index, stop;
+
+	for (;;)
+	{
+		//Own deque first, then the others in turn
+		task = dequeTake(self, 0);
+		for (index = 1; task == NULL && index < executor->workerCount; index++)
+			task = dequeTake(&executor->workers[(self->index + index) %
+				executor->workerCount], 1);
+
+		if (task != NULL)
+		{
+			task->done(task->op, task->context);
+			taskFinish(executor, task);
+			continue;
+		}
+
+		pthread_mutex_lock(&executor->lock);
+		__atomic_add_fetch(&executor->sleepers, 1, __ATOMIC_SEQ_CST);
+		while (__atomic_load_n(&executor->ready, __ATOMIC_SEQ_CST) <= 0 &&
+			!executor->stopping)
+			pthread_cond_wait(&executor->work, &executor->lock);
+		__atomic_sub_fetch(&executor->sleepers, 1, __ATOMIC_SEQ_CST);
+		stop = executor->stopping &&
+			__atomic_load_n(&executor->ready, __ATOMIC_SEQ_CST) <= 0;
+		pthread_mutex_unlock(&executor->lock);
+
+		if (stop) break;
+	}
+
+	return NULL;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function run by each bus thread.                                 )
+//  --------------------------------------------------------------------------
+static void *busLoop(void *arg)
+{
+	executor_bus *bus = (executor_bus*)arg;
+	SeaMaxExecutor *executor = bus->executor;
+	executor_task *task;
+	seamax_op_s *op;
+	unsigned long long start;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&bus->lock);
+		while (bus->head == NULL && !bus->stopping)
+			pthread_cond_wait(&bus->wake, &bus->lock);
+		if ((task = bus->head) == NULL)
+		{
+			pthread_mutex_unlock(&bus->lock);
+			break;
+		}
+		if ((bus->head = task->next) == NULL) bus->tail = NULL;
+		__atomic_sub_fetch(&bus->queued, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&bus->lock);
+
+		op = task->op;
+		start = statsNow();
+		if (op->write)
+			op->result = SeaMaxLinWrite(op->module, op->slaveId, op->type,
+				op->starting_address, op->range, op->data);
+		else
+			op->result = SeaMaxLinRead(op->module, op->slaveId, op->type,
+				op->starting_address, op->range, op->data);
+
+		__atomic_add_fetch(&bus->busyNs, statsNow() - start, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&bus->completed, 1, __ATOMIC_RELAXED);
+		if (op->result < 0)
+			__atomic_add_fetch(&bus->failed, 1, __ATOMIC_RELAXED);
+
+		//Callbacks go to the pool; without one (or room for one) it ends here
+		if (task->done == NULL ||
+			dequePush(&executor->workers[bus->worker], task) < 0)
+		{
+			if (task->done != NULL) task->done(op, task->context);
+			taskFinish(executor, task);
+		}
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Start an executor for driving many buses at once.
+/// Buses are added with \a SeaMaxExecutorAddBus and requests for any of them
+/// given to \a SeaMaxExecutorSubmit.  Each bus runs its requests in its own
+/// thread, in the order they were submitted; callbacks run on a separate
+/// pool of workers.
+///
+/// \param[in] workers   Callback threads; 0 or less for one per core.
+///
+/// \return SeaMaxExecutor*   The new executor, or NULL on failure.
+// ----------------------------------------------------------------------------
+SeaMaxExecutor *SeaMaxExecutorCreate(int workers)
+{
+	SeaMaxExecutor *executor;
+	executor_worker *worker;
+	int index;
+
+	if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0) workers = 1;
+
+	executor = calloc(1, sizeof(SeaMaxExecutor));
+	if (executor == NULL) return NULL;
+	executor->workers = calloc(workers, sizeof(executor_worker));
+	if (executor->workers == NULL)
+	{
+		free(executor);
+		return NULL;
+	}
+
+	pthread_mutex_init(&executor->lock, NULL);
+	pthread_cond_init(&executor->work, NULL);
+	pthread_cond_init(&executor->idle, NULL);
+
+	for (index = 0; index < workers; index++)
+	{
+		worker = &executor->workers[index];
+		worker->executor = executor;
+		worker->index = index;
+		worker->capacity = EXECUTOR_DEQUE;
+		pthread_mutex_init(&worker->lock, NULL);
+	}
+	executor->workerCount = workers;
+
+	for (index = 0; index < workers; index++)
+	{
+		worker = &executor->workers[index];
+		worker->tasks = malloc(EXECUTOR_DEQUE * sizeof(executor_task*));
+		if (worker->tasks == NULL ||
+			pthread_create(&worker->thread, NULL, workerLoop, worker) != 0)
+		{
+			SeaMaxExecutorDestroy(executor);
+			return NULL;
+		}
+		worker->running = 1;
+	}
+
+	return executor;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Give a bus to an executor.
+/// The module must already be open.  From here until the executor is
+/// destroyed its requests should only be made through
+/// \a SeaMaxExecutorSubmit, so that they do not wait on one another.
+///
+/// \param[in] *executor   An executor from \a SeaMaxExecutorCreate.
+/// \param[in] *module     Module open on the bus.
+///
+/// \return int      Error code.
+/// \retval >=0      Bus number, for \a SeaMaxExecutorBusStats.
+/// \retval -EINVAL  Null executor or module.
+/// \retval -EBUSY   The module is already a bus of this executor.
+/// \retval -ENOSPC  The executor has as many buses as it can take.
+/// \retval -ENOMEM  Low memory.
+/// \retval -EAGAIN  The bus thread could not be started.
+// ----------------------------------------------------------------------------
+int SeaMaxExecutorAddBus(SeaMaxExecutor *executor, SeaMaxLin *module)
+{
+	executor_bus *bus;
+	int index;
+
+	if (executor == NULL || module == NULL) return -EINVAL;
+
+	pthread_mutex_lock(&executor->lock);
+	for (index = 0; index < executor->busCount; index++)
+	{
+		if (executor->buses[index]->module == module)
+		{
+			pthread_mutex_unlock(&executor->lock);
+			return -EBUSY;
+		}
+	}
+	if (executor->busCount == EXECUTOR_BUSES)
+	{
+		pthread_mutex_unlock(&executor->lock);
+		return -ENOSPC;
+	}
+
+	if ((bus = calloc(1, sizeof(executor_bus))) == NULL)
+	{
+		pthread_mutex_unlock(&executor->lock);
+		return -ENOMEM;
+	}
+	bus->executor = executor;
+	bus->module = module;
+	bus->worker = executor->busCount % executor->workerCount;
+	bus->started = statsNow();
+	pthread_mutex_init(&bus->lock, NULL);
+	pthread_cond_init(&bus->wake, NULL);
+
+	if (pthread_create(&bus->thread, NULL, busLoop, bus) != 0)
+	{
+		pthread_mutex_unlock(&executor->lock);
+		free(bus);
+		return -EAGAIN;
+	}
+
+	//Submitters read the list without the lock, so publish the bus last
+	index = executor->busCount;
+	executor->buses[index] = bus;
+	__atomic_store_n(&executor->busCount, index + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&executor->lock);
+
+	return index;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Queue a read or write on one of an executor's buses.
+/// The request goes to the bus of op->module and runs after those already
+/// queued there.  Its result is set as in \a SeaMaxLinBatch, and then done
+/// is called, on a worker thread, with op and context.  Callbacks for
+/// different requests may run at the same time, even for one bus, and may
+/// submit further requests.  The op and its data must stay valid until then.
+///
+/// \param[in] *executor   An executor from \a SeaMaxExecutorCreate.
+/// \param[in,out] *op     The request.
+/// \param[in] done        Callback, or NULL for none.
+/// \param[in] *context    Passed to the callback.
+///
+/// \return int      Error code.
+/// \retval 0        Queued.
+/// \retval -EINVAL  Null argument, or op->module is not a bus.
+/// \retval -ENOMEM  Low memory.
+// ----------------------------------------------------------------------------
+int SeaMaxExecutorSubmit(SeaMaxExecutor *executor, seamax_op_s *op,
+	seamax_done_t done, void *context)
+{
+	executor_bus *bus = NULL;
+	executor_task *task;
+	int index, count;
+
+	if (executor == NULL || op == NULL) return -EINVAL;
+
+	count = __atomic_load_n(&executor->busCount, __ATOMIC_ACQUIRE);
+	for (index = 0; index < count && bus == NULL; index++)
+		if (executor->buses[index]->module == op->module)
+			bus = executor->buses[index];
+	if (bus == NULL) return -EINVAL;
+
+	if ((task = malloc(sizeof(executor_task))) == NULL) return -ENOMEM;
+	task->next = NULL;
+	task->op = op;
+	task->done = done;
+	task->context = context;
+
+	__atomic_add_fetch(&executor->pending, 1, __ATOMIC_ACQ_REL);
+
+	pthread_mutex_lock(&bus->lock);
+	if (bus->tail != NULL) bus->tail->next = task;
+	else bus->head = task;
+	bus->tail = task;
+	__atomic_add_fetch(&bus->queued, 1, __ATOMIC_RELAXED);
+	pthread_cond_signal(&bus->wake);
+	pthread_mutex_unlock(&bus->lock);
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Wait until every submitted request, and its callback, has finished.
+/// Requests submitted by callbacks are waited for too.  Must not be called
+/// from a callback.
+///
+/// \param[in] *executor   An executor from \a SeaMaxExecutorCreate.
+///
+/// \return int      Error code.
+/// \retval 0        Nothing left to do.
+/// \retval -EINVAL  Null executor.
+// ----------------------------------------------------------------------------
+int SeaMaxExecutorWait(SeaMaxExecutor *executor)
+{
+	if (executor == NULL) return -EINVAL;
+
+	pthread_mutex_lock(&executor->lock);
+	while (__atomic_load_n(&executor->pending, __ATOMIC_ACQUIRE) > 0)
+		pthread_cond_wait(&executor->idle, &executor->lock);
+	pthread_mutex_unlock(&executor->lock);
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Report how busy one of an executor's buses is.
+/// Utilisation is the share of the time since the bus was added that it
+/// spent in exchanges; a bus near 1.0 is the limit on its own throughput,
+/// while one well below it is waiting on the application for work.
+///
+/// \param[in] *executor   An executor from \a SeaMaxExecutorCreate.
+/// \param[in] bus         Bus number from \a SeaMaxExecutorAddBus.
+/// \param[out] *stats     Filled in with the bus's figures.
+///
+/// \return int      Error code.
+/// \retval 0        Success.
+/// \retval -EINVAL  Null argument or no such bus.
+// ----------------------------------------------------------------------------
+int SeaMaxExecutorBusStats(SeaMaxExecutor *executor, int bus,
+	seamax_bus_stats_s *stats)
+{
+	executor_bus *which;
+
+	if (executor == NULL || stats == NULL || bus < 0 ||
+		bus >= __atomic_load_n(&executor->busCount, __ATOMIC_ACQUIRE))
+		return -EINVAL;
+
+	which = executor->buses[bus];
+	stats->completed = __atomic_load_n(&which->completed, __ATOMIC_RELAXED);
+	stats->failed = __atomic_load_n(&which->failed, __ATOMIC_RELAXED);
+	stats->busy_ns = __atomic_load_n(&which->busyNs, __ATOMIC_RELAXED);
+	stats->elapsed_ns = statsNow() - which->started;
+	stats->queued = __atomic_load_n(&which->queued, __ATOMIC_RELAXED);
+	stats->utilisation = stats->elapsed_ns ?
+		(double)stats->busy_ns / stats->elapsed_ns : 0.0;
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Finish all submitted work, then stop and free an executor.
+/// The buses' modules are left open.  Must not be called from a callback.
+///
+/// \param[in] *executor   An executor from \a SeaMaxExecutorCreate.
+///
+/// \return int      Error code.
+/// \retval 0        Success.
+/// \retval -EINVAL  Null executor.
+// ----------------------------------------------------------------------------
+int SeaMaxExecutorDestroy(SeaMaxExecutor *executor)
+{
+	executor_bus *bus;
+	int index;
+
+	if (executor == NULL) return -EINVAL;
+	SeaMaxExecutorWait(executor);
+
+	for (index = 0; index < executor->busCount; index++)
+	{
+		bus = executor->buses[index];
+		pthread_mutex_lock(&bus->lock);
+		bus->stopping = 1;
+		pthread_cond_signal(&bus->wake);
+		pthread_mutex_unlock(&bus->lock);
+		pthread_join(bus->thread, NULL);
+		pthread_mutex_destroy(&bus->lock);
+		pthread_cond_destroy(&bus->wake);
+		free(bus);
+	}
+
+	pthread_mutex_lock(&executor->lock);
+	executor->stopping = 1;
+	pthread_cond_broadcast(&executor->work);
+	pthread_mutex_unlock(&executor->lock);
+
+	for (index = 0; index < executor->workerCount; index++)
+	{
+		if (executor->workers[index].running)
+			pthread_join(executor->workers[index].thread, NULL);
+		pthread_mutex_destroy(&executor->workers[index].lock);
+		free(executor->workers[index].tasks);
+	}
+
+	pthread_mutex_destroy(&executor->lock);
+	pthread_cond_destroy(&executor->work);
+	pthread_cond_destroy(&executor->idle);
+	free(executor->workers);
+	free(executor);
+	return 0;
+}
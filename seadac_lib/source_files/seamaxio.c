@@ -0,0 +1,773 @@
+/*
+ * seamaxio.c
+ * SeaMAX for Linux
+ *
+ * This code implements the I/O engines the serial (RTU) and socket (TCP)
+ * transports can hand their frames to instead of blocking system calls:
+ *
+ *  - io_uring: a request's write, the read of its response and a timeout
+ *    linked to that read are queued in the calling thread's ring without a
+ *    system call.  One io_uring_enter submits everything queued and waits,
+ *    and every completion that is ready is reaped, whichever module it is
+ *    for.  Frames go through buffers registered with the ring once, so the
+ *    kernel does not pin user pages for each transfer.
+ *  - epoll: frames are written at once, and the readiness of every module
+ *    the thread talks to comes back from one epoll set.
+ *
+ * Both pay off most in SeaMaxLinBatch, where many modules have a request
+ * outstanding at the same time.  io_uring is used when the kernel allows it
+ * and epoll otherwise.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "seamaxlin.h"
+#include "seamaxprobes.h"
+
+// Transactions one thread can have in flight, and the buffer of each way
+#define IO_SLOTS		256
+#define IO_SLOT_BYTES		256
+
+// Submission queue size; a transaction takes at most three entries
+#define IO_RING_ENTRIES		1024
+
+// RTU silence that ends a response, as the port's VTIME does
+#define IO_GAP_MS		100
+
+// epoll events taken per wait
+#define IO_EVENTS		64
+
+// What a completion is for, kept in the low bits of its user_data
+#define IO_WRITE		0
+#define IO_READ			1
+#define IO_TIMEOUT		2
+
+// ----------------------------------------------------------------------------
+// One transaction in a ring: its completions and the timeout of its read.
+// Its buffers are the slot's pair in the registered area.
+// ----------------------------------------------------------------------------
+typedef struct io_slot
+{
+	int busy;			//Owned by a transaction.
+	int pending;			//Completions still to come.
+	int readDone;			//The read has completed ...
+	int readResult;			//... with this result.
+	int writeDone;			//Likewise the write.
+	int writeResult;
+	struct __kernel_timespec timeout;
+} io_slot;
+
+// ----------------------------------------------------------------------------
+// A thread's io_uring, with its mapped queues and registered buffers.
+// ----------------------------------------------------------------------------
+typedef struct io_ring
+{
+	int fd;
+	unsigned int *sqHead, *sqTail, *sqMask, *sqArray, sqEntries;
+	unsigned int *cqHead, *cqTail, *cqMask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sqMap, *cqMap;
+	size_t sqMapSize, cqMapSize, sqesSize;
+	unsigned int staged;		//Entries queued but not submitted.
+	unsigned char *buffers;		//IO_SLOTS transmit and receive pairs.
+	io_slot slots[IO_SLOTS];
+	int freeSlots[IO_SLOTS];
+	int freeCount;
+} io_ring;
+
+// ----------------------------------------------------------------------------
+// What each thread keeps: its ring and its epoll set.
+// ----------------------------------------------------------------------------
+typedef struct io_thread
+{
+	io_ring *ring;			//NULL until made, or if it can't be.
+	int ringFailed;
+	int epollFd;			//-1 until needed.
+	unsigned long epollId;		//Tells this set from earlier ones.
+} io_thread;
+
+// ----------------------------------------------------------------------------
+// What each module keeps, as its transport link.
+// ----------------------------------------------------------------------------
+typedef struct io_link
+{
+	seamax_io_t backend;		//Engine chosen at open.
+	seamax_io_t via;		//Engine carrying the request in flight.
+	io_ring *ring;			//Ring and ...
+	int slot;			//... slot of that request, -1 for none.
+	unsigned long epollId;		//epoll set holding the descriptor ...
+	int epollFd;			//... and its descriptor, while epollId != 0.
+	int ready;			//Readable, as seen by an epoll wait.
+} io_link;
+
+// Engine for modules opened from now on
+static seamax_io_t ioBackend = SEAMAX_IO_DIRECT;
+
+static pthread_once_t ioOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t ioKey;
+static unsigned long ioEpollIds = 0;
+
+//  --------------------------------------------------------------------------
+// ( Private functions wrapping the io_uring system calls.                    )
+//  --------------------------------------------------------------------------
+static int ringSetup(unsigned int entries, struct io_uring_params *params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ringEnterCall(int fd, unsigned int submit, unsigned int complete,
+	unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, submit, complete, flags, NULL, 0);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to tear down a ring.                                    )
+//  --------------------------------------------------------------------------
+static void ringFree(io_ring *ring)
+{
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqesSize);
+	if (ring->cqMap != NULL && ring->cqMap != MAP_FAILED &&
+		ring->cqMap != ring->sqMap)
+		munmap(ring->cqMap, ring->cqMapSize);
+	if (ring->sqMap != NULL && ring->sqMap != MAP_FAILED)
+		munmap(ring->sqMap, ring->sqMapSize);
+	if (ring->fd >= 0) close(ring->fd);
+	free(ring->buffers);
+	free(ring);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to make a ring and register its buffers.                )
+// NULL is returned where io_uring is missing, disabled or out of memory.
+//  --------------------------------------------------------------------------
+static io_ring *ringCreate(void)
+{
+	struct io_uring_params params;
+	struct iovec area;
+	io_ring *ring;
+	unsigned char *sq, *cq;
+	int index;
+
+	ring = calloc(1, sizeof(io_ring));
+	if (ring == NULL) return NULL;
+
+	memset(&params, 0, sizeof(params));
+	ring->fd = ringSetup(IO_RING_ENTRIES, &params);
+	if (ring->fd < 0 || !(params.features & IORING_FEAT_NODROP))
+	{
+		ringFree(ring);
+		return NULL;
+	}
+
+	//Map the queues; newer kernels share one mapping between them
+	ring->sqMapSize = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned int);
+	ring->cqMapSize = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (ring->cqMapSize > ring->sqMapSize)
+			ring->sqMapSize = ring->cqMapSize;
+		ring->cqMapSize = ring->sqMapSize;
+	}
+
+	ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sqMap == MAP_FAILED)
+	{
+		ringFree(ring);
+		return NULL;
+	}
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) ring->cqMap = ring->sqMap;
+	else ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->cqMap == MAP_FAILED || ring->sqes == MAP_FAILED)
+	{
+		ringFree(ring);
+		return NULL;
+	}
+
+	sq = (unsigned char*)ring->sqMap;
+	cq = (unsigned char*)ring->cqMap;
+	ring->sqHead = (unsigned int*)(sq + params.sq_off.head);
+	ring->sqTail = (unsigned int*)(sq + params.sq_off.tail);
+	ring->sqMask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned int*)(sq + params.sq_off.array);
+	ring->sqEntries = params.sq_entries;
+	ring->cqHead = (unsigned int*)(cq + params.cq_off.head);
+	ring->cqTail = (unsigned int*)(cq + params.cq_off.tail);
+	ring->cqMask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	//One registered area holds every slot's transmit and receive buffers
+	if (posix_memalign((void**)&ring->buffers, 4096,
+		IO_SLOTS * 2 * IO_SLOT_BYTES) != 0)
+	{
+		ring->buffers = NULL;
+		ringFree(ring);
+		return NULL;
+	}
+	area.iov_base = ring->buffers;
+	area.iov_len = IO_SLOTS * 2 * IO_SLOT_BYTES;
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+		&area, 1) < 0)
+	{
+		ringFree(ring);
+		return NULL;
+	}
+
+	for (index = 0; index < IO_SLOTS; index++)
+		ring->freeSlots[index] = IO_SLOTS - 1 - index;
+	ring->freeCount = IO_SLOTS;
+	return ring;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to hand every completion to its slot.                   )
+//  --------------------------------------------------------------------------
+static void ringReap(io_ring *ring)
+{
+	unsigned int head = *ring->cqHead;
+	unsigned int tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+	struct io_uring_cqe *cqe;
+	io_slot *slot;
+
+	while (head != tail)
+	{
+		cqe = &ring->cqes[head & *ring->cqMask];
+		slot = &ring->slots[cqe->user_data >> 2];
+
+		switch (cqe->user_data & 3)
+		{
+		case IO_WRITE:
+			slot->writeResult = cqe->res;
+			slot->writeDone = 1;
+			break;
+		case IO_READ:
+			slot->readResult = cqe->res;
+			slot->readDone = 1;
+			break;
+		default:
+			break;
+		}
+
+		//A slot given up on goes back once its last completion is in
+		if (--slot->pending == 0 && !slot->busy)
+			ring->freeSlots[ring->freeCount++] = slot - ring->slots;
+		head++;
+	}
+
+	__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to submit what is queued, waiting for completions.      )
+//  --------------------------------------------------------------------------
+static int ringEnter(io_ring *ring, unsigned int complete)
+{
+	int submitted;
+
+	do
+	{
+		submitted = ringEnterCall(ring->fd, ring->staged, complete,
+			complete ? IORING_ENTER_GETEVENTS : 0);
+	} while (submitted < 0 && errno == EINTR);
+
+	if (submitted < 0 && errno != EBUSY && errno != EAGAIN) return -errno;
+	if (submitted > 0) ring->staged -= submitted;
+	ringReap(ring);
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to queue one submission entry.                          )
+//  --------------------------------------------------------------------------
+static void ringQueue(io_ring *ring, unsigned char opcode, int fd, void *addr,
+	unsigned int length, unsigned char flags, int slot, int kind)
+{
+	unsigned int tail = *ring->sqTail;
+	struct io_uring_sqe *sqe;
+
+	//A full queue is submitted first; it never is with IO_SLOTS in use
+	while (tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) >=
+		ring->sqEntries)
+	{
+		if (ringEnter(ring, 0) < 0) break;
+	}
+
+	sqe = &ring->sqes[tail & *ring->sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->flags = flags;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)addr;
+	sqe->len = length;
+	sqe->user_data = ((unsigned long long)slot << 2) | kind;
+
+	ring->sqArray[tail & *ring->sqMask] = tail & *ring->sqMask;
+	__atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+	ring->staged++;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to queue a read of a slot's receive buffer, ended by a  )
+// ( linked timeout.                                                          )
+//  --------------------------------------------------------------------------
+static void ringQueueRead(io_ring *ring, int fd, int index, int offset,
+	int length, int ms)
+{
+	io_slot *slot = &ring->slots[index];
+	unsigned char *buffer = ring->buffers + (index * 2 + 1) * IO_SLOT_BYTES;
+
+	slot->readDone = 0;
+	slot->pending += 2;
+	slot->timeout.tv_sec = ms / 1000;
+	slot->timeout.tv_nsec = (ms % 1000) * 1000000LL;
+
+	ringQueue(ring, IORING_OP_READ_FIXED, fd, buffer + offset, length,
+		IOSQE_IO_LINK, index, IO_READ);
+	ringQueue(ring, IORING_OP_LINK_TIMEOUT, -1, &slot->timeout, 1, 0,
+		index, IO_TIMEOUT);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to take a free slot, waiting for one if need be.        )
+//  --------------------------------------------------------------------------
+static int ringTake(io_ring *ring)
+{
+	int index;
+
+	while (ring->freeCount == 0)
+		if (ringEnter(ring, 1) < 0) return -1;
+
+	index = ring->freeSlots[--ring->freeCount];
+	memset(&ring->slots[index], 0, sizeof(io_slot));
+	ring->slots[index].busy = 1;
+	return index;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to give a slot up; it is reused once its completions    )
+// ( are all in.                                                              )
+//  --------------------------------------------------------------------------
+static void ringRelease(io_ring *ring, int index)
+{
+	ring->slots[index].busy = 0;
+	if (ring->slots[index].pending == 0)
+		ring->freeSlots[ring->freeCount++] = index;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function run as a thread exits, to free its ring and epoll set.  )
+// Reads still out end by their linked timeouts, so the wait is bounded.
+//  --------------------------------------------------------------------------
+static void ioThreadEnd(void *data)
+{
+	io_thread *thread = (io_thread*)data;
+	int index, pending;
+
+	if (thread->ring != NULL)
+	{
+		do
+		{
+			pending = 0;
+			for (index = 0; index < IO_SLOTS; index++)
+				pending += thread->ring->slots[index].pending;
+		} while (pending > 0 && ringEnter(thread->ring, 1) == 0);
+		ringFree(thread->ring);
+	}
+	if (thread->epollFd >= 0) close(thread->epollFd);
+	free(thread);
+}
+
+static void ioKeyCreate(void)
+{
+	pthread_key_create(&ioKey, ioThreadEnd);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function returning the calling thread's state.                   )
+//  --------------------------------------------------------------------------
+static io_thread *ioThread(void)
+{
+	io_thread *thread;
+
+	pthread_once(&ioOnce, ioKeyCreate);
+	thread = (io_thread*)pthread_getspecific(ioKey);
+	if (thread != NULL) return thread;
+
+	thread = calloc(1, sizeof(io_thread));
+	if (thread == NULL) return NULL;
+	thread->epollFd = -1;
+	pthread_setspecific(ioKey, thread);
+	return thread;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function returning the thread's ring, made on first use.         )
+//  --------------------------------------------------------------------------
+static io_ring *ioRing(io_thread *thread)
+{
+	if (thread->ring == NULL && !thread->ringFailed)
+	{
+		thread->ring = ringCreate();
+		thread->ringFailed = (thread->ring == NULL);
+	}
+	return thread->ring;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to wait on the thread's epoll set.                      )
+// Every module found readable is marked, not just the one waited for.
+//  --------------------------------------------------------------------------
+static int epollWait(io_thread *thread, int ms)
+{
+	struct epoll_event events[IO_EVENTS];
+	int count, index;
+
+	count = epoll_wait(thread->epollFd, events, IO_EVENTS, ms);
+	for (index = 0; index < count; index++)
+		((io_link*)events[index].data.ptr)->ready = 1;
+
+	return count;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to put a module's descriptor in the thread's epoll set. )
+// A module a thread took over from another is taken out of the old set
+// first, so that thread's waits no longer see it.  If the old thread has
+// gone, its set went with it and the removal just fails.
+//  --------------------------------------------------------------------------
+static int epollJoin(seaMaxModule *in, io_thread *thread)
+{
+	io_link *link = (io_link*)in->link;
+	struct epoll_event event;
+
+	if (thread->epollFd < 0)
+	{
+		thread->epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (thread->epollFd < 0) return -EBADF;
+		thread->epollId = __atomic_add_fetch(&ioEpollIds, 1, __ATOMIC_RELAXED);
+	}
+	if (link->epollId == thread->epollId) return 0;
+	if (link->epollId != 0)
+		epoll_ctl(link->epollFd, EPOLL_CTL_DEL, in->hDevice, NULL);
+
+	//Edge triggered, so modules with nothing asked of them stay quiet
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLET;
+	event.data.ptr = link;
+	if (epoll_ctl(thread->epollFd, EPOLL_CTL_ADD, in->hDevice, &event) < 0 &&
+		(errno != EEXIST ||
+		epoll_ctl(thread->epollFd, EPOLL_CTL_MOD, in->hDevice, &event) < 0))
+		return -EBADF;
+
+	link->epollId = thread->epollId;
+	link->epollFd = thread->epollFd;
+	link->ready = 1;
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to collect a response through epoll.                    )
+// Mirrors the blocking transports: TCP takes one receive once readable, RTU
+// reads until the frame is complete or the line goes quiet.
+//  --------------------------------------------------------------------------
+static int epollReceive(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	io_link *link = (io_link*)in->link;
+	io_thread *thread = ioThread();
+	unsigned long long now, until;
+	struct iovec rest[FRAME_PIECES];
+	struct msghdr message;
+	int incoming, wanted;
+
+	*length = 0;
+	if (thread == NULL || epollJoin(in, thread) < 0)
+		return (in->commMode == MODBUS_RTU) ? -EFAULT : -EBADF;
+
+	for (;;)
+	{
+		if (link->ready)
+		{
+			wanted = (in->commMode == MODBUS_TCP) ? 255 - *length :
+				expected + 4 - *length;
+			memset(&message, 0, sizeof(message));
+			message.msg_iov = rest;
+			message.msg_iovlen = frameSlice(frame, count, *length, wanted,
+				rest);
+
+			if (in->commMode == MODBUS_TCP)
+				incoming = recvmsg(in->hDevice, &message, MSG_DONTWAIT);
+			else
+				incoming = readv(in->hDevice, rest, message.msg_iovlen);
+
+			//The socket or port was drained; wait for the next edge
+			if (incoming < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				link->ready = 0;
+			else if (incoming <= 0)
+				return (in->commMode == MODBUS_RTU) ? -EFAULT : 0;
+			else
+			{
+				if (*length == 0)
+					SEAMAX_PROBE3(first_byte, in->traceId,
+						in->requestSlave, incoming);
+				*length += incoming;
+				if (in->commMode == MODBUS_TCP)
+				{
+					link->ready = 0;
+					return 0;
+				}
+
+				if (incoming < wanted) link->ready = 0;
+				usleep(1000 * in->throttle);
+				if (*length >= 220) return -ENOMEM;
+				if (*length >= expected + 4 ||
+					rtuException(frame, count, *length)) return 0;
+			}
+		}
+
+		//Wait for more, for as long as the link's own read would
+		now = statsNow();
+		if (now >= deadline)
+			return (in->commMode == MODBUS_RTU) ? -EFAULT : 0;
+		until = deadline;
+		if (in->commMode == MODBUS_RTU && now + IO_GAP_MS * 1000000ULL < until)
+			until = now + IO_GAP_MS * 1000000ULL;
+
+		if (epollWait(thread, (until - now + 999999) / 1000000) < 0 &&
+			errno != EINTR)
+			return (in->commMode == MODBUS_RTU) ? -EFAULT : -EBADF;
+
+		//A serial response that stops coming is over
+		if (!link->ready && in->commMode == MODBUS_RTU && statsNow() >= until)
+			return -EFAULT;
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to collect a response through the ring.                 )
+//  --------------------------------------------------------------------------
+static int ringReceive(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	io_link *link = (io_link*)in->link;
+	io_ring *ring = link->ring;
+	int index = link->slot, incoming, result = 0;
+	io_slot *slot = &ring->slots[index];
+	unsigned char *received = ring->buffers + (index * 2 + 1) * IO_SLOT_BYTES;
+
+	*length = 0;
+	for (;;)
+	{
+		//Wait out the write too, or it alone would end the wait
+		while (!slot->readDone && result == 0)
+			result = ringEnter(ring, slot->writeDone ? 1 : 2);
+		if (result < 0)
+		{
+			result = -EBADF;
+			break;
+		}
+
+		//A failed write leaves its read to time out
+		incoming = slot->readResult;
+		if (incoming <= 0 || slot->writeResult < 0)
+		{
+			result = (in->commMode == MODBUS_RTU) ? -EFAULT : 0;
+			break;
+		}
+
+		if (*length == 0)
+			SEAMAX_PROBE3(first_byte, in->traceId, in->requestSlave,
+				incoming);
+		if (incoming > 255 - *length) incoming = 255 - *length;
+		*length += incoming;
+		if (in->commMode == MODBUS_TCP) break;
+
+		//Serial frames may come in pieces; read on until complete
+		usleep(1000 * in->throttle);
+		if (*length >= 220)
+		{
+			result = -ENOMEM;
+			break;
+		}
+		//Done once whole, or once a whole exception
+		if (*length >= expected + 4) break;
+		if (*length >= 5 && (received[1] & 0x80)) break;
+		if (statsNow() > deadline)
+		{
+			result = -EFAULT;
+			break;
+		}
+
+		ringQueueRead(ring, in->hDevice, index, *length,
+			expected + 4 - *length, IO_GAP_MS);
+	}
+
+	//The read went to a registered buffer, queued before the pieces it
+	//belongs in were known; this is the one copy out of it
+	frameFill(frame, count, received, *length);
+	ringRelease(ring, index);
+	link->slot = -1;
+	return result;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to send a frame through the module's engine.            )
+// With io_uring the write, the read of the response and its timeout are only
+// queued; they go to the kernel together when the response is waited for, or
+// with the rest of a batch.  A failed write then shows up as no response.
+// An RTU broadcast is never waited for, so it is written at once instead.
+//  --------------------------------------------------------------------------
+int ioSend(seaMaxModule *in, struct iovec *frame, int count)
+{
+	io_link *link = (io_link*)in->link;
+	io_thread *thread = ioThread();
+	io_ring *ring = NULL;
+	unsigned char *buffer;
+	int index, length = frameLength(frame, count);
+
+	if (link->backend == SEAMAX_IO_URING && thread != NULL)
+		ring = ioRing(thread);
+
+	//No ring in this thread, or none to be had: epoll it is
+	link->via = SEAMAX_IO_EPOLL;
+	if (ring != NULL && link->slot >= 0 && link->ring == ring)
+		ringRelease(ring, link->slot);
+	link->slot = -1;
+	if (ring == NULL || length > IO_SLOT_BYTES ||
+		(in->commMode == MODBUS_RTU && in->requestSlave == 0) ||
+		(index = ringTake(ring)) < 0)
+		return writev(in->hDevice, frame, count);
+
+	buffer = ring->buffers + index * 2 * IO_SLOT_BYTES;
+	frameCopy(frame, count, buffer, length);
+	ring->slots[index].pending = 1;
+	ringQueue(ring, IORING_OP_WRITE_FIXED, in->hDevice, buffer, length, 0,
+		index, IO_WRITE);
+
+	//TCP gets the whole response window, RTU the gap a port would allow
+	ringQueueRead(ring, in->hDevice, index, 0, IO_SLOT_BYTES - 1,
+		(in->commMode == MODBUS_TCP) ? MODBUS_RESPONSE_TIMEOUT_MS : IO_GAP_MS);
+
+	link->via = SEAMAX_IO_URING;
+	link->ring = ring;
+	link->slot = index;
+	return length;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to receive a response through the module's engine.      )
+//  --------------------------------------------------------------------------
+int ioReceive(seaMaxModule *in, struct iovec *frame, int count, int *length,
+	int expected, unsigned long long deadline)
+{
+	io_link *link = (io_link*)in->link;
+
+	if (link->via == SEAMAX_IO_URING && link->slot >= 0)
+		return ringReceive(in, frame, count, length, expected, deadline);
+	return epollReceive(in, frame, count, length, expected, deadline);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to give an opened module the engine chosen, if any.     )
+//  --------------------------------------------------------------------------
+int ioAttach(seaMaxModule *in)
+{
+	io_link *link;
+
+	if (ioBackend == SEAMAX_IO_DIRECT) return 0;
+
+	link = calloc(1, sizeof(io_link));
+	if (link == NULL) return -ENOMEM;
+	link->backend = ioBackend;
+	link->slot = -1;
+	in->link = link;
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to free a module's engine state as it closes.           )
+// The descriptor's close takes it out of any epoll set.
+//  --------------------------------------------------------------------------
+void ioDetach(seaMaxModule *in)
+{
+	io_link *link = (io_link*)in->link;
+	io_thread *thread;
+
+	//A request left half done can only be given up by the ring's thread
+	if (link == NULL) return;
+	if (link->slot >= 0 && (thread = ioThread()) != NULL &&
+		thread->ring == link->ring)
+		ringRelease(link->ring, link->slot);
+	free(link);
+	in->link = NULL;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Choose how Modbus RTU and TCP modules do their I/O.
+/// Applies to modules opened after the call; ones already open keep theirs.
+/// \a SEAMAX_IO_DIRECT, the default, makes blocking calls for each request.
+/// \a SEAMAX_IO_URING queues each request's write, response read and timeout
+/// in a per-thread io_uring and submits them with a single system call; in
+/// \a SeaMaxLinBatch one call carries a whole round of requests and reaps all
+/// their completions.  Where io_uring is missing or not permitted,
+/// \a SEAMAX_IO_EPOLL is used instead: writes go out at once and one epoll
+/// set per thread reports which modules have answered.
+///
+/// \param[in] backend  The engine wanted.
+///
+/// \return int     The engine now in use.
+/// \retval -EINVAL Unknown engine.
+// ----------------------------------------------------------------------------
+int SeaMaxLinSetIoBackend(seamax_io_t backend)
+{
+	io_thread *thread;
+
+	if (backend != SEAMAX_IO_DIRECT && backend != SEAMAX_IO_EPOLL &&
+		backend != SEAMAX_IO_URING) return -EINVAL;
+
+	//Check io_uring works here by making this thread's ring
+	if (backend == SEAMAX_IO_URING)
+	{
+		thread = ioThread();
+		if (thread == NULL || ioRing(thread) == NULL)
+			backend = SEAMAX_IO_EPOLL;
+	}
+
+	ioBackend = backend;
+	return backend;
+}
@@ -24,25 +24,35 @@
 #include <string.h>
 #include <errno.h>
 #include <termios.h>
-#include <fcntl.h>
-#include <netdb.h>
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "seamaxlin.h"
+#include "seamaxprobes.h"
 
 // privately used tcp transaction number... unused in RTU type communications.
 static int tcp_transaction = 0;
 
+// Modbus function codes of the read and write types, 0x00 for none
+static const unsigned char readFunct[6] = { 0x01, 0x02, 0x03, 0x04, 0x45, 0x41 };
+static const unsigned char writeFunct[6] = { 0x0F, 0x00, 0x06, 0x00, 0x00, 0x42 };
+
+// Exception code of a slave that doesn't know the function asked of it
+#define ILLEGAL_FUNCTION	0x01
+
+// Links a device string can name, by the prefix it starts with
+static const seamax_transport_s *transports[] =
+{
+	&rtuTransport, &tcpTransport, &d2xTransport, &loopTransport
+};
+
 //  --------------------------------------------------------------------------
-// ( Private function to calculate and tack on the crc.                       )
+// ( Private function to run n more bytes through a crc.                      )
 //  --------------------------------------------------------------------------
-void calc_crc(int n, unsigned char *data)
+static unsigned short crcUpdate(unsigned short crc, const unsigned char *data,
+	int n)
 {
 	int i, j;
 	unsigned char carry_flag;
-	unsigned short crc = 0xFFFF;
 
 	for (i = 0; i < n; i++)
 	{
@@ -57,121 +67,133 @@ void calc_crc(int n, unsigned char *data)
 		}
 	}
 
+	return crc;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to calculate and tack on the crc.                       )
+//  --------------------------------------------------------------------------
+void calc_crc(int n, unsigned char *data)
+{
+	unsigned short crc = crcUpdate(0xFFFF, data, n);
 
 	data[n++] = crc & 0xFF;
 	data[n] = (crc >> 8) & 0xFF;
-
 }
 
 //  --------------------------------------------------------------------------
-// ( Private function to open a SeaIO device using serial                     )
+// ( Private function returning the length of a frame held in pieces.         )
 //  --------------------------------------------------------------------------
-int openRTU(SeaMaxLin *SeaMaxPointer, char *devName)
+int frameLength(const struct iovec *frame, int count)
 {
-	struct termios newtio;
-	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
-
-	//Quick test to make sure nothing is already opened
-	if (in->hDevice > 0) return -EBUSY;
-
-	//Open device for reading and writing, and not control tty.  (CTRL-C)
-	in->hDevice = open(devName, O_RDWR | O_NOCTTY);
-	if (in->hDevice < 0) return -EBADF;
-
-	//Save the current serial line configuration.
-	in->initalConfig = (struct termios*) malloc(sizeof(struct termios));
-	if (in->initalConfig == NULL) return -ENOMEM;
-	if (tcgetattr(in->hDevice, in->initalConfig) < 0) return -EPERM;
-	bzero(&newtio, sizeof(newtio));
+	int index, length = 0;
 
-	//9600 Baud, 8 data bits, local use, and readable
-	newtio.c_cflag = B9600 | CS8 | CLOCAL | CREAD;
-
-	//IGNPAR  : ignore bytes with parity errors
-	newtio.c_iflag = IGNPAR;
+	for (index = 0; index < count; index++) length += frame[index].iov_len;
+	return length;
+}
 
-	//Raw output.
-	newtio.c_oflag = 0;
+//  --------------------------------------------------------------------------
+// ( Private function to gather up to size bytes of a frame into buffer.      )
+// Returns the bytes copied.
+//  --------------------------------------------------------------------------
+int frameCopy(const struct iovec *frame, int count, unsigned char *buffer,
+	int size)
+{
+	int index, piece, copied = 0;
 
-	//ICANON  : enable canonical input
-	newtio.c_lflag = 0;
+	for (index = 0; index < count && copied < size; index++)
+	{
+		piece = frame[index].iov_len;
+		if (piece > size - copied) piece = size - copied;
+		memcpy(&buffer[copied], frame[index].iov_base, piece);
+		copied += piece;
+	}
 
-	//1/10 second timeout VERY IMPORTANT
-	newtio.c_cc[VTIME] = 1;
-	newtio.c_cc[VMIN] = 0;
+	return copied;
+}
 
-	//clean line and activate settings 
-	tcflush(in->hDevice, TCIFLUSH);
-	if (tcsetattr(in->hDevice, TCSANOW, &newtio) < 0) return -EXDEV;
+//  --------------------------------------------------------------------------
+// ( Private function to scatter length bytes of buffer over a frame's pieces )
+// Returns the bytes placed, fewer if the pieces run out.
+//  --------------------------------------------------------------------------
+int frameFill(const struct iovec *frame, int count,
+	const unsigned char *buffer, int length)
+{
+	int index, piece, placed = 0;
 
-	//if we got this far without any errors, it's ok to update local data
-	in->commMode = MODBUS_RTU;
+	for (index = 0; index < count && placed < length; index++)
+	{
+		piece = frame[index].iov_len;
+		if (piece > length - placed) piece = length - placed;
+		memcpy(frame[index].iov_base, &buffer[placed], piece);
+		placed += piece;
+	}
 
-	return 0;
+	return placed;
 }
 
 //  --------------------------------------------------------------------------
-// ( Private function to open a SeaIO device using sockets                    )
+// ( Private function to describe size bytes of a frame from offset onwards.  )
+// slice needs room for as many pieces as frame; returns how many it holds.
 //  --------------------------------------------------------------------------
-int openTCP(SeaMaxLin *SeaMaxPointer, char *devName)
+int frameSlice(const struct iovec *frame, int count, int offset, int size,
+	struct iovec *slice)
 {
-	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
-	char *passed;
-	char port[6] = "502";
-	struct hostent *host;
-	struct sockaddr_in sockinfo;
-
-	//Quick test to make sure nothing is already opened
-	if (in->hDevice > 0) return -EBUSY;
+	int index, pieces = 0;
 
-	//Open socket.
-	in->hDevice = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (in->hDevice < 0) return -EBUSY;
-
-	//Get the port number if one was supplied, otherwise default to 502
-	if ((passed = strpbrk(devName, ":")) != NULL)
+	for (index = 0; index < count && size > 0; index++)
 	{
-		passed[0] = 0;                //clear the ':'
-		memcpy(port, &passed[1], 5);  //update the port variable
-	}
-
-	//Get host address from the name or address provided
-	if ((host = gethostbyname(devName)) == NULL) return -EBADF;
+		if (offset >= (int)frame[index].iov_len)
+		{
+			offset -= frame[index].iov_len;
+			continue;
+		}
 
-	//Prepare and make connection.
-	memset(&sockinfo, 0, sizeof(sockinfo));
-	sockinfo.sin_family = AF_INET;
-	sockinfo.sin_addr.s_addr = *(long*)host->h_addr_list[0];
-	sockinfo.sin_port = htons(atoi(port));
+		slice[pieces].iov_base = (unsigned char*)frame[index].iov_base + offset;
+		slice[pieces].iov_len = frame[index].iov_len - offset;
+		if ((int)slice[pieces].iov_len > size) slice[pieces].iov_len = size;
+		size -= slice[pieces].iov_len;
+		offset = 0;
+		pieces++;
+	}
 
-	if (connect(in->hDevice, (struct sockaddr*) &sockinfo,
-		sizeof(sockinfo)) < 0) return -1;
+	return pieces;
+}
 
-	//If we get here, it's ok to update local data.
-	in->commMode = MODBUS_TCP;
+//  --------------------------------------------------------------------------
+// ( Private function telling whether the first length bytes of an RTU        )
+// ( response are a whole exception: slave, function | 0x80, code and CRC.    )
+//  --------------------------------------------------------------------------
+int rtuException(const struct iovec *frame, int count, int length)
+{
+	struct iovec funct[FRAME_PIECES];
 
-	return 0;
+	if (length < 5 || frameSlice(frame, count, 1, 1, funct) < 1) return 0;
+	return (*(unsigned char*)funct[0].iov_base & 0x80) != 0;
 }
 
 //  --------------------------------------------------------------------------
-// ( Private function to format a valid modbus request and send it.           )
+// ( Private function to format a valid modbus request as pieces of a frame.  )
+// The fixed fields (the MBAP header for TCP, slave address onwards, and the
+// CRC for RTU) are built in buff, which must hold FRAME_FIXED bytes, while the
+// data to be written stays where it is in the caller's buffer.  frame is set
+// to the pieces in wire order, at most FRAME_PIECES of them, and count to how
+// many.  writeStart and writeQuan are only used by 0x17, which reads start and
+// quan.  Nothing is sent.  Returns the frame length or -EINVAL.
 //  --------------------------------------------------------------------------
-int makeRequest(seaMaxModule* in, slave_address_t slaveId, unsigned char funct,
-	address_loc_t start, address_range_t quan, unsigned char *data)
+int encodeFrame(seaio_mode_t mode, int transaction, slave_address_t slaveId,
+	unsigned char funct, address_loc_t start, address_range_t quan,
+	address_loc_t writeStart, address_range_t writeQuan,
+	unsigned char *data, unsigned char *buff, struct iovec *frame, int *count)
 {
 	int i = 0, dataSize = 0, length = 0;
-	unsigned char buff[256];
-
-	//Make sure the channel isn't in use, when it isn't, lock it
-	while (in->mutex) usleep(1000 * in->throttle);
-	in->mutex = 1;
+	unsigned short crc;
 
 	//Prepare the packet header.
-	if (in->commMode == MODBUS_TCP)
+	if (mode == MODBUS_TCP)
 	{
-		int temp = tcp_transaction++;
-		buff[0] = temp >> 8;      //upper byte of tcp transaction id
-		buff[1] = temp & 0x00FF;  //lower byte of tcp transaction id
+		buff[0] = transaction >> 8;      //upper byte of tcp transaction id
+		buff[1] = transaction & 0x00FF;  //lower byte of tcp transaction id
 		buff[2] = 0;
 		buff[3] = 0;
 		i = 6;        //hold a place for the message length
@@ -213,108 +235,174 @@ int makeRequest(seaMaxModule* in, slave_address_t slaveId, unsigned char funct,
 		length++;
 	}
 
+	//0x17 follows the registers to read with those to write, and a count
+	if (funct == 0x17)
+	{
+		buff[i + 6] = writeStart >> 8;
+		buff[i + 7] = writeStart & 0x00FF;
+		buff[i + 8] = writeQuan >> 8;
+		buff[i + 9] = writeQuan & 0x00FF;
+		buff[i + 10] = writeQuan * 2;
+		length += 5;
+	}
+
 	//Now the writes need the data tact'd on the ends.
 	if (funct == 0x06 || funct == 0x44) dataSize = 2;
 	if ((funct == 0x0F) || (funct == 0x10)) dataSize = buff[i + 6];
+	if (funct == 0x17) dataSize = buff[i + 10];
 	if (funct == 0x42) dataSize = 12;
 	if (funct == 0x46 || funct == 0x47) dataSize = 3;
 	if (funct == 0x64) dataSize = 5;
 
-	for (i = 0; i < dataSize; i++)
+	if (dataSize > 0 && length + dataSize >= 255)
 	{
-		buff[length] = data[i];
-		length++;
-		if (length == 255)
-		{
-			in->mutex = 0;
-			//fprintf(stderr, "-EINVAL\n");
-			return -EINVAL;
-		}
+		//fprintf(stderr, "-EINVAL\n");
+		return -EINVAL;
 	}
 
-	//send the command to the module.
-	if (in->commMode == MODBUS_RTU)
+	//The data goes out from the caller's buffer, between header and crc.
+	frame[0].iov_base = buff;
+	frame[0].iov_len = length;
+	*count = 1;
+	if (dataSize > 0)
 	{
-		//add on the crc
-		calc_crc(length, buff);
-		length += 2;
+		frame[1].iov_base = data;
+		frame[1].iov_len = dataSize;
+		*count = 2;
+	}
 
-		//write the command to the opened serial port
-		if (write(in->hDevice, buff, length) != length)
-		{
-			in->mutex = 0;  //unlock
-			//fprintf(stderr, "-EBADF\n");
-			return -EBADF;  //quit
-		}
+	//finish the frame for the medium it will travel on.
+	if (mode == MODBUS_RTU)
+	{
+		//add on the crc, after the header in buff
+		crc = crcUpdate(0xFFFF, buff, length);
+		crc = crcUpdate(crc, data, dataSize);
+		buff[length] = crc & 0xFF;
+		buff[length + 1] = (crc >> 8) & 0xFF;
+		frame[*count].iov_base = &buff[length];
+		frame[*count].iov_len = 2;
+		(*count)++;
+		length += dataSize + 2;
 	}
 	else
 	{
 		//insert my length
+		length += dataSize;
 		buff[4] = (length - 6) >> 8;      //header Hi byte
 		buff[5] = (length - 6) & 0x00FF;  //header Lo byte
-
-		//write the packet to the opened socket
-		if (send(in->hDevice, buff, length, 0) != length)
-		{
-			in->mutex = 0;  //unlock
-			//fprintf(stderr, "-EBADF\n");
-			return -EBADF;  //quit
-		}
 	}
 
-	in->mutex = 0;
 	return length;
 }
 
 //  --------------------------------------------------------------------------
-// ( Private function to recieve a response and place it in a buffer          )
+// ( Private function to format a valid modbus request into a frame buffer.   )
+// The frame is built exactly as it will appear on the wire, including the CRC
+// for RTU or the MBAP header for TCP, but nothing is sent.  The frame buffer
+// must hold at least 256 bytes.  Returns the frame length or -EINVAL.
 //  --------------------------------------------------------------------------
-int getResponse(seaMaxModule* in, unsigned char funct, unsigned char *data,
-	int expected)
+int encodeRequest(seaio_mode_t mode, int transaction, slave_address_t slaveId,
+	unsigned char funct, address_loc_t start, address_range_t quan,
+	unsigned char *data, unsigned char *buff)
 {
-	int i = 0, j = 0, length = 0;
-	unsigned char buffer[256];
+	unsigned char header[FRAME_FIXED];
+	struct iovec frame[FRAME_PIECES];
+	int length, count;
 
-	// Parameter check
-	if (expected > sizeof(buffer))
+	length = encodeFrame(mode, transaction, slaveId, funct, start, quan, 0, 0,
+		data, header, frame, &count);
+	if (length < 0) return length;
+
+	frameCopy(frame, count, buff, length);
+	return length;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to format a valid modbus request and send it.           )
+// writeStart and writeQuan are only used by 0x17, see encodeFrame.
+//  --------------------------------------------------------------------------
+int makeRequest(seaMaxModule* in, slave_address_t slaveId, unsigned char funct,
+	address_loc_t start, address_range_t quan, address_loc_t writeStart,
+	address_range_t writeQuan, unsigned char *data)
+{
+	int length = 0, count = 0;
+	unsigned char buff[FRAME_FIXED];
+	struct iovec frame[FRAME_PIECES];
+	unsigned long long now;
+
+	SEAMAX_PROBE3(request_submit, in->traceId, slaveId, funct);
+
+	//SeaDAC Lite modules don't speak Modbus
+	if (in->commMode != MODBUS_RTU && in->commMode != MODBUS_TCP)
+		return -EBADF;
+
+	//Make sure the channel isn't in use, when it isn't, lock it
+	SEAMAX_PROBE1(lock_wait_begin, in->traceId);
+	__atomic_fetch_add(&in->waiters, 1, __ATOMIC_RELAXED);
+	while (in->mutex) usleep(1000 * in->throttle);
+	in->mutex = 1;
+	__atomic_fetch_sub(&in->waiters, 1, __ATOMIC_RELAXED);
+	SEAMAX_PROBE1(lock_wait_end, in->traceId);
+
+	//Give the slaves the rest of their time to act on a broadcast
+	now = statsNow();
+	if (now < in->quietUntil) usleep((in->quietUntil - now) / 1000);
+	statsBegin(in, slaveId);
+
+	//Build the frame; only TCP consumes a transaction number.
+	length = encodeFrame(in->commMode,
+		(in->commMode == MODBUS_TCP) ? tcp_transaction++ : 0,
+		slaveId, funct, start, quan, writeStart, writeQuan, data, buff,
+		frame, &count);
+	if (length < 0)
 	{
-		//fprintf(stderr, "-ENOMEM\n");
-		return -ENOMEM;
+		in->mutex = 0;
+		return length;
 	}
 
-	//Read back a response into a local buffer.
-	if (in->commMode == MODBUS_RTU)
+	//send the command to the module.
+	if (in->transport->send(in, frame, count) != length)
 	{
-		while (length < expected + 4)
-		{
-			int incoming = read(in->hDevice,
-				&buffer[length],
-				expected + 4 - length);
-
-			if (incoming <= 0)
-			{
-				in->mutex = 0;
-				//fprintf(stderr, "-EFAULT1\n");
-				return -EFAULT;
-			}
-
-			usleep(1000 * in->throttle);
-			length += incoming;
-			if (length >= 220)
-			{
-				in->mutex = 0;  //unlock
-			//fprintf(stderr, "-ENOMEM\n");
-				return -ENOMEM; //quit
-			}
-		}
+		traceFrames(in, SEAMAX_TRACE_TX, frame, count, length, -EBADF);
+		statsFailed(in, -EBADF);
+		in->mutex = 0;  //unlock
+		//fprintf(stderr, "-EBADF\n");
+		return -EBADF;  //quit
+	}
 
-		if (length < 1)
-		{
-			in->mutex = 0;
-			//fprintf(stderr, "-ENODEV\n");
-			return -ENODEV;
-		}
+	SEAMAX_PROBE3(wire_write, in->traceId, slaveId, length);
+	traceFrames(in, SEAMAX_TRACE_TX, frame, count, length, 0);
+	statsSent(in, length);
+
+	//An RTU broadcast is never answered; the bus stays quiet instead, from
+	//when the frame has left the port
+	if (slaveId == 0 && in->commMode == MODBUS_RTU)
+	{
+		if (in->hDevice >= 0) tcdrain(in->hDevice);
+		in->quietUntil = statsNow() + in->turnaround * 1000000ULL;
+	}
+	in->mutex = 0;
+	return length;
+}
 
+//  --------------------------------------------------------------------------
+// ( Private function to parse a received frame into the user's buffer.       )
+// The buffer holds the raw bytes read from the wire (length of them), with the
+// RTU CRC or TCP MBAP header still attached.  No descriptor is touched.
+//  --------------------------------------------------------------------------
+int decodeResponse(seaio_mode_t mode, unsigned char funct,
+	unsigned char *buffer, int length, unsigned char *data)
+{
+	int i = 0, j = 0;
+
+	if (length < 1)
+	{
+		//fprintf(stderr, "-ENODEV\n");
+		return -ENODEV;
+	}
+
+	if (mode == MODBUS_RTU)
+	{
 		i = 1;  //jump over slaveid.
 		length -= 1;
 
@@ -323,14 +411,6 @@ int getResponse(seaMaxModule* in, unsigned char funct, unsigned char *data,
 	}
 	else
 	{
-		//read response, unlock channel, and check for error
-		length = recv(in->hDevice, buffer, 255, 0);
-		if (length < 1)
-		{
-			//fprintf(stderr, "-ENODEV\n");
-			return -ENODEV;
-		}
-
 		i = 7;  //jump over the header.  And slaveid.
 		length -= 7;
 	}
@@ -339,7 +419,6 @@ int getResponse(seaMaxModule* in, unsigned char funct, unsigned char *data,
 	if (buffer[i] != funct)
 	{
 		data[0] = buffer[i + 1];  //return the exception code to user
-		in->mutex = 0;          //unlock channel
 		//fprintf(stderr, "-EFAULT2 %d %d\n", funct, buffer[i]);
 		return -EFAULT;
 	}
@@ -347,12 +426,11 @@ int getResponse(seaMaxModule* in, unsigned char funct, unsigned char *data,
 	//Writes don't get data back, they provide it...
 	if (funct == 0x06 || funct == 0x10 || funct == 0x0F || funct == 0x42 || funct == 0x64)
 	{
-		in->mutex = 0;  //unlock the channel
 		return 0;       //return the oky doky signal
 	}
 
 	//This will be a little different for some funct codes, so pay attention
-	if (funct < 0x05)  //all come back with a byte count
+	if (funct < 0x05 || funct == 0x17)  //all come back with a byte count
 	{
 		i += 2;
 		length -= 2;
@@ -375,10 +453,218 @@ int getResponse(seaMaxModule* in, unsigned char funct, unsigned char *data,
 		i++;
 	}
 
-	in->mutex = 0;  //unlock the channel
 	return length;  //Return the number of bytes in the buffer
 }
 
+//  --------------------------------------------------------------------------
+// ( Private function to recieve a response and place it in a buffer          )
+// If exception isn't NULL it is set to the exception code of an exception
+// response, or 0 for anything else (timeouts included).
+//  --------------------------------------------------------------------------
+int getResponse(seaMaxModule* in, unsigned char funct, unsigned char *data,
+	int expected, unsigned char *exception)
+{
+	int length = 0, result = 0;
+	unsigned char buffer[256];
+	struct iovec frame[1];
+
+	if (exception != NULL) *exception = 0;
+
+	// Parameter check
+	if (expected > sizeof(buffer))
+	{
+		//fprintf(stderr, "-ENOMEM\n");
+		return -ENOMEM;
+	}
+
+	//The response is read into a local frame, and only a decoded success
+	//reaches the user's buffer: a short frame, or an exception and its CRC,
+	//must not land on top of the caller's data.
+	frame[0].iov_base = buffer;
+	frame[0].iov_len = sizeof(buffer);
+
+	result = in->transport->receive(in, frame, 1, &length, expected,
+		statsNow() + MODBUS_RESPONSE_TIMEOUT_MS * 1000000ULL);
+	if (result < 0)
+	{
+		SEAMAX_PROBE4(response_complete, in->traceId,
+			in->requestSlave, funct, result);
+		traceFrames(in, SEAMAX_TRACE_RX, frame, 1, length, result);
+		statsFailed(in, result);
+		in->mutex = 0;  //unlock
+		return result;  //quit
+	}
+
+	result = decodeResponse(in->commMode, funct, buffer, length, data);
+	if (result == -EFAULT && exception != NULL) *exception = data[0];
+	SEAMAX_PROBE4(response_complete, in->traceId, in->requestSlave, funct,
+		result);
+	traceFrames(in, SEAMAX_TRACE_RX, frame, 1, length,
+		(result < 0) ? result : 0);
+
+	//An exception is still a response; only no data at all is a timeout.
+	if (result == -ENODEV) statsFailed(in, result);
+	else statsReceived(in, length, result == -EFAULT);
+
+	in->mutex = 0;  //unlock the channel
+	return result;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to send the request of a read or write.                 )
+// The function code used is left in funct for finishRequest.
+//  --------------------------------------------------------------------------
+static int startRequest(seaMaxModule *in, slave_address_t slaveId, int write,
+	seaio_type_t type, address_loc_t starting_address,
+	address_range_t range, unsigned char *data, unsigned char *funct)
+{
+	//Possible goof ups.
+	if (write && writeFunct[type - 1] == 0x00)  return -EINVAL;
+	if (in == NULL)  return -EBADF;
+	if (data == NULL) 	    return -EINVAL;
+	if (in->commMode == NO_CONNECT)   return -EBADF;
+
+	//Modbus wants the starting address based at 0, not 1
+	starting_address--;
+
+	//Format a valid request and send it to the module.
+	if (!write)
+	{
+		*funct = readFunct[type - 1];
+		return makeRequest(in, slaveId, *funct, starting_address,
+			range, 0, 0, NULL);
+	}
+
+	//if we have multiple register writes:
+	*funct = writeFunct[type - 1];
+	if ((*funct == 0x06) && (range > 1))
+	{
+		*funct = 0x10;
+	}
+
+	return makeRequest(in, slaveId, *funct, starting_address, range, 0, 0,
+		data);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to wait for the response to startRequest.               )
+//  --------------------------------------------------------------------------
+static int finishRequest(seaMaxModule *in, int write, seaio_type_t type,
+	address_range_t range, unsigned char *data, unsigned char funct)
+{
+	int error = 0, length = 0, expected = 0;
+
+	if (!write)
+	{
+		switch (funct)
+		{
+		case 0x01:
+		case 0x02:
+			expected = 1 + (range / 8);
+			if (range % 8 != 0) expected++;
+			break;
+		case 0x03:
+		case 0x04:
+			expected = 1 + (range * 2);
+			break;
+		case 0x45:
+			expected = 5;
+			break;
+		case 0x41:
+			expected = 15;
+			break;
+		default:
+			expected = 1;
+			break;
+		}
+
+		//Wait for a response.
+		return getResponse(in, funct, data, expected, NULL);
+	}
+
+	//Most of the responses don't even contain the data you wrote, so
+	//figure out how much we wrote based on what the user told us.
+	switch (writeFunct[type - 1])
+	{
+	case 0x06:
+		length = 2;
+		expected = 4;
+		break;
+	case 0x10:
+		length = 2;
+		expected = 4;
+		break;
+	case 0x0F:
+		length = range / 8;
+		if ((range % 8) != 0) length++;
+		expected = 4;
+		break;
+	case 0x42:
+		length = 12;
+		expected = 12;
+		break;
+	default:
+		length = 1;
+		expected = 1;
+		break;
+	}
+
+	error = getResponse(in, funct, data, expected, NULL);
+	if (error < 0) return error;
+
+	return length;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to pack an adda_config into its 5 byte wire format.     )
+//  --------------------------------------------------------------------------
+void packADDAConfig(adda_config *ptrAdda, unsigned char *buffer)
+{
+	buffer[0] = (ptrAdda->device.reference_offset << 4);
+	buffer[0] |= (ptrAdda->device.channel_mode & 0x0F);
+	buffer[1] = ((ptrAdda->channels.ch_1 & 0x03) << 6);
+	buffer[1] |= ((ptrAdda->channels.ch_2 & 0x03) << 4);
+	buffer[1] |= ((ptrAdda->channels.ch_3 & 0x03) << 2);
+	buffer[1] |= ((ptrAdda->channels.ch_4 & 0x03) << 0);
+	buffer[2] = ((ptrAdda->channels.ch_5 & 0x03) << 6);
+	buffer[2] |= ((ptrAdda->channels.ch_6 & 0x03) << 4);
+	buffer[2] |= ((ptrAdda->channels.ch_7 & 0x03) << 2);
+	buffer[2] |= ((ptrAdda->channels.ch_8 & 0x03) << 0);
+	buffer[3] = ((ptrAdda->channels.ch_9 & 0x03) << 6);
+	buffer[3] |= ((ptrAdda->channels.ch_10 & 0x03) << 4);
+	buffer[3] |= ((ptrAdda->channels.ch_11 & 0x03) << 2);
+	buffer[3] |= ((ptrAdda->channels.ch_12 & 0x03) << 0);
+	buffer[4] = ((ptrAdda->channels.ch_13 & 0x03) << 6);
+	buffer[4] |= ((ptrAdda->channels.ch_14 & 0x03) << 4);
+	buffer[4] |= ((ptrAdda->channels.ch_15 & 0x03) << 2);
+	buffer[4] |= ((ptrAdda->channels.ch_16 & 0x03) << 0);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to unpack the 5 byte wire format into an adda_config.   )
+//  --------------------------------------------------------------------------
+void unpackADDAConfig(unsigned char *buffer, adda_config *ptrAdda)
+{
+	ptrAdda->device.reference_offset = buffer[0] >> 4;
+	ptrAdda->device.channel_mode = buffer[0] & 0x0F;
+	ptrAdda->channels.ch_1 = (buffer[1] >> 6) & 0x03;
+	ptrAdda->channels.ch_2 = (buffer[1] >> 4) & 0x03;
+	ptrAdda->channels.ch_3 = (buffer[1] >> 2) & 0x03;
+	ptrAdda->channels.ch_4 = (buffer[1] >> 0) & 0x03;
+	ptrAdda->channels.ch_5 = (buffer[2] >> 6) & 0x03;
+	ptrAdda->channels.ch_6 = (buffer[2] >> 4) & 0x03;
+	ptrAdda->channels.ch_7 = (buffer[2] >> 2) & 0x03;
+	ptrAdda->channels.ch_8 = (buffer[2] >> 0) & 0x03;
+	ptrAdda->channels.ch_9 = (buffer[3] >> 6) & 0x03;
+	ptrAdda->channels.ch_10 = (buffer[3] >> 4) & 0x03;
+	ptrAdda->channels.ch_11 = (buffer[3] >> 2) & 0x03;
+	ptrAdda->channels.ch_12 = (buffer[3] >> 0) & 0x03;
+	ptrAdda->channels.ch_13 = (buffer[4] >> 6) & 0x03;
+	ptrAdda->channels.ch_14 = (buffer[4] >> 4) & 0x03;
+	ptrAdda->channels.ch_15 = (buffer[4] >> 2) & 0x03;
+	ptrAdda->channels.ch_16 = (buffer[4] >> 0) & 0x03;
+}
+
 //  --------------------------------------------------------------------------
 // ( Private extended adda config ioctl.                                      )
 //  --------------------------------------------------------------------------
@@ -513,8 +799,24 @@ SeaMaxLin *SeaMaxLinCreate()
 	SeaMaxPointer->commMode = NO_CONNECT;
 	SeaMaxPointer->hDevice = -1;
 	SeaMaxPointer->initalConfig = NULL;
+	SeaMaxPointer->transport = NULL;
+	SeaMaxPointer->link = NULL;
 	SeaMaxPointer->libftdi = NULL;
 	SeaMaxPointer->ftdic = NULL;
+	SeaMaxPointer->i2cQueue = NULL;
+	SeaMaxPointer->bitbangOutput = -1;
+	SeaMaxPointer->requestStart = 0;
+	SeaMaxPointer->requestSlave = 0;
+	SeaMaxPointer->traceId = traceNextId();
+	SeaMaxPointer->waiters = 0;
+	memset(&SeaMaxPointer->stats, 0, sizeof(SeaMaxPointer->stats));
+	memset(SeaMaxPointer->slaveStats, 0, sizeof(SeaMaxPointer->slaveStats));
+	memset(SeaMaxPointer->noReadWrite, 0, sizeof(SeaMaxPointer->noReadWrite));
+	SeaMaxPointer->turnaround = MODBUS_TURNAROUND_MS;
+	SeaMaxPointer->quietUntil = 0;
+
+	//Make the module visible to the metrics endpoint
+	metricsRegister(SeaMaxPointer);
 
 	//Cast the pointer as the type expected and return it.
 	return (SeaMaxLin*)SeaMaxPointer;
@@ -539,9 +841,15 @@ int SeaMaxLinDestroy(SeaMaxLin *SeaMaxPointer)
 	//If there isn't an object to free... don't try.
 	if (SeaMaxPointer == NULL) return 0;
 
+	//Stop reporting on it before anything is released
+	metricsUnregister(in);
+
 	//First check to make sure the malloc'd tty struct is free
 	if (in->initalConfig != NULL) free(in->initalConfig);
 
+	//Per slave statistics are allocated as slaves are addressed
+	statsFree(in);
+
 	//Free up the memory previously used.
 	free(SeaMaxPointer);
 
@@ -558,6 +866,34 @@ int SeaMaxLinDestroy(SeaMaxLin *SeaMaxPointer)
 /// If you leave out the port, 502 will be used as the default.  You may also 
 /// enter the device's DCHP name like: "sealevel_tcp://Samwise". For SeaDAC Lite
 /// modules use sealevel_d2x://xxxx where xxxx=8112 or 8115 etc..
+/// "sealevel_loop://rtu" or "sealevel_loop://tcp" opens a simulated module
+/// inside the process instead, using that framing, for tests and benchmarks
+/// without hardware.  After SeaMaxLinReactorStart, "sealevel_tcp://" modules
+/// are connected and served by the reactor's threads instead.
+///
+/// SeaDAC Lite options follow the model number, separated by '?' and '&':
+///  - i2c=rate   I2C clock of the 8126, e.g. "sealevel_d2x://8126?i2c=400k".
+///               Accepts Hz, or a k or M suffix, from 1k up to 1M.  Without
+///               it the clock used by earlier releases is kept.
+///  - int=n      ACBUS bit (4 to 7) the 8126 expanders' INT line is wired
+///               to, for \a SeaDacWaitForChange.  Defaults to 4.
+///  - serial=s   Open the module with USB serial number s.
+///  - index=n    Open the n-th module (from 0) of the model, in the order
+///               \a SeaDacEnumerate lists them.  Without serial= or index=
+///               the first module of the model found is opened.
+///  - profile=p  USB tuning: "latency" (1 ms latency timer, small transfers)
+///               for request/response use, "throughput" (16 ms, large
+///               transfers) for long sweeps, or "auto" to time the latency
+///               timers with \a SeaDacCalibrate and keep the best.  Without
+///               it libftdi's settings (16 ms) are left alone.
+///  - latency=n  USB latency timer in ms (1 to 255), overriding the profile.
+///  - reconnect=ms  How long (default 100 ms) a call that hits a USB error
+///               looks for the module to come back, by its serial number.
+///               Once reopened its mode, I2C setup, directions and last
+///               written outputs are restored and the call is tried once
+///               more.  0 turns reconnecting off.  Only modules that
+///               report a USB serial number are reconnected; without one
+///               the call fails with the USB error.
 ///
 /// \param[out] *SeaMaxPointer Pointer to a seaMaxModule object.
 /// \param[in] *filename           Filename to open.
@@ -575,26 +911,32 @@ int SeaMaxLinDestroy(SeaMaxLin *SeaMaxPointer)
 int SeaMaxLinOpen(SeaMaxLin *SeaMaxPointer, char *filename)
 {
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
-	char rtu[15] = "sealevel_rtu://", tcp[15] = "sealevel_tcp://",
-		d2x[15] = "sealevel_d2x://";
+	const seamax_transport_s *transport;
+	int index, length;
 
 	//Possible goof ups.
 	if (strlen(filename) > 256) return -ENAMETOOLONG;
 	if (SeaMaxPointer == NULL) return -EINVAL;
-	if (in->commMode != NO_CONNECT) SeaMaxLinClose(SeaMaxPointer);
-
-	//Determine which method of connection to attempt (RTU)
-	if (strncmp(filename, rtu, 15) == 0)
-		return openRTU(SeaMaxPointer, &filename[14]);
-	//TCP
-	else if (strncmp(filename, tcp, 15) == 0)
-		return openTCP(SeaMaxPointer, &filename[15]);
-	//Direct ftdi
-	else if (strncmp(filename, d2x, 15) == 0)
-		return openD2X(SeaMaxPointer, &filename[15]);
+	if (in->commMode != NO_CONNECT || in->transport != NULL)
+		SeaMaxLinClose(SeaMaxPointer);
+
+	//What the slaves support is learned afresh on each link
+	memset(in->noReadWrite, 0, sizeof(in->noReadWrite));
+
+	//Determine which method of connection to attempt
+	for (index = 0; index < sizeof(transports) / sizeof(transports[0]); index++)
+	{
+		transport = transports[index];
+		length = strlen(transport->scheme);
+		if (strncmp(filename, transport->scheme, length) != 0) continue;
+
+		//Kept even on failure, so a close releases what was opened
+		in->transport = transport;
+		return transport->open(in, &filename[length]);
+	}
+
 	//Unsupported
-	else
-		return -EINVAL;
+	return -EINVAL;
 }
 
 // ----------------------------------------------------------------------------
@@ -616,29 +958,19 @@ int SeaMaxLinClose(SeaMaxLin *SeaMaxPointer)
 	if (SeaMaxPointer == NULL) return 0;
 
 	//Don't try to close anything, if there isn't anything open...
-	if (in->hDevice > 0)
-	{
-		//Return serial line state to previous.
-		if (in->commMode == MODBUS_RTU)
-			tcsetattr(in->hDevice, TCSANOW, in->initalConfig);
+	if (in->transport == NULL) return 0;
 
-		//Close SeaDAC Lite modules if connected
-		if (in->commMode == FTDI_DIRECT)
-		{
-			closeD2X(SeaMaxPointer);
-		}
-
-		//Close the connection, TCP or RTU
-		close(in->hDevice);
+	//Close the connection, whatever its link
+	in->transport->close(in);
+	in->transport = NULL;
 
-		//Time to clean up.
-		in->throttle = 1;
-		in->mutex = 0;
-		in->commMode = NO_CONNECT;
-		in->hDevice = -1;
-		free(in->initalConfig);
-		in->initalConfig = NULL;
-	}
+	//Time to clean up.
+	in->throttle = 1;
+	in->mutex = 0;
+	in->commMode = NO_CONNECT;
+	in->hDevice = -1;
+	free(in->initalConfig);
+	in->initalConfig = NULL;
 
 	return 0;
 }
@@ -670,49 +1002,14 @@ int SeaMaxLinRead(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 	address_range_t range, void *data)
 {
 	int error = 0;
-	int expected = 0;
+	unsigned char funct = 0;
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
 
-	//Modbus function code mask.
-	unsigned char funct[6] = { 0x01, 0x02, 0x03, 0x04, 0x45, 0x41 };
-
-	//Possible goof ups.
-	if (SeaMaxPointer == NULL)  return -EBADF;
-	if (data == NULL) 	    return -EINVAL;
-	if (in->commMode == NO_CONNECT)   return -EBADF;
-
-	//Modbus wants the starting address based at 0, not 1
-	starting_address--;
-
-	//Format a valid request and send it to the module.
-	error = makeRequest(in, slaveId, funct[type - 1], starting_address,
-		range, NULL);
+	error = startRequest(in, slaveId, 0, type, starting_address, range,
+		(unsigned char*)data, &funct);
 	if (error < 0) return error;
 
-	switch (funct[type - 1])
-	{
-	case 0x01:
-	case 0x02:
-		expected = 1 + (range / 8);
-		if (range % 8 != 0) expected++;
-		break;
-	case 0x03:
-	case 0x04:
-		expected = 1 + (range * 2);
-		break;
-	case 0x45:
-		expected = 5;
-		break;
-	case 0x41:
-		expected = 15;
-		break;
-	default:
-		expected = 1;
-		break;
-	}
-
-	//Wait for a response.
-	return getResponse(in, funct[type - 1], (unsigned char*)data, expected);
+	return finishRequest(in, 0, type, range, (unsigned char*)data, funct);
 }
 
 // ----------------------------------------------------------------------------
@@ -741,64 +1038,217 @@ int SeaMaxLinWrite(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 	seaio_type_t type, address_loc_t starting_address,
 	address_range_t range, unsigned char *data)
 {
-	int error = 0, length = 0, expected = 0;
+	int error = 0;
+	unsigned char funct = 0;
 	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
 
-	//Modbus function code mask.
-	unsigned char funct[6] = { 0x0F, 0x00, 0x06, 0x00, 0x00, 0x42 };
-	unsigned char fcode = funct[type - 1];
+	error = startRequest(in, slaveId, 1, type, starting_address, range,
+		data, &funct);
+	if (error < 0) return error;
 
-	//Possible goof ups.
-	if (funct[type - 1] == 0x00)  return -EINVAL;
-	if (SeaMaxPointer == NULL)  return -EBADF;
-	if (data == NULL) 	    return -EINVAL;
-	if (in->commMode == NO_CONNECT)   return -EBADF;
+	return finishRequest(in, 1, type, range, data, funct);
+}
 
-	//Modbus wants the starting address based at 0, not 1
-	starting_address--;
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Write holding registers and read registers back in one exchange.
+/// Made for control loops that set outputs and read inputs from the same
+/// device every cycle.  The write is done first, then the read, as if by
+/// \a SeaMaxLinWrite and \a SeaMaxLinRead, but holding registers are both
+/// written and read with a single MODBUS read/write multiple registers
+/// (0x17) request: one trip over the bus instead of two.
+///
+/// Input registers can't be read by 0x17, so a read of them is always made
+/// as a write and a separate read.  So is every exchange with a device that
+/// has answered 0x17 with an illegal function exception; the module
+/// remembers those until it is opened again.
+///
+/// \param[in] *SeaMaxPointer    Pointer to an open seaMaxModule.
+/// \param[in] slaveId           Address of the device.
+/// \param[in] type              HOLDINGREG or INPUTREG, the registers to read.
+/// \param[in] read_start        Where to start the read; MODBUS is base 1.
+/// \param[in] read_range        Registers to read, at most 125.
+/// \param[out] *read_data       Buffer for the registers read.
+/// \param[in] write_start       Holding register to start the write at.
+/// \param[in] write_range       Registers to write, at most 121 (118 over
+///                              TCP, where frames are held to 255 bytes).
+/// \param[in] *write_data       Registers to write.
+///
+/// \return int      Error code.
+/// \retval >0       Number of bytes of data read.
+/// \retval -EBADF   No module open or write error.
+/// \retval -EINVAL  Null buffer, bad type or range, or too much data.
+/// \retval -ENOMEM  Low memory.
+/// \retval -ENODEV  Didn't receive response.
+/// \retval -EFAULT  MODBUS exception.  First byte of read_data contains
+///                  exception.
+// ----------------------------------------------------------------------------
+int SeaMaxLinReadWrite(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
+	seaio_type_t type, address_loc_t read_start, address_range_t read_range,
+	void *read_data, address_loc_t write_start, address_range_t write_range,
+	unsigned char *write_data)
+{
+	int error = 0;
+	unsigned char *data = (unsigned char*)read_data, exception = 0;
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
 
-	//if we have multiple register writes:
-	if ((fcode == 0x06) && (range > 1))
+	//Possible goof ups.
+	if (in == NULL) return -EBADF;
+	if (data == NULL || write_data == NULL) return -EINVAL;
+	if (type != HOLDINGREG && type != INPUTREG) return -EINVAL;
+	if (read_range < 1 || read_range > 125) return -EINVAL;
+	if (write_range < 1 || write_range > 121) return -EINVAL;
+	if (in->commMode == NO_CONNECT) return -EBADF;
+
+	if (type == HOLDINGREG &&
+		!(in->noReadWrite[slaveId / 8] & (1 << (slaveId % 8))))
 	{
-		fcode = 0x10;
+		//Modbus wants the starting addresses based at 0, not 1
+		error = makeRequest(in, slaveId, 0x17, read_start - 1, read_range,
+			write_start - 1, write_range, write_data);
+		if (error < 0) return error;
+
+		error = getResponse(in, 0x17, data, 1 + read_range * 2,
+			&exception);
+		if (exception != ILLEGAL_FUNCTION) return error;
+
+		__atomic_fetch_or(&in->noReadWrite[slaveId / 8],
+			1 << (slaveId % 8), __ATOMIC_RELAXED);
 	}
 
-	//Format a valid request and send it to the module.
-	error = makeRequest(in, slaveId, fcode, starting_address,
-		range, data);
+	//No 0x17 here: write, then read
+	error = SeaMaxLinWrite(SeaMaxPointer, slaveId, HOLDINGREG, write_start,
+		write_range, write_data);
 	if (error < 0) return error;
 
-	//Most of the responses don't even contain the data you wrote, so
-	//figure out how much we wrote based on what the user told us.
-	switch (funct[type - 1])
+	return SeaMaxLinRead(SeaMaxPointer, slaveId, type, read_start,
+		read_range, read_data);
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Write the same coils or holding registers on every device at once.
+/// The write goes out once to MODBUS address 0, which every device on a
+/// serial bus acts on, and none answer.  Nothing waits for a response, so
+/// updating many devices together takes one frame instead of a round trip
+/// each.  The bus is then left quiet for the turnaround time (see
+/// \a SeaMaxLinSetTurnaround) while the devices act on it: the next request
+/// on this module goes out no sooner.
+///
+/// Whether each device took the write can only be learned by reading it back.
+///
+/// \param[in] *SeaMaxPointer    Pointer to a seaMaxModule open on RTU.
+/// \param[in] type              COILS or HOLDINGREG.
+/// \param[in] starting_address  Where to start the write; MODBUS is base 1.
+/// \param[in] range             How many consecutive addresses to write.
+/// \param[in] *data             Pointer to data buffer.
+///
+/// \return int      Error code.
+/// \retval >0       Number of bytes of data sent.
+/// \retval -EBADF   No module open, not an RTU module, or write error.
+/// \retval -EINVAL  Null buffer, bad type or too much data in buffer.
+// ----------------------------------------------------------------------------
+int SeaMaxLinBroadcast(SeaMaxLin *SeaMaxPointer, seaio_type_t type,
+	address_loc_t starting_address, address_range_t range,
+	unsigned char *data)
+{
+	int error = 0;
+	unsigned char funct = 0;
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+
+	//Possible goof ups.  Modbus/TCP has no broadcast.
+	if (in == NULL) return -EBADF;
+	if (type != COILS && type != HOLDINGREG) return -EINVAL;
+	if (in->commMode != MODBUS_RTU) return -EBADF;
+
+	//makeRequest starts the quiet time as the frame goes out
+	error = startRequest(in, 0, 1, type, starting_address, range, data,
+		&funct);
+	if (error < 0) return error;
+
+	return (type == COILS) ? (range + 7) / 8 : range * 2;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Run many reads and writes, on many modules, together.
+/// Each module has one request at a time on the wire, taken in the order
+/// given, but every module with work left sends its next request before any
+/// response is waited for.  The time of a round is then that of the slowest
+/// module rather than the sum of them all.  With the io_uring engine (see
+/// \a SeaMaxLinSetIoBackend) a round's writes, reads and timeouts go to the
+/// kernel in one system call and its completions are collected in bulk.
+///
+/// \param[in,out] *ops  Requests to run; each one's result is set to what
+///                      \a SeaMaxLinRead or \a SeaMaxLinWrite would return.
+/// \param[in] count     Number of requests.
+///
+/// \return int     Error code.
+/// \retval >=0     Number of requests that succeeded.
+/// \retval -EINVAL Null list or negative count.
+/// \retval -ENOMEM Low memory.
+// ----------------------------------------------------------------------------
+int SeaMaxLinBatch(seamax_op_s *ops, int count)
+{
+	int *started, *state, rounds, index, other, remaining, succeeded = 0;
+	unsigned char *functs;
+
+	if (ops == NULL || count < 0) return -EINVAL;
+
+	started = malloc((count + 1) * sizeof(int));
+	state = calloc(count + 1, sizeof(int));
+	functs = malloc(count + 1);
+	if (started == NULL || state == NULL || functs == NULL)
 	{
-	case 0x06:
-		length = 2;
-		expected = 4;
-		break;
-	case 0x10:
-		length = 2;
-		expected = 4;
-		break;
-	case 0x0F:
-		length = range / 8;
-		if ((range % 8) != 0) length++;
-		expected = 4;
-		break;
-	case 0x42:
-		length = 12;
-		expected = 12;
-		break;
-	default:
-		length = 1;
-		expected = 1;
-		break;
+		free(started);
+		free(state);
+		free(functs);
+		return -ENOMEM;
 	}
 
-	error = getResponse(in, fcode, data, expected);
-	if (error < 0) return error;
+	//State: 0 waiting, 1 on the wire, 2 done
+	for (remaining = count; remaining > 0; )
+	{
+		//Send the next request of every module
+		rounds = 0;
+		for (index = 0; index < count; index++)
+		{
+			if (state[index] != 0) continue;
+			for (other = 0; other < rounds; other++)
+				if (ops[started[other]].module == ops[index].module)
+					break;
+			if (other < rounds) continue;
+
+			started[rounds++] = index;
+			ops[index].result = startRequest(
+				(seaMaxModule*)ops[index].module, ops[index].slaveId,
+				ops[index].write, ops[index].type,
+				ops[index].starting_address, ops[index].range,
+				ops[index].data, &functs[index]);
+			state[index] = (ops[index].result < 0) ? 2 : 1;
+			if (state[index] == 2) remaining--;
+		}
 
-	return length;
+		//Then collect the responses
+		for (other = 0; other < rounds; other++)
+		{
+			index = started[other];
+			if (state[index] != 1) continue;
+
+			ops[index].result = finishRequest(
+				(seaMaxModule*)ops[index].module, ops[index].write,
+				ops[index].type, ops[index].range, ops[index].data,
+				functs[index]);
+			state[index] = 2;
+			remaining--;
+			if (ops[index].result >= 0) succeeded++;
+		}
+	}
+
+	free(started);
+	free(state);
+	free(functs);
+	return succeeded;
 }
 
 // ----------------------------------------------------------------------------
@@ -858,31 +1308,14 @@ int SeaMaxLinIoctl(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 		buffer[1] = ptrIoctl->u.pio.config_state.PIO96.channel1;
 		break;
 	case 0x64:  //SET_ADDA: dev cfg-(4 bytes for 16 channels)
-		buffer[0] = (ptrAdda->device.reference_offset << 4);
-		buffer[0] |= (ptrAdda->device.channel_mode & 0x0F);
-		buffer[1] = ((ptrAdda->channels.ch_1 & 0x03) << 6);
-		buffer[1] |= ((ptrAdda->channels.ch_2 & 0x03) << 4);
-		buffer[1] |= ((ptrAdda->channels.ch_3 & 0x03) << 2);
-		buffer[1] |= ((ptrAdda->channels.ch_4 & 0x03) << 0);
-		buffer[2] = ((ptrAdda->channels.ch_5 & 0x03) << 6);
-		buffer[2] |= ((ptrAdda->channels.ch_6 & 0x03) << 4);
-		buffer[2] |= ((ptrAdda->channels.ch_7 & 0x03) << 2);
-		buffer[2] |= ((ptrAdda->channels.ch_8 & 0x03) << 0);
-		buffer[3] = ((ptrAdda->channels.ch_9 & 0x03) << 6);
-		buffer[3] |= ((ptrAdda->channels.ch_10 & 0x03) << 4);
-		buffer[3] |= ((ptrAdda->channels.ch_11 & 0x03) << 2);
-		buffer[3] |= ((ptrAdda->channels.ch_12 & 0x03) << 0);
-		buffer[4] = ((ptrAdda->channels.ch_13 & 0x03) << 6);
-		buffer[4] |= ((ptrAdda->channels.ch_14 & 0x03) << 4);
-		buffer[4] |= ((ptrAdda->channels.ch_15 & 0x03) << 2);
-		buffer[4] |= ((ptrAdda->channels.ch_16 & 0x03) << 0);
+		packADDAConfig(ptrAdda, buffer);
 		break;
 	default:
 		break;
 	}
 
 	//makeRequest
-	error = makeRequest(in, slaveId, funct[which - 1], 0, 0, buffer);
+	error = makeRequest(in, slaveId, funct[which - 1], 0, 0, 0, 0, buffer);
 	if (error < 0) return error;
 
 	//getResponse
@@ -907,7 +1340,7 @@ int SeaMaxLinIoctl(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 		break;
 	}
 
-	error = getResponse(in, funct[which - 1], buffer, expected);
+	error = getResponse(in, funct[which - 1], buffer, expected, NULL);
 	if (error < 0) return error;
 
 	//Update
@@ -930,24 +1363,7 @@ int SeaMaxLinIoctl(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 		ptrIoctl->u.pio.config_state.PIO96.channel1 = buffer[2];
 		break;
 	case 0x65:  //GET_ADDA: dev cfg-(4 bytes for 16 channel cfgs)
-		ptrAdda->device.reference_offset = buffer[0] >> 4;
-		ptrAdda->device.channel_mode = buffer[0] & 0x0F;
-		ptrAdda->channels.ch_1 = (buffer[1] >> 6) & 0x03;
-		ptrAdda->channels.ch_2 = (buffer[1] >> 4) & 0x03;
-		ptrAdda->channels.ch_3 = (buffer[1] >> 2) & 0x03;
-		ptrAdda->channels.ch_4 = (buffer[1] >> 0) & 0x03;
-		ptrAdda->channels.ch_5 = (buffer[2] >> 6) & 0x03;
-		ptrAdda->channels.ch_6 = (buffer[2] >> 4) & 0x03;
-		ptrAdda->channels.ch_7 = (buffer[2] >> 2) & 0x03;
-		ptrAdda->channels.ch_8 = (buffer[2] >> 0) & 0x03;
-		ptrAdda->channels.ch_9 = (buffer[3] >> 6) & 0x03;
-		ptrAdda->channels.ch_10 = (buffer[3] >> 4) & 0x03;
-		ptrAdda->channels.ch_11 = (buffer[3] >> 2) & 0x03;
-		ptrAdda->channels.ch_12 = (buffer[3] >> 0) & 0x03;
-		ptrAdda->channels.ch_13 = (buffer[4] >> 6) & 0x03;
-		ptrAdda->channels.ch_14 = (buffer[4] >> 4) & 0x03;
-		ptrAdda->channels.ch_15 = (buffer[4] >> 2) & 0x03;
-		ptrAdda->channels.ch_16 = (buffer[4] >> 0) & 0x03;
+		unpackADDAConfig(buffer, ptrAdda);
 		break;
 	case 0x66:  //GET_EXT_CONFIG
 		ptrIoctl->u.config.model = (buffer[0] << 8) | buffer[1];
@@ -986,6 +1402,33 @@ int SeaMaxLinSetIMDelay(SeaMaxLin *SeaMaxPointer, int delay)
 	return 0;
 }
 
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Set the turnaround delay after a broadcast.
+/// Devices don't answer a broadcast, so the bus is kept quiet for this long
+/// after one goes out, giving them time to act on it before the next request.
+/// The MODBUS serial line guide suggests 100 to 200 ms; 100 ms is the default.
+/// The delay is expected in ms.
+///
+/// \param[in] *SeaMaxPointer pointer to a seaMaxModule
+/// \param[in] delay integer representation of the number of ms to delay
+///
+/// \return int      Error code.
+/// \retval 0        Successfully set delay.
+/// \retval -EBADF   No module.
+/// \retval -EPERM   Delay must be >= 0.
+// ----------------------------------------------------------------------------
+int SeaMaxLinSetTurnaround(SeaMaxLin *SeaMaxPointer, int delay)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+
+	if (SeaMaxPointer == NULL) return -EBADF;
+	if (delay < 0) return -EPERM;
+
+	in->turnaround = delay;
+	return 0;
+}
+
 // ----------------------------------------------------------------------------
 /// \ingroup group_seamax_fun
 /// \brief Get the handle to the actual communication medium.
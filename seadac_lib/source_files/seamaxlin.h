@@ -459,6 +459,283 @@ typedef struct adda_ext_config
 	channel_range_type	da_channel_2_range;     ///< D/A2 range 
 } adda_ext_config;
 
+// ----------------------------------------------------------------------------
+// | Runtime statistics.                                                      |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// Number of buckets in a \a seamax_stats_s latency histogram.
+/// Bucket 0-3 hold 0-3us exactly; every power of two above that is split into
+/// four linear buckets, so bucket b covers [(4 + b%4) << (b/4 - 1),
+/// (5 + b%4) << (b/4 - 1)) microseconds.  The last bucket also collects
+/// anything slower than its range (about 67 seconds).
+// ----------------------------------------------------------------------------
+#define SEAMAX_STATS_BUCKETS	100
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// Pass as the slave ID to \a SeaMaxLinGetStats for the whole module.
+// ----------------------------------------------------------------------------
+#define SEAMAX_STATS_MODULE	(-1)
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief Request counters and latency histogram for a module or slave.
+/// Filled in by \a SeaMaxLinGetStats.  The library keeps one of these per
+/// module and, for Modbus connections, one per slave ID it has talked to.
+/// Counters only ever increase until \a SeaMaxLinResetStats is called.
+// ----------------------------------------------------------------------------
+typedef struct seamax_stats_s
+{
+	unsigned long long requests;        ///< Requests put on the wire.
+	unsigned long long responses;       ///< Good responses received.
+	unsigned long long exceptions;      ///< Modbus exception responses.
+	unsigned long long timeouts;        ///< Requests that got no response.
+	unsigned long long errors;          ///< Other send/receive failures.
+	unsigned long long retries;         ///< Requests sent again.
+	unsigned long long bytes_tx;        ///< Bytes written, framing included.
+	unsigned long long bytes_rx;        ///< Bytes read, framing included.
+	unsigned long long busy_ns;         ///< Time spent in exchanges (ns).
+	unsigned long long latency_count;   ///< Samples in the histogram.
+	unsigned long long latency_sum_us;  ///< Sum of all samples (us).
+	unsigned long long latency_max_us;  ///< Slowest sample (us).
+	unsigned long long latency[SEAMAX_STATS_BUCKETS]; ///< Log-linear histogram.
+} seamax_stats_s;
+
+// ----------------------------------------------------------------------------
+// | Frame trace.                                                             |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// Number of frames held by the trace ring.  Older frames are overwritten.
+// ----------------------------------------------------------------------------
+#define SEAMAX_TRACE_ENTRIES	4096
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// Number of leading frame bytes kept with each trace entry.
+// ----------------------------------------------------------------------------
+#define SEAMAX_TRACE_BYTES	44
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief Direction of a traced frame.
+// ----------------------------------------------------------------------------
+typedef enum
+{
+	SEAMAX_TRACE_TX = 0,   ///< Frame written to the module.
+	SEAMAX_TRACE_RX = 1    ///< Frame (or lack of one) read from the module.
+} seamax_trace_dir_t;
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief One frame in the trace ring and in a capture file.
+/// Entries are 64 bytes and are written to capture files as-is, in host byte
+/// order.  A failed receive is recorded as an RX entry with a negative result
+/// and whatever partial data arrived.
+// ----------------------------------------------------------------------------
+typedef struct seamax_trace_entry_s
+{
+	unsigned long long timestamp_ns;  ///< CLOCK_MONOTONIC time of the event.
+	unsigned int	module;           ///< Module number, in creation order.
+	unsigned short	length;           ///< Full frame length on the wire.
+	short		result;           ///< 0 or a negative error code.
+	unsigned char	direction;        ///< \a seamax_trace_dir_t
+	unsigned char	slave;            ///< Modbus slave ID (0 for SeaDAC Lite).
+	unsigned char	captured;         ///< Bytes of the frame held in data.
+	unsigned char	reserved;
+	unsigned char	data[SEAMAX_TRACE_BYTES]; ///< Leading frame bytes.
+} seamax_trace_entry_s;
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief Header at the start of a trace capture file.
+/// Followed by \a count entries of \a entry_size bytes, oldest first.
+// ----------------------------------------------------------------------------
+typedef struct seamax_trace_header_s
+{
+	char		magic[4];         ///< "SMTR"
+	unsigned short	version;          ///< Capture format version (1).
+	unsigned short	entry_size;       ///< sizeof(seamax_trace_entry_s)
+	unsigned int	count;            ///< Number of entries that follow.
+	unsigned int	reserved;
+} seamax_trace_header_s;
+
+// ----------------------------------------------------------------------------
+// | Modbus I/O engines and batches.                                          |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief How Modbus RTU and TCP modules do their I/O.
+/// See \a SeaMaxLinSetIoBackend.
+// ----------------------------------------------------------------------------
+typedef enum
+{
+	SEAMAX_IO_DIRECT = 0,  ///< Blocking calls per request (the default).
+	SEAMAX_IO_EPOLL	 = 1,  ///< One epoll set per thread for readiness.
+	SEAMAX_IO_URING	 = 2   ///< io_uring with registered buffers.
+} seamax_io_t;
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief One read or write in a \a SeaMaxLinBatch.
+/// The fields are the arguments of \a SeaMaxLinRead or \a SeaMaxLinWrite,
+/// and result is set to what that call would have returned.
+// ----------------------------------------------------------------------------
+typedef struct seamax_op_s
+{
+	SeaMaxLin	*module;          ///< Open Modbus module.
+	slave_address_t	slaveId;          ///< Address of the device.
+	int		write;            ///< Non-zero to write, zero to read.
+	seaio_type_t	type;             ///< The read or write type.
+	address_loc_t	starting_address; ///< Where to start; MODBUS is base 1.
+	address_range_t	range;            ///< How many consecutive addresses.
+	unsigned char	*data;            ///< Data buffer.
+	int		result;           ///< Filled in by \a SeaMaxLinBatch.
+} seamax_op_s;
+
+// ----------------------------------------------------------------------------
+// | Bit packing.                                                             |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief How coils and discrete inputs are packed and unpacked.
+/// See \a SeaMaxLinSetBitKernel.
+// ----------------------------------------------------------------------------
+typedef enum
+{
+	SEAMAX_BITS_AUTO   = 0,  ///< The fastest this processor has (default).
+	SEAMAX_BITS_SCALAR = 1,  ///< A bit at a time, on any processor.
+	SEAMAX_BITS_SSE2   = 2,  ///< Sixteen channels at a time.
+	SEAMAX_BITS_AVX2   = 3,  ///< Thirty-two channels at a time.
+	SEAMAX_BITS_BMI2   = 4   ///< Eight at a time with pdep and pext.
+} seamax_bits_t;
+
+// ----------------------------------------------------------------------------
+// | Multi-bus executor.                                                      |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \typedef SeaMaxExecutor
+/// \brief Runs requests on many buses at once, see \a SeaMaxExecutorCreate.
+// ----------------------------------------------------------------------------
+typedef struct seamax_executor_s	SeaMaxExecutor;
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief Called by an executor worker once a submitted request has run.
+/// op->result holds what \a SeaMaxLinRead or \a SeaMaxLinWrite returned.
+// ----------------------------------------------------------------------------
+typedef void (*seamax_done_t)(seamax_op_s *op, void *context);
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief How busy an executor's bus is, see \a SeaMaxExecutorBusStats.
+// ----------------------------------------------------------------------------
+typedef struct seamax_bus_stats_s
+{
+	unsigned long long completed;   ///< Requests run on the bus.
+	unsigned long long failed;      ///< Of those, ones that returned an error.
+	unsigned long long busy_ns;     ///< Time spent in exchanges (ns).
+	unsigned long long elapsed_ns;  ///< Time since the bus was added (ns).
+	unsigned int	queued;         ///< Requests waiting for the bus.
+	double		utilisation;    ///< busy_ns / elapsed_ns.
+} seamax_bus_stats_s;
+
+// ----------------------------------------------------------------------------
+// | SeaDAC Lite change events.                                               |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief An input change reported by \a SeaDacWaitForChange.
+// ----------------------------------------------------------------------------
+typedef struct seadac_pio_event_s
+{
+	unsigned long long timestamp_ns;  ///< CLOCK_MONOTONIC time INT was seen.
+	unsigned char state[4];           ///< PIO space, as \a SeaDacGetPIO.
+	unsigned char changed[4];         ///< Input bits that changed.
+} seadac_pio_event_s;
+
+// ----------------------------------------------------------------------------
+// | SeaDAC Lite discovery.                                                   |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// Longest USB serial number kept, with its terminator.
+// ----------------------------------------------------------------------------
+#define SEADAC_SERIAL_LENGTH	64
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \brief An attached module, as listed by \a SeaDacEnumerate.
+// ----------------------------------------------------------------------------
+typedef struct seadac_device_info_s
+{
+	int product;                      ///< Model number, e.g. 0x8111.
+	int index;                        ///< Position among the same model.
+	char serial[SEADAC_SERIAL_LENGTH];///< USB serial number, may be empty.
+	char description[64];             ///< USB product string.
+	char location[16];                ///< Bus and device, e.g. "001/004", may be empty.
+} seadac_device_info_s;
+
+// ----------------------------------------------------------------------------
+// | SeaDAC Lite transactions.                                                |
+// ----------------------------------------------------------------------------
+
+// ----------------------------------------------------------------------------
+/// \ingroup	group_seamax_all
+/// \typedef SeaDacTxn
+/// \brief A batch of 8126 register accesses, see \a SeaDacTxnCreate.
+// ----------------------------------------------------------------------------
+typedef struct seadac_txn_s	SeaDacTxn;
+
+// ----------------------------------------------------------------------------
+// Private
+// Transport struct.
+// A transport moves whole frames over one kind of link (serial port, socket,
+// SeaDAC Lite USB, in-process loopback).  The Modbus code above it builds and
+// parses frames but never touches a descriptor.
+// Frames are passed as pieces (count iovecs, at most FRAME_PIECES), so the
+// user's data goes to and from the link without being copied on the way.
+// send writes the pieces in order and returns the bytes written.  receive
+// scatters one response of expected data bytes over the pieces, which hold at
+// least 256 bytes between them, setting length to the bytes it got, and
+// returns 0 or an error of the link's own; an empty frame means nothing came
+// before deadline (a statsNow() time).  pollFd is -1 for links without one.
+// ----------------------------------------------------------------------------
+struct seaMaxModule;
+struct iovec;
+
+typedef struct seamax_transport_s
+{
+	const char *scheme;		//Device string prefix; the rest goes to open.
+	int (*open)(struct seaMaxModule *in, char *devName);
+	int (*send)(struct seaMaxModule *in, struct iovec *frame, int count);
+	int (*receive)(struct seaMaxModule *in, struct iovec *frame, int count,
+		int *length, int expected, unsigned long long deadline);
+	void (*close)(struct seaMaxModule *in);
+	int (*pollFd)(struct seaMaxModule *in);
+} seamax_transport_s;
+
+// How long to wait for a whole Modbus response frame
+#define MODBUS_RESPONSE_TIMEOUT_MS	1000
+
+// Default quiet time on an RTU bus after a broadcast, for slaves to act on it
+#define MODBUS_TURNAROUND_MS	100
+
+// Most pieces a frame is sent or received in
+#define FRAME_PIECES	3
+
+// Room encodeFrame needs for a frame's fixed fields
+#define FRAME_FIXED	24
+
 // ----------------------------------------------------------------------------
 // Private
 // SeaMaxModule struct.
@@ -472,9 +749,36 @@ typedef struct seaMaxModule
 	HANDLE hDevice;                 //Device comm interface.
 	int mutex;                      //Multithread (force sequential).
 	struct termios *initalConfig;   //Original serial configuration.
+	const seamax_transport_s *transport;//Link the module was opened on.
+	void *link;			//Transport's own state, if any.
 	void *libftdi;			//Library handle
 	void *ftdic;			//For SeaDAC Lite modules
 	int deviceType;
+	unsigned int i2cClock;		//Requested I2C clock (Hz), 0 for default.
+	unsigned char pioDirection[4];	//8126 direction registers (1 = input).
+	unsigned char pioOutput[4];	//8126 output registers.
+	int pioCached;			//Which of the above are known.
+	unsigned char pioLast[4];	//PIO space last reported by a change event.
+	unsigned char intPin;		//ACBUS bit wired to the expanders' INT.
+	void *i2cQueue;			//SeaDAC Lite I2C command queue.
+	char usbSerial[SEADAC_SERIAL_LENGTH];//Module to open by serial and/or ...
+	int usbIndex;			//... index among its model, -1 for any.
+	unsigned char bitbangMask;	//Bit bang models' output pins.
+	int syncBitbang;		//In synchronous bit bang mode.
+	int usbProfile;			//USB tuning asked for at open.
+	unsigned char latencyTimer;	//USB latency timer (ms), 0 if untouched.
+	int bitbangOutput;		//Bit bang pins last written, -1 if none.
+	unsigned int reconnectMs;	//Time to look for a lost module, 0 for never.
+
+	seamax_stats_s stats;		//Module totals (atomic counters).
+	seamax_stats_s *slaveStats[256];//Per slave totals, allocated on use.
+	unsigned long long requestStart;//Timestamp of the request in flight.
+	slave_address_t requestSlave;	//Slave of the request in flight.
+	unsigned int traceId;		//Module number in trace entries.
+	unsigned int waiters;		//Requests waiting for the channel.
+	unsigned char noReadWrite[32];	//Slaves refusing 0x17, a bit each.
+	unsigned int turnaround;	//Quiet time (ms) after a broadcast.
+	unsigned long long quietUntil;	//No request goes out before this.
 	
 } seaMaxModule;
 
@@ -484,6 +788,58 @@ typedef struct seaMaxModule
 int openD2X(SeaMaxLin *SeaMaxPointer, char *devName);
 void closeD2X(SeaMaxLin *SeaMaxPointer);
 
+extern const seamax_transport_s rtuTransport;
+extern const seamax_transport_s tcpTransport;
+extern const seamax_transport_s d2xTransport;
+extern const seamax_transport_s loopTransport;
+
+int ioAttach(seaMaxModule *in);
+void ioDetach(seaMaxModule *in);
+struct sockaddr_in;
+int reactorAttach(seaMaxModule *in, struct sockaddr_in *address);
+int ioSend(seaMaxModule *in, struct iovec *frame, int count);
+int ioReceive(seaMaxModule *in, struct iovec *frame, int count, int *length,
+		  int expected, unsigned long long deadline);
+
+void calc_crc(int n, unsigned char *data);
+int frameLength(const struct iovec *frame, int count);
+int frameCopy(const struct iovec *frame, int count, unsigned char *buffer,
+		  int size);
+int frameFill(const struct iovec *frame, int count,
+		  const unsigned char *buffer, int length);
+int frameSlice(const struct iovec *frame, int count, int offset, int size,
+		  struct iovec *slice);
+int rtuException(const struct iovec *frame, int count, int length);
+int encodeFrame(seaio_mode_t mode, int transaction, slave_address_t slaveId,
+		  unsigned char funct, address_loc_t start, address_range_t quan,
+		  address_loc_t writeStart, address_range_t writeQuan,
+		  unsigned char *data, unsigned char *buff, struct iovec *frame,
+		  int *count);
+int encodeRequest(seaio_mode_t mode, int transaction, slave_address_t slaveId,
+		  unsigned char funct, address_loc_t start, address_range_t quan,
+		  unsigned char *data, unsigned char *frame);
+int decodeResponse(seaio_mode_t mode, unsigned char funct,
+		  unsigned char *frame, int length, unsigned char *data);
+void packADDAConfig(adda_config *config, unsigned char *buffer);
+void unpackADDAConfig(unsigned char *buffer, adda_config *config);
+
+unsigned long long statsNow(void);
+void statsBegin(seaMaxModule *in, slave_address_t slaveId);
+void statsSent(seaMaxModule *in, int bytes);
+void statsReceived(seaMaxModule *in, int bytes, int exception);
+void statsFailed(seaMaxModule *in, int error);
+void statsRetry(seaMaxModule *in);
+void statsFree(seaMaxModule *in);
+
+void metricsRegister(seaMaxModule *in);
+void metricsUnregister(seaMaxModule *in);
+
+unsigned int traceNextId(void);
+void traceFrame(seaMaxModule *in, seamax_trace_dir_t direction,
+		  unsigned char *frame, int length, int result);
+void traceFrames(seaMaxModule *in, seamax_trace_dir_t direction,
+		  struct iovec *frame, int count, int length, int result);
+
 // ----------------------------------------------------------------------------
 // |                             API prototypes                               |
 // ----------------------------------------------------------------------------
@@ -504,14 +860,67 @@ int SeaMaxLinWrite(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 		  seaio_type_t type, address_loc_t starting_address,
 		  address_range_t range, unsigned char *data);
 
+int SeaMaxLinReadWrite(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
+		  seaio_type_t type, address_loc_t read_start,
+		  address_range_t read_range, void *read_data,
+		  address_loc_t write_start, address_range_t write_range,
+		  unsigned char *write_data);
+
+int SeaMaxLinBroadcast(SeaMaxLin *SeaMaxPointer, seaio_type_t type,
+		  address_loc_t starting_address, address_range_t range,
+		  unsigned char *data);
+
+int SeaMaxLinReadBits(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
+		  seaio_type_t type, address_loc_t starting_address,
+		  address_range_t range, unsigned char *bits);
+
+int SeaMaxLinWriteBits(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
+		  address_loc_t starting_address, address_range_t range,
+		  const unsigned char *bits);
+
+int SeaMaxLinUnpackBits(const unsigned char *packed, unsigned char *bits,
+		  int count);
+
+int SeaMaxLinPackBits(const unsigned char *bits, unsigned char *packed,
+		  int count);
+
+int SeaMaxLinSetBitKernel(seamax_bits_t kernel);
+
+int SeaMaxLinBatch(seamax_op_s *ops, int count);
+
+int SeaMaxLinSetIoBackend(seamax_io_t backend);
+
+int SeaMaxLinReactorStart(int shards);
+
+int SeaMaxLinReactorStop(void);
+
+SeaMaxExecutor *SeaMaxExecutorCreate(int workers);
+
+int SeaMaxExecutorAddBus(SeaMaxExecutor *executor, SeaMaxLin *module);
+
+int SeaMaxExecutorSubmit(SeaMaxExecutor *executor, seamax_op_s *op,
+			seamax_done_t done, void *context);
+
+int SeaMaxExecutorWait(SeaMaxExecutor *executor);
+
+int SeaMaxExecutorBusStats(SeaMaxExecutor *executor, int bus,
+			seamax_bus_stats_s *stats);
+
+int SeaMaxExecutorDestroy(SeaMaxExecutor *executor);
+
 int SeaDacLinWrite(SeaMaxLin *SeaMaxPointer, unsigned char *data, 
 			int numBytes);
 
+int SeaDacLinExchange(SeaMaxLin *SeaMaxPointer, unsigned char *out,
+			unsigned char *data, int count);
+
 int SeaMaxLinIoctl(SeaMaxLin *SeaMaxPointer, slave_address_t slaveId,
 		  IOCTL_t which, void *data);
 
 int SeaMaxLinSetIMDelay(SeaMaxLin *SeaMaxPointer, int delay);
 
+int SeaMaxLinSetTurnaround(SeaMaxLin *SeaMaxPointer, int delay);
+
 int SeaDacGetPIO(SeaMaxLin *SeaMaxPointer, unsigned char* data);
 
 int SeaDacSetPIO(SeaMaxLin *SeaMaxPointer, unsigned char* data);
@@ -520,8 +929,56 @@ int SeaDacSetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data);
 
 int SeaDacGetPIODirection(SeaMaxLin *SeaMaxPointer, unsigned char* data);
 
+int SeaDacGetInputs(SeaMaxLin *SeaMaxPointer, unsigned char* data);
+
+int SeaDacWaitForChange(SeaMaxLin *SeaMaxPointer, seadac_pio_event_s *event,
+			int timeout);
+
+int SeaDacCalibrate(SeaMaxLin *SeaMaxPointer);
+
+int SeaDacEnumerate(seadac_device_info_s *devices, int maximum);
+
+int SeaDacOpenAll(int product, const char *options, SeaMaxLin **modules,
+			int maximum);
+
+SeaDacTxn *SeaDacTxnCreate(void);
+
+int SeaDacTxnDestroy(SeaDacTxn *txn);
+
+int SeaDacTxnClear(SeaDacTxn *txn);
+
+int SeaDacTxnRead(SeaDacTxn *txn, unsigned char address, unsigned char reg,
+			unsigned char *data, int count);
+
+int SeaDacTxnWrite(SeaDacTxn *txn, unsigned char address, unsigned char reg,
+			unsigned char *data, int count);
+
+int SeaDacTxnSetGPIO(SeaDacTxn *txn, unsigned char direction,
+			unsigned char state);
+
+int SeaDacTxnExecute(SeaMaxLin *SeaMaxPointer, SeaDacTxn *txn);
+
 HANDLE SeaMaxLinGetCommHandle(SeaMaxLin *SeaMaxPointer);
 
+int SeaMaxLinGetStats(SeaMaxLin *SeaMaxPointer, int slaveId,
+		  seamax_stats_s *stats);
+
+int SeaMaxLinResetStats(SeaMaxLin *SeaMaxPointer);
+
+unsigned long long SeaMaxLinStatsQuantile(seamax_stats_s *stats, double q);
+
+int SeaMaxLinTraceEnable(int enable);
+
+int SeaMaxLinTraceSnapshot(seamax_trace_entry_s *entries, int maximum);
+
+int SeaMaxLinTraceDump(const char *filename);
+
+int SeaMaxLinMetricsFormat(char *buffer, int size);
+
+int SeaMaxLinMetricsStart(const char *address);
+
+int SeaMaxLinMetricsStop(void);
+
 
 
 // ----------------------------------------------------------------------------
@@ -549,6 +1006,8 @@ public:
 			   address_range_t range, unsigned char *data);
 
 	int Write(unsigned char *data, int length);
+
+	int Exchange(unsigned char *out, unsigned char *data, int count);
 	
 	int Ioctl(slave_address_t slaveId, IOCTL_t which, void *data);
 
@@ -562,8 +1021,18 @@ public:
 	
 	int GetPIODirection(unsigned char* data);
 	
+	int GetInputs(unsigned char* data);
+	
+	int WaitForChange(seadac_pio_event_s *event, int timeout);
+	
+	int Execute(SeaDacTxn *txn);
+	
 	HANDLE getCommHandle(void);
 
+	int GetStats(int slaveId, seamax_stats_s *stats);
+
+	int ResetStats(void);
+
 private:
 	SeaMaxLin *SeaMaxPointer;
 };
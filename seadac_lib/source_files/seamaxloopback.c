@@ -0,0 +1,303 @@
+/*
+ * seamaxloopback.c
+ * SeaMAX for Linux
+ *
+ * This code implements the loopback transport: "sealevel_loop://rtu" or
+ * "sealevel_loop://tcp" opens a simulated SeaIO module inside the process.
+ * Each request frame is answered as it is sent, with no descriptor, thread
+ * or system call involved, so the library's own cost can be measured apart
+ * from the kernel's and the wire's.
+ *
+ * The simulated module answers every slave address, and on RTU acts on
+ * broadcasts (address 0) without answering them.  It has 65536 coils and
+ * 65536 holding registers; its discrete inputs read back the coils and its
+ * input registers read back the holding registers, as if each output were
+ * wired to the matching input.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/uio.h>
+
+#include "seamaxlin.h"
+#include "seamaxprobes.h"
+
+// Model number reported by the simulated module, less 256 as on the wire
+#define LOOP_MODEL	(410 - 256)
+
+// Most bits and registers read at once, so a TCP response fits 255 bytes
+#define LOOP_MAX_BITS		1968
+#define LOOP_MAX_REGISTERS	123
+
+// Most registers 0x17 writes at once
+#define LOOP_MAX_WRITES		121
+
+// Modbus exception codes
+#define ILLEGAL_FUNCTION	0x01
+#define ILLEGAL_ADDRESS		0x02
+#define ILLEGAL_VALUE		0x03
+
+// ----------------------------------------------------------------------------
+// The simulated module, and the response waiting to be received.
+// ----------------------------------------------------------------------------
+typedef struct loop_module
+{
+	unsigned char coils[65536 / 8];
+	unsigned short registers[65536];
+	unsigned char response[256];
+	int length;			//Response bytes waiting, 0 for none.
+} loop_module;
+
+//  --------------------------------------------------------------------------
+// ( Private function to answer one request PDU (function code onwards).      )
+// The response PDU is built in reply; its length is returned.
+//  --------------------------------------------------------------------------
+static int loopAnswer(loop_module *sim, unsigned char *request, int length,
+	unsigned char *reply)
+{
+	unsigned char funct = request[0];
+	int start, quantity, index, bit, exception = 0;
+	int writeStart = 0, writeQuantity = 0;
+
+	reply[0] = funct;
+	start = (length >= 3) ? (request[1] << 8) | request[2] : 0;
+	quantity = (length >= 5) ? (request[3] << 8) | request[4] : 0;
+
+	switch (funct)
+	{
+	case 0x01:	//Read coils
+	case 0x02:	//Read discrete inputs
+		if (length < 5 || quantity < 1 || quantity > LOOP_MAX_BITS) exception = ILLEGAL_VALUE;
+		else if (start + quantity > 65536) exception = ILLEGAL_ADDRESS;
+		if (exception) break;
+
+		reply[1] = (quantity + 7) / 8;
+		memset(&reply[2], 0, reply[1]);
+		for (index = 0; index < quantity; index++)
+		{
+			bit = start + index;
+			if (sim->coils[bit / 8] & (1 << (bit % 8)))
+				reply[2 + index / 8] |= 1 << (index % 8);
+		}
+		return 2 + reply[1];
+
+	case 0x03:	//Read holding registers
+	case 0x04:	//Read input registers
+		if (length < 5 || quantity < 1 || quantity > LOOP_MAX_REGISTERS) exception = ILLEGAL_VALUE;
+		else if (start + quantity > 65536) exception = ILLEGAL_ADDRESS;
+		if (exception) break;
+
+		reply[1] = quantity * 2;
+		for (index = 0; index < quantity; index++)
+		{
+			reply[2 + index * 2] = sim->registers[start + index] >> 8;
+			reply[3 + index * 2] = sim->registers[start + index] & 0xFF;
+		}
+		return 2 + reply[1];
+
+	case 0x06:	//Write single register
+		if (length < 5)
+		{
+			exception = ILLEGAL_VALUE;
+			break;
+		}
+		sim->registers[start] = quantity;
+		memcpy(&reply[1], &request[1], 4);
+		return 5;
+
+	case 0x0F:	//Write multiple coils
+		if (length < 6 || quantity < 1 || request[5] != (quantity + 7) / 8 ||
+			length < 6 + request[5]) exception = ILLEGAL_VALUE;
+		else if (start + quantity > 65536) exception = ILLEGAL_ADDRESS;
+		if (exception) break;
+
+		for (index = 0; index < quantity; index++)
+		{
+			bit = start + index;
+			if (request[6 + index / 8] & (1 << (index % 8)))
+				sim->coils[bit / 8] |= 1 << (bit % 8);
+			else sim->coils[bit / 8] &= ~(1 << (bit % 8));
+		}
+		memcpy(&reply[1], &request[1], 4);
+		return 5;
+
+	case 0x10:	//Write multiple registers
+		if (length < 6 || quantity < 1 || request[5] != quantity * 2 ||
+			length < 6 + request[5]) exception = ILLEGAL_VALUE;
+		else if (start + quantity > 65536) exception = ILLEGAL_ADDRESS;
+		if (exception) break;
+
+		for (index = 0; index < quantity; index++)
+			sim->registers[start + index] =
+				(request[6 + index * 2] << 8) | request[7 + index * 2];
+		memcpy(&reply[1], &request[1], 4);
+		return 5;
+
+	case 0x17:	//Write, then read, multiple registers
+		if (length >= 10)
+		{
+			writeStart = (request[5] << 8) | request[6];
+			writeQuantity = (request[7] << 8) | request[8];
+		}
+		if (length < 10 || quantity < 1 || quantity > LOOP_MAX_REGISTERS ||
+			writeQuantity < 1 || writeQuantity > LOOP_MAX_WRITES ||
+			request[9] != writeQuantity * 2 || length < 10 + request[9])
+			exception = ILLEGAL_VALUE;
+		else if (start + quantity > 65536 ||
+			writeStart + writeQuantity > 65536) exception = ILLEGAL_ADDRESS;
+		if (exception) break;
+
+		for (index = 0; index < writeQuantity; index++)
+			sim->registers[writeStart + index] =
+				(request[10 + index * 2] << 8) | request[11 + index * 2];
+
+		reply[1] = quantity * 2;
+		for (index = 0; index < quantity; index++)
+		{
+			reply[2 + index * 2] = sim->registers[start + index] >> 8;
+			reply[3 + index * 2] = sim->registers[start + index] & 0xFF;
+		}
+		return 2 + reply[1];
+
+	case 0x45:	//Get parameters: model, bridge, baud, parity, cookie
+		reply[1] = LOOP_MODEL;
+		reply[2] = 0x00;
+		reply[3] = 0x04;
+		reply[4] = 0x00;
+		reply[5] = 0x00;
+		return 6;
+
+	default:
+		exception = ILLEGAL_FUNCTION;
+		break;
+	}
+
+	reply[0] = funct | 0x80;
+	reply[1] = exception;
+	return 2;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to open the simulated module.                           )
+//  --------------------------------------------------------------------------
+static int openLoop(seaMaxModule *in, char *devName)
+{
+	seaio_mode_t mode;
+
+	//The framing to simulate; RTU unless asked otherwise
+	if (*devName == '\0' || strcmp(devName, "rtu") == 0) mode = MODBUS_RTU;
+	else if (strcmp(devName, "tcp") == 0) mode = MODBUS_TCP;
+	else return -EBADF;
+
+	in->link = calloc(1, sizeof(loop_module));
+	if (in->link == NULL) return -ENOMEM;
+
+	in->commMode = mode;
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to hand a request to the simulated module.              )
+// A frame with a bad CRC or MBAP length is dropped, as a module would.
+//  --------------------------------------------------------------------------
+static int sendLoop(seaMaxModule *in, struct iovec *pieces, int count)
+{
+	loop_module *sim = (loop_module*)in->link;
+	unsigned char frame[256];
+	int header, pdu, length, sent = frameLength(pieces, count);
+
+	//The module sees the frame whole, as it would off the wire
+	sim->length = 0;
+	if (sent > sizeof(frame)) return sent;
+	length = frameCopy(pieces, count, frame, sent);
+	header = (in->commMode == MODBUS_TCP) ? 6 : 0;
+
+	if (in->commMode == MODBUS_TCP)
+	{
+		if (length < 8 || ((frame[4] << 8) | frame[5]) != length - 6)
+			return sent;
+	}
+	else
+	{
+		if (length < 4) return sent;
+		memcpy(sim->response, frame, length - 2);
+		calc_crc(length - 2, sim->response);
+		if (memcmp(&sim->response[length - 2], &frame[length - 2], 2) != 0)
+			return sent;
+		length -= 2;
+	}
+
+	//Header (MBAP or none) and slave address go back as they came
+	memcpy(sim->response, frame, header + 1);
+	pdu = loopAnswer(sim, &frame[header + 1], length - header - 1,
+		&sim->response[header + 1]);
+	sim->length = header + 1 + pdu;
+
+	if (in->commMode == MODBUS_TCP)
+	{
+		sim->response[4] = (sim->length - 6) >> 8;
+		sim->response[5] = (sim->length - 6) & 0xFF;
+	}
+	else if (frame[0] == 0) sim->length = 0;	//Broadcasts go unanswered
+	else
+	{
+		calc_crc(sim->length, sim->response);
+		sim->length += 2;
+	}
+
+	return sent;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to collect the simulated module's response.             )
+// There is nothing to wait for: the response is there or never will be.
+//  --------------------------------------------------------------------------
+static int receiveLoop(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	loop_module *sim = (loop_module*)in->link;
+
+	*length = sim->length;
+	sim->length = 0;
+	if (*length == 0) return (in->commMode == MODBUS_RTU) ? -EFAULT : 0;
+
+	SEAMAX_PROBE3(first_byte, in->traceId, in->requestSlave, *length);
+	frameFill(frame, count, sim->response, *length);
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to free the simulated module.                           )
+//  --------------------------------------------------------------------------
+static void closeLoop(seaMaxModule *in)
+{
+	free(in->link);
+	in->link = NULL;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function; the loopback has no descriptor to wait on.            )
+//  --------------------------------------------------------------------------
+static int pollFdLoop(seaMaxModule *in)
+{
+	return -1;
+}
+
+const seamax_transport_s loopTransport =
+{
+	"sealevel_loop://", openLoop, sendLoop, receiveLoop, closeLoop, pollFdLoop
+};
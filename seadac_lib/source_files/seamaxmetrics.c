@@ -0,0 +1,658 @@
+/*
+ * seamaxmetrics.c
+ * SeaMAX for Linux
+ *
+ * This code renders the module statistics kept by seamaxstats.c in the
+ * Prometheus text exposition format, and optionally serves them over HTTP
+ * on a Unix domain socket or a local TCP port from a background thread.
+ *
+ * The exporter only ever reads the atomic counters; it never takes the
+ * module channel lock, so a scrape cannot stall a request in progress.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "seamaxlin.h"
+
+// Registry of every module created, so the exporter can find them.
+static pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+static seaMaxModule **metricsModules = NULL;
+static int metricsCount = 0;
+static int metricsCapacity = 0;
+
+// Background HTTP server state.
+static pthread_t metricsThread;
+static int metricsListener = -1;
+static int metricsWake[2] = { -1, -1 };
+static char metricsPath[108];
+
+// A snapshot of one module, taken before any text is produced.
+typedef struct metrics_module
+{
+	unsigned int id;
+	seaio_mode_t mode;
+	unsigned int waiters;
+	seamax_stats_s stats;
+	int slaves;
+	unsigned char slaveIds[256];
+	seamax_stats_s *slaveStats;
+} metrics_module;
+
+// Growable text buffer.
+typedef struct metrics_text
+{
+	char *text;
+	size_t used;
+	size_t size;
+	int failed;
+} metrics_text;
+
+// Counter families exported for modules and slaves alike.
+static const struct
+{
+	const char *name;
+	const char *help;
+	size_t offset;
+} metricsCounters[] =
+{
+	{ "requests_total", "Requests put on the wire.",
+		offsetof(seamax_stats_s, requests) },
+	{ "responses_total", "Good responses received.",
+		offsetof(seamax_stats_s, responses) },
+	{ "exceptions_total", "Modbus exception responses.",
+		offsetof(seamax_stats_s, exceptions) },
+	{ "timeouts_total", "Requests that got no response.",
+		offsetof(seamax_stats_s, timeouts) },
+	{ "errors_total", "Send or receive failures.",
+		offsetof(seamax_stats_s, errors) },
+	{ "retries_total", "Requests sent again.",
+		offsetof(seamax_stats_s, retries) },
+	{ "sent_bytes_total", "Bytes written, framing included.",
+		offsetof(seamax_stats_s, bytes_tx) },
+	{ "received_bytes_total", "Bytes read, framing included.",
+		offsetof(seamax_stats_s, bytes_rx) },
+};
+
+static const double metricsQuantiles[] = { 0.5, 0.9, 0.99 };
+
+//  --------------------------------------------------------------------------
+// ( Private function to add a module to the exporter's registry.             )
+//  --------------------------------------------------------------------------
+void metricsRegister(seaMaxModule *in)
+{
+	seaMaxModule **grown;
+
+	pthread_mutex_lock(&metricsLock);
+	if (metricsCount == metricsCapacity)
+	{
+		grown = (seaMaxModule**)realloc(metricsModules,
+			(metricsCapacity + 16) * sizeof(seaMaxModule*));
+		if (grown == NULL)
+		{
+			//Not fatal; the module just won't be exported
+			pthread_mutex_unlock(&metricsLock);
+			return;
+		}
+		metricsModules = grown;
+		metricsCapacity += 16;
+	}
+	metricsModules[metricsCount++] = in;
+	pthread_mutex_unlock(&metricsLock);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to remove a module from the exporter's registry.        )
+//  --------------------------------------------------------------------------
+void metricsUnregister(seaMaxModule *in)
+{
+	int i;
+
+	pthread_mutex_lock(&metricsLock);
+	for (i = 0; i < metricsCount; i++)
+	{
+		if (metricsModules[i] == in)
+		{
+			metricsModules[i] = metricsModules[--metricsCount];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&metricsLock);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to append formatted text, growing the buffer.           )
+//  --------------------------------------------------------------------------
+static void metricsPrintf(metrics_text *out, const char *format, ...)
+{
+	va_list args;
+	char *grown;
+	int length;
+
+	if (out->failed) return;
+
+	for (;;)
+	{
+		va_start(args, format);
+		length = vsnprintf(out->text + out->used, out->size - out->used,
+			format, args);
+		va_end(args);
+
+		if (length < 0)
+		{
+			out->failed = 1;
+			return;
+		}
+		if ((size_t)length < out->size - out->used)
+		{
+			out->used += length;
+			return;
+		}
+
+		grown = (char*)realloc(out->text, out->size * 2 + length);
+		if (grown == NULL)
+		{
+			out->failed = 1;
+			return;
+		}
+		out->text = grown;
+		out->size = out->size * 2 + length;
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function naming a connection type for the mode label.           )
+//  --------------------------------------------------------------------------
+static const char *metricsMode(seaio_mode_t mode)
+{
+	switch (mode)
+	{
+	case MODBUS_RTU:	return "rtu";
+	case MODBUS_TCP:	return "tcp";
+	case FTDI_DIRECT:	return "d2x";
+	default:		return "none";
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to print one latency summary.                           )
+//  --------------------------------------------------------------------------
+static void metricsSummary(metrics_text *out, const char *name,
+	const char *labels, seamax_stats_s *stats)
+{
+	size_t q;
+
+	for (q = 0; q < sizeof(metricsQuantiles) / sizeof(*metricsQuantiles); q++)
+	{
+		metricsPrintf(out, "seamax_%s{%s,quantile=\"%g\"} %.6f\n", name,
+			labels, metricsQuantiles[q],
+			SeaMaxLinStatsQuantile(stats, metricsQuantiles[q]) / 1e6);
+	}
+	metricsPrintf(out, "seamax_%s_sum{%s} %.6f\n", name, labels,
+		stats->latency_sum_us / 1e6);
+	metricsPrintf(out, "seamax_%s_count{%s} %llu\n", name, labels,
+		stats->latency_count);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to snapshot every registered module.                    )
+//  --------------------------------------------------------------------------
+static int metricsSnapshot(metrics_module **snapshot)
+{
+	metrics_module *modules;
+	seamax_stats_s *slave;
+	seaMaxModule *in;
+	int i, id, count;
+
+	pthread_mutex_lock(&metricsLock);
+
+	count = metricsCount;
+	modules = (metrics_module*)calloc(count ? count : 1,
+		sizeof(metrics_module));
+	if (modules == NULL)
+	{
+		pthread_mutex_unlock(&metricsLock);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		in = metricsModules[i];
+		modules[i].id = in->traceId;
+		modules[i].mode = in->commMode;
+		modules[i].waiters = __atomic_load_n(&in->waiters, __ATOMIC_RELAXED);
+		SeaMaxLinGetStats((SeaMaxLin*)in, SEAMAX_STATS_MODULE,
+			&modules[i].stats);
+
+		for (id = 0; id < 256; id++)
+		{
+			slave = __atomic_load_n(&in->slaveStats[id], __ATOMIC_ACQUIRE);
+			if (slave != NULL) modules[i].slaveIds[modules[i].slaves++] = id;
+		}
+		if (modules[i].slaves == 0) continue;
+
+		modules[i].slaveStats = (seamax_stats_s*)malloc(modules[i].slaves *
+			sizeof(seamax_stats_s));
+		if (modules[i].slaveStats == NULL)
+		{
+			modules[i].slaves = 0;
+			continue;
+		}
+		for (id = 0; id < modules[i].slaves; id++)
+			SeaMaxLinGetStats((SeaMaxLin*)in, modules[i].slaveIds[id],
+				&modules[i].slaveStats[id]);
+	}
+
+	pthread_mutex_unlock(&metricsLock);
+
+	*snapshot = modules;
+	return count;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to render all metrics into a newly allocated string.    )
+//  --------------------------------------------------------------------------
+static int metricsRender(metrics_text *out)
+{
+	metrics_module *modules = NULL;
+	unsigned long long value;
+	char labels[64];
+	size_t c;
+	int i, s, count;
+
+	out->size = 4096;
+	out->used = 0;
+	out->failed = 0;
+	out->text = (char*)malloc(out->size);
+	if (out->text == NULL) return -ENOMEM;
+	out->text[0] = '\0';
+
+	count = metricsSnapshot(&modules);
+	if (count < 0)
+	{
+		free(out->text);
+		return count;
+	}
+
+	//Per module families
+	for (c = 0; c < sizeof(metricsCounters) / sizeof(*metricsCounters); c++)
+	{
+		metricsPrintf(out, "# HELP seamax_%s %s\n# TYPE seamax_%s counter\n",
+			metricsCounters[c].name, metricsCounters[c].help,
+			metricsCounters[c].name);
+		for (i = 0; i < count; i++)
+		{
+			value = *(unsigned long long*)((char*)&modules[i].stats +
+				metricsCounters[c].offset);
+			metricsPrintf(out, "seamax_%s{module=\"%u\",mode=\"%s\"} %llu\n",
+				metricsCounters[c].name, modules[i].id,
+				metricsMode(modules[i].mode), value);
+		}
+	}
+
+	metricsPrintf(out, "# HELP seamax_busy_seconds_total Time the bus spent "
+		"in exchanges; its rate is bus utilisation.\n"
+		"# TYPE seamax_busy_seconds_total counter\n");
+	for (i = 0; i < count; i++)
+		metricsPrintf(out, "seamax_busy_seconds_total{module=\"%u\",mode=\"%s\"}"
+			" %.9f\n", modules[i].id, metricsMode(modules[i].mode),
+			modules[i].stats.busy_ns / 1e9);
+
+	metricsPrintf(out, "# HELP seamax_queue_depth Requests waiting for the "
+		"module channel.\n# TYPE seamax_queue_depth gauge\n");
+	for (i = 0; i < count; i++)
+		metricsPrintf(out, "seamax_queue_depth{module=\"%u\",mode=\"%s\"} %u\n",
+			modules[i].id, metricsMode(modules[i].mode), modules[i].waiters);
+
+	metricsPrintf(out, "# HELP seamax_latency_seconds Request to response "
+		"time.\n# TYPE seamax_latency_seconds summary\n");
+	for (i = 0; i < count; i++)
+	{
+		snprintf(labels, sizeof(labels), "module=\"%u\",mode=\"%s\"",
+			modules[i].id, metricsMode(modules[i].mode));
+		metricsSummary(out, "latency_seconds", labels, &modules[i].stats);
+	}
+
+	//Per slave families (Modbus only)
+	for (c = 0; c < sizeof(metricsCounters) / sizeof(*metricsCounters); c++)
+	{
+		metricsPrintf(out, "# HELP seamax_slave_%s %s\n"
+			"# TYPE seamax_slave_%s counter\n", metricsCounters[c].name,
+			metricsCounters[c].help, metricsCounters[c].name);
+		for (i = 0; i < count; i++)
+		{
+			for (s = 0; s < modules[i].slaves; s++)
+			{
+				value = *(unsigned long long*)((char*)&modules[i].slaveStats[s]
+					+ metricsCounters[c].offset);
+				metricsPrintf(out, "seamax_slave_%s{module=\"%u\",slave=\"%u\"}"
+					" %llu\n", metricsCounters[c].name, modules[i].id,
+					modules[i].slaveIds[s], value);
+			}
+		}
+	}
+
+	metricsPrintf(out, "# HELP seamax_slave_latency_seconds Request to "
+		"response time per slave.\n"
+		"# TYPE seamax_slave_latency_seconds summary\n");
+	for (i = 0; i < count; i++)
+	{
+		for (s = 0; s < modules[i].slaves; s++)
+		{
+			snprintf(labels, sizeof(labels), "module=\"%u\",slave=\"%u\"",
+				modules[i].id, modules[i].slaveIds[s]);
+			metricsSummary(out, "slave_latency_seconds", labels,
+				&modules[i].slaveStats[s]);
+		}
+	}
+
+	for (i = 0; i < count; i++) free(modules[i].slaveStats);
+	free(modules);
+
+	if (out->failed)
+	{
+		free(out->text);
+		return -ENOMEM;
+	}
+	return (int)out->used;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Render the statistics of every module in Prometheus text format.
+/// Use this to publish metrics from an HTTP server the application already
+/// runs.  Modules are labelled with the module number used in trace entries
+/// and their connection type; Modbus slaves additionally get a slave label.
+///
+/// \param[out] *buffer  Where to store the text (null terminated).
+/// \param[in] size      Size of the buffer.
+///
+/// \return int      Length of the text, not counting the terminator.
+/// \retval -EINVAL  Null buffer.
+/// \retval -ENOMEM  Low memory.
+/// \retval -ERANGE  Buffer too small; nothing is stored.
+// ----------------------------------------------------------------------------
+int SeaMaxLinMetricsFormat(char *buffer, int size)
+{
+	metrics_text out;
+	int length;
+
+	if (buffer == NULL || size < 1) return -EINVAL;
+
+	length = metricsRender(&out);
+	if (length < 0) return length;
+
+	if (length >= size)
+	{
+		free(out.text);
+		return -ERANGE;
+	}
+
+	memcpy(buffer, out.text, length + 1);
+	free(out.text);
+	return length;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to answer one scrape on an accepted connection.         )
+//  --------------------------------------------------------------------------
+static void metricsAnswer(int client)
+{
+	char request[2048], header[160];
+	struct timeval timeout = { 1, 0 };
+	metrics_text out;
+	int length, got = 0, sent, n;
+
+	//Read (and ignore) the request, but don't let a slow client hang us,
+	//on the way in or, when it stops reading, on the way out
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	while (got < (int)sizeof(request) - 1)
+	{
+		n = recv(client, request + got, sizeof(request) - 1 - got, 0);
+		if (n <= 0) break;
+		got += n;
+		request[got] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) break;
+	}
+
+	length = metricsRender(&out);
+	if (length < 0)
+	{
+		n = snprintf(header, sizeof(header), "HTTP/1.0 500 Internal Server "
+			"Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		send(client, header, n, MSG_NOSIGNAL);
+		return;
+	}
+
+	n = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: %d\r\nConnection: close\r\n\r\n", length);
+
+	if (send(client, header, n, MSG_NOSIGNAL) == n)
+	{
+		for (sent = 0; sent < length; sent += n)
+		{
+			n = send(client, out.text + sent, length - sent, MSG_NOSIGNAL);
+			if (n <= 0) break;
+		}
+	}
+
+	free(out.text);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private thread body: accept scrapes until asked to stop.                 )
+//  --------------------------------------------------------------------------
+static void *metricsServe(void *unused)
+{
+	struct pollfd fds[2];
+	int client;
+
+	(void)unused;
+
+	fds[0].fd = metricsListener;
+	fds[0].events = POLLIN;
+	fds[1].fd = metricsWake[0];
+	fds[1].events = POLLIN;
+
+	for (;;)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (fds[1].revents) break;
+		if (!(fds[0].revents & POLLIN)) continue;
+
+		client = accept(metricsListener, NULL, NULL);
+		if (client < 0) continue;
+
+		metricsAnswer(client);
+		close(client);
+	}
+
+	return NULL;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to open the listening socket for an address string.     )
+//  --------------------------------------------------------------------------
+static int metricsListen(const char *address)
+{
+	char host[64] = "127.0.0.1", *colon;
+	struct addrinfo hints, *found;
+	struct sockaddr_un local;
+	struct stat existing;
+	int fd, one = 1;
+
+	//Unix domain socket: "unix:/path" or an absolute path
+	if (strncmp(address, "unix:", 5) == 0 || address[0] == '/')
+	{
+		if (address[0] != '/') address += 5;
+		if (strlen(address) >= sizeof(local.sun_path)) return -ENAMETOOLONG;
+
+		memset(&local, 0, sizeof(local));
+		local.sun_family = AF_UNIX;
+		strcpy(local.sun_path, address);
+
+		//Only a socket left by an earlier server is removed
+		if (lstat(address, &existing) == 0)
+		{
+			if (!S_ISSOCK(existing.st_mode)) return -EADDRINUSE;
+			unlink(address);
+		}
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) return -errno;
+		if (bind(fd, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+			listen(fd, 8) < 0)
+		{
+			close(fd);
+			return -EADDRINUSE;
+		}
+
+		strcpy(metricsPath, address);
+		return fd;
+	}
+
+	//TCP: "host:port" or ":port", localhost unless told otherwise
+	colon = strrchr(address, ':');
+	if (colon == NULL) return -EINVAL;
+	if (colon != address)
+	{
+		if ((size_t)(colon - address) >= sizeof(host)) return -ENAMETOOLONG;
+		memcpy(host, address, colon - address);
+		host[colon - address] = '\0';
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(host, colon + 1, &hints, &found) != 0) return -EINVAL;
+
+	fd = socket(found->ai_family, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		freeaddrinfo(found);
+		return -errno;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, found->ai_addr, found->ai_addrlen) < 0 || listen(fd, 8) < 0)
+	{
+		freeaddrinfo(found);
+		close(fd);
+		return -EADDRINUSE;
+	}
+
+	freeaddrinfo(found);
+	metricsPath[0] = '\0';
+	return fd;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Serve module metrics over HTTP for Prometheus to scrape.
+/// Starts a background thread answering every HTTP request with the output of
+/// \a SeaMaxLinMetricsFormat.  The address is either a Unix domain socket,
+/// "unix:/run/seamax.sock" or just "/run/seamax.sock", or a TCP endpoint,
+/// "127.0.0.1:9502" or ":9502" (which binds to localhost only).
+///
+/// \param[in] *address  Where to listen.
+///
+/// \return int          Error code.
+/// \retval 0            Server running.
+/// \retval -EBUSY       A server is already running.
+/// \retval -EINVAL      Unrecognised address.
+/// \retval -EADDRINUSE  Unable to bind the address, or a file that isn't a
+///                      socket is at the path.
+/// \retval -EAGAIN      Unable to start the server thread.
+// ----------------------------------------------------------------------------
+int SeaMaxLinMetricsStart(const char *address)
+{
+	int fd, ret;
+
+	if (address == NULL) return -EINVAL;
+	if (metricsListener >= 0) return -EBUSY;
+
+	fd = metricsListen(address);
+	if (fd < 0) return fd;
+
+	if (pipe(metricsWake) < 0)
+	{
+		ret = -errno;
+		metricsWake[0] = metricsWake[1] = -1;
+	}
+	else
+	{
+		metricsListener = fd;
+		if (pthread_create(&metricsThread, NULL, metricsServe, NULL) == 0)
+			return 0;
+		ret = -EAGAIN;
+
+		//No thread to stop, so undo the rest here
+		close(metricsWake[0]);
+		close(metricsWake[1]);
+		metricsWake[0] = metricsWake[1] = -1;
+		metricsListener = -1;
+	}
+
+	close(fd);
+	if (metricsPath[0] != '\0') unlink(metricsPath);
+	metricsPath[0] = '\0';
+	return ret;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Stop the metrics server started by \a SeaMaxLinMetricsStart.
+///
+/// \return int  Error code.
+/// \retval 0    Stopped (or was not running).
+// ----------------------------------------------------------------------------
+int SeaMaxLinMetricsStop(void)
+{
+	if (metricsListener < 0) return 0;
+
+	if (metricsWake[1] >= 0 && write(metricsWake[1], "", 1) == 1)
+		pthread_join(metricsThread, NULL);
+
+	close(metricsListener);
+	close(metricsWake[0]);
+	close(metricsWake[1]);
+	metricsListener = -1;
+	metricsWake[0] = metricsWake[1] = -1;
+
+	if (metricsPath[0] != '\0') unlink(metricsPath);
+	metricsPath[0] = '\0';
+
+	return 0;
+}
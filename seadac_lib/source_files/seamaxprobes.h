@@ -0,0 +1,63 @@
+/*
+ * seamaxprobes.h
+ * SeaMAX for Linux
+ *
+ * This code defines the static (USDT) tracepoints of the SeaMAX library.
+ * When <sys/sdt.h> (systemtap-sdt-dev) is available at build time every
+ * probe compiles to a single nop plus an ELF note, which perf and bpftrace
+ * can attach to by name under the "seamax" provider.  Without it, or when
+ * built with -DSEAMAX_NO_PROBES, the probes compile to nothing.
+ *
+ *  request_submit       (module, slave, function)   request handed in
+ *  lock_wait_begin      (module)                    waiting for the channel
+ *  lock_wait_end        (module)                    channel acquired
+ *  wire_write           (module, slave, bytes)      frame written
+ *  first_byte           (module, slave, bytes)      first response data
+ *  response_complete    (module, slave, function, result)
+ *  ftdi_transfer_begin  (module, direction, bytes)  0 = write, 1 = read
+ *  ftdi_transfer_end    (module, direction, result)
+ *  i2c_chunk_send       (module, command bytes, response bytes, reads)
+ *                                                   one chunk of an I2C queue
+ *  i2c_queue_execute    (module, command bytes, response bytes, result)
+ *                                                   whole I2C queue answered
+ *  reconnect_begin      (module, model)             lost SeaDAC Lite reopening
+ *  reconnect_end        (module, result)
+ *
+ * The module argument is the module number used in trace entries.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#ifndef SEAMAXPROBES_H__
+#define SEAMAXPROBES_H__
+
+#if !defined(SEAMAX_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SEAMAX_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef SEAMAX_HAVE_PROBES
+#define SEAMAX_PROBE1(name, a)		DTRACE_PROBE1(seamax, name, a)
+#define SEAMAX_PROBE2(name, a, b)	DTRACE_PROBE2(seamax, name, a, b)
+#define SEAMAX_PROBE3(name, a, b, c)	DTRACE_PROBE3(seamax, name, a, b, c)
+#define SEAMAX_PROBE4(name, a, b, c, d)	DTRACE_PROBE4(seamax, name, a, b, c, d)
+#else
+#define SEAMAX_PROBE1(name, a)			do { } while (0)
+#define SEAMAX_PROBE2(name, a, b)		do { } while (0)
+#define SEAMAX_PROBE3(name, a, b, c)		do { } while (0)
+#define SEAMAX_PROBE4(name, a, b, c, d)		do { } while (0)
+#endif
+
+#endif //SEAMAXPROBES_H__
@@ -0,0 +1,702 @@
+/*
+ * seamaxreactor.c
+ * SeaMAX for Linux
+ *
+ * This code implements the Modbus/TCP reactor: a few event loop threads, one
+ * per core by default, that between them own the connections of every TCP
+ * module opened while the reactor runs.  Each module belongs to one loop (its
+ * shard).  A call on the module hands its request frame to that shard through
+ * a lock-free queue and sleeps until the shard has the response, so any
+ * number of modules can be driven from a handful of threads; SeaMaxLinBatch
+ * keeps them all busy at once.
+ *
+ * The shard does the socket work: a non-blocking connect the first time a
+ * module is used, writes, reads, response timeouts, and tearing down and
+ * remaking a connection that failed or timed out.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "seamaxlin.h"
+#include "seamaxprobes.h"
+
+// How often a shard looks for requests past their deadline
+#define REACTOR_SCAN_MS		10
+
+// epoll events taken per wait
+#define REACTOR_EVENTS		256
+
+// What a queued node asks of the shard
+#define REACTOR_REQUEST		0
+#define REACTOR_CLOSE		1
+
+// Completion word values: waiting, waiting with a sleeper, done
+#define REACTOR_PENDING		0
+#define REACTOR_SLEEPING	1
+#define REACTOR_DONE		2
+
+struct reactor_conn;
+struct reactor_shard;
+
+// ----------------------------------------------------------------------------
+// An entry in a shard's queue.  Callers push, the shard takes them all at once.
+// ----------------------------------------------------------------------------
+typedef struct reactor_node
+{
+	struct reactor_node *next;
+	int kind;
+	struct reactor_conn *conn;
+} reactor_node;
+
+// ----------------------------------------------------------------------------
+// A module's connection, owned by its shard, and its request in flight.  The
+// caller fills the request before queueing it and reads the response once
+// done is set; in between only the shard touches them.
+// ----------------------------------------------------------------------------
+typedef struct reactor_conn
+{
+	reactor_node requestNode, closeNode;
+	struct reactor_shard *shard;
+	struct sockaddr_in address;
+	int fd;				//-1 until connected.
+	int connected;			//Connect has completed.
+	unsigned int events;		//epoll events asked for.
+	int busy;			//A request is in flight.
+	struct reactor_conn *prev, *next;//Shard's list of busy connections.
+
+	unsigned char tx[256];
+	int txLength, txDone;
+	unsigned char rx[256];
+	int rxLength;
+	int result;			//0, or the link error.
+	unsigned long long deadline;
+	int done;			//REACTOR_PENDING, _SLEEPING or _DONE.
+	int closed;			//Likewise, for a close.
+} reactor_conn;
+
+// ----------------------------------------------------------------------------
+// One event loop and its share of the connections.
+// ----------------------------------------------------------------------------
+typedef struct reactor_shard
+{
+	pthread_t thread;
+	int epollFd;
+	int wakeFd;			//eventfd the queue rings.
+	reactor_node *queue;		//Pushed newest first.
+	reactor_conn *busy;		//Requests in flight.
+	int stopping;
+} reactor_shard;
+
+static pthread_mutex_t reactorLock = PTHREAD_MUTEX_INITIALIZER;
+static reactor_shard *reactorShards = NULL;
+static int reactorCount = 0;
+static int reactorAttached = 0;
+static unsigned int reactorNext = 0;
+
+//  --------------------------------------------------------------------------
+// ( Private functions to sleep on and wake a completion word.                )
+//  --------------------------------------------------------------------------
+static void reactorWait(int *word)
+{
+	int expected = REACTOR_PENDING, spins;
+
+	//The shard is often done already, or nearly
+	for (spins = 0; spins < 100; spins++)
+		if (__atomic_load_n(word, __ATOMIC_ACQUIRE) == REACTOR_DONE) return;
+
+	__atomic_compare_exchange_n(word, &expected, REACTOR_SLEEPING, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	while (__atomic_load_n(word, __ATOMIC_ACQUIRE) != REACTOR_DONE)
+		syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, REACTOR_SLEEPING,
+			NULL, NULL, 0);
+}
+
+static void reactorWake(int *word)
+{
+	if (__atomic_exchange_n(word, REACTOR_DONE, __ATOMIC_ACQ_REL) ==
+		REACTOR_SLEEPING)
+		syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to queue a node for a shard, from any thread.           )
+// Only a push onto an empty queue rings the shard; it takes the whole queue
+// when it wakes.
+//  --------------------------------------------------------------------------
+static void reactorPush(reactor_shard *shard, reactor_node *node)
+{
+	reactor_node *head = __atomic_load_n(&shard->queue, __ATOMIC_RELAXED);
+	unsigned long long ring = 1;
+
+	do
+	{
+		node->next = head;
+	} while (!__atomic_compare_exchange_n(&shard->queue, &head, node, 1,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	if (head == NULL && write(shard->wakeFd, &ring, sizeof(ring)) < 0)
+		return;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to change the epoll events a connection waits for.      )
+//  --------------------------------------------------------------------------
+static void connEvents(reactor_conn *conn, unsigned int events)
+{
+	struct epoll_event event;
+
+	if (conn->events == events) return;
+
+	memset(&event, 0, sizeof(event));
+	event.events = events;
+	event.data.ptr = conn;
+	epoll_ctl(conn->shard->epollFd, EPOLL_CTL_MOD, conn->fd, &event);
+	conn->events = events;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to hand a finished request back to its caller.          )
+//  --------------------------------------------------------------------------
+static void connFinish(reactor_conn *conn, int result)
+{
+	reactor_shard *shard = conn->shard;
+
+	if (!conn->busy) return;
+	conn->busy = 0;
+	if (conn->prev != NULL) conn->prev->next = conn->next;
+	else shard->busy = conn->next;
+	if (conn->next != NULL) conn->next->prev = conn->prev;
+	conn->prev = conn->next = NULL;
+
+	conn->result = result;
+	reactorWake(&conn->done);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to tear a connection down; the next request remakes it. )
+//  --------------------------------------------------------------------------
+static void connDrop(reactor_conn *conn)
+{
+	if (conn->fd >= 0) close(conn->fd);
+	conn->fd = -1;
+	conn->connected = 0;
+	conn->events = 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to start a non-blocking connect.                        )
+//  --------------------------------------------------------------------------
+static int connOpen(reactor_conn *conn)
+{
+	struct epoll_event event;
+	int one = 1;
+
+	conn->fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		IPPROTO_TCP);
+	if (conn->fd < 0) return -EBADF;
+	setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (connect(conn->fd, (struct sockaddr*)&conn->address,
+		sizeof(conn->address)) == 0) conn->connected = 1;
+	else if (errno != EINPROGRESS)
+	{
+		connDrop(conn);
+		return -EBADF;
+	}
+
+	memset(&event, 0, sizeof(event));
+	conn->events = conn->connected ? EPOLLIN : EPOLLIN | EPOLLOUT;
+	event.events = conn->events;
+	event.data.ptr = conn;
+	if (epoll_ctl(conn->shard->epollFd, EPOLL_CTL_ADD, conn->fd, &event) < 0)
+	{
+		connDrop(conn);
+		return -EBADF;
+	}
+
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to write what is left of the request.                   )
+//  --------------------------------------------------------------------------
+static void connWrite(reactor_conn *conn)
+{
+	int sent;
+
+	while (conn->txDone < conn->txLength)
+	{
+		sent = send(conn->fd, &conn->tx[conn->txDone],
+			conn->txLength - conn->txDone, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			connEvents(conn, EPOLLIN | EPOLLOUT);
+			return;
+		}
+		if (sent <= 0)
+		{
+			connDrop(conn);
+			connFinish(conn, -EBADF);
+			return;
+		}
+		conn->txDone += sent;
+	}
+
+	connEvents(conn, EPOLLIN);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to read from a connection.                              )
+// A response is complete once the length in its MBAP header has arrived.
+// Anything arriving with no request in flight is stale and dropped.
+//  --------------------------------------------------------------------------
+static void connRead(reactor_conn *conn)
+{
+	unsigned char stale[256];
+	int incoming, total;
+
+	for (;;)
+	{
+		if (conn->busy)
+			incoming = recv(conn->fd, &conn->rx[conn->rxLength],
+				sizeof(conn->rx) - conn->rxLength, MSG_DONTWAIT);
+		else incoming = recv(conn->fd, stale, sizeof(stale), MSG_DONTWAIT);
+
+		if (incoming < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+
+		//Closed by the module: a request in flight got no answer
+		if (incoming <= 0)
+		{
+			connDrop(conn);
+			connFinish(conn, 0);
+			return;
+		}
+		if (!conn->busy) continue;
+
+		conn->rxLength += incoming;
+		total = (conn->rxLength >= 6) ?
+			6 + ((conn->rx[4] << 8) | conn->rx[5]) : sizeof(conn->rx);
+		if (conn->rxLength >= total || conn->rxLength >= sizeof(conn->rx))
+		{
+			connFinish(conn, 0);
+			return;
+		}
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to act on a connection's epoll events.                  )
+//  --------------------------------------------------------------------------
+static void connEvent(reactor_conn *conn, unsigned int events)
+{
+	int error = 0;
+	socklen_t size = sizeof(error);
+
+	if (!conn->connected)
+	{
+		getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &size);
+		if (error != 0)
+		{
+			connDrop(conn);
+			connFinish(conn, -EBADF);
+			return;
+		}
+		conn->connected = 1;
+		connEvents(conn, EPOLLIN);
+	}
+
+	if (conn->busy && conn->txDone < conn->txLength) connWrite(conn);
+	if (conn->fd >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		connRead(conn);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to take up a queued request.                            )
+//  --------------------------------------------------------------------------
+static void connRequest(reactor_conn *conn)
+{
+	reactor_shard *shard = conn->shard;
+
+	conn->busy = 1;
+	conn->prev = NULL;
+	conn->next = shard->busy;
+	if (shard->busy != NULL) shard->busy->prev = conn;
+	shard->busy = conn;
+
+	if (conn->fd < 0 && connOpen(conn) < 0)
+	{
+		connFinish(conn, -EBADF);
+		return;
+	}
+	if (conn->connected) connWrite(conn);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to end requests past their deadline.                    )
+// The connection goes too, so a late answer can't be taken for the next one.
+//  --------------------------------------------------------------------------
+static void shardExpire(reactor_shard *shard)
+{
+	unsigned long long now = statsNow();
+	reactor_conn *conn, *next;
+
+	for (conn = shard->busy; conn != NULL; conn = next)
+	{
+		next = conn->next;
+		if (now < conn->deadline) continue;
+		conn->rxLength = 0;
+		connDrop(conn);
+		connFinish(conn, 0);
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to take everything queued, oldest first.                )
+//  --------------------------------------------------------------------------
+static void shardDrain(reactor_shard *shard)
+{
+	reactor_node *node, *next, *ordered = NULL;
+	unsigned long long rings;
+
+	if (read(shard->wakeFd, &rings, sizeof(rings)) < 0) rings = 0;
+
+	node = __atomic_exchange_n(&shard->queue, NULL, __ATOMIC_ACQUIRE);
+	for (; node != NULL; node = next)
+	{
+		next = node->next;
+		node->next = ordered;
+		ordered = node;
+	}
+
+	for (node = ordered; node != NULL; node = next)
+	{
+		//The node may be reused as soon as its caller is woken
+		next = node->next;
+		if (node->kind == REACTOR_REQUEST)
+		{
+			connRequest(node->conn);
+			continue;
+		}
+
+		connFinish(node->conn, -EBADF);
+		connDrop(node->conn);
+		reactorWake(&node->conn->closed);
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function run by each shard's thread.                             )
+//  --------------------------------------------------------------------------
+static void *shardLoop(void *data)
+{
+	reactor_shard *shard = (reactor_shard*)data;
+	struct epoll_event events[REACTOR_EVENTS];
+	unsigned long long nextScan = 0, now;
+	int count, index, rung;
+
+	while (!__atomic_load_n(&shard->stopping, __ATOMIC_ACQUIRE))
+	{
+		count = epoll_wait(shard->epollFd, events, REACTOR_EVENTS,
+			(shard->busy != NULL) ? REACTOR_SCAN_MS : -1);
+
+		//The queue comes last, as a close frees its connection
+		rung = 0;
+		for (index = 0; index < count; index++)
+		{
+			if (events[index].data.ptr == NULL) rung = 1;
+			else connEvent((reactor_conn*)events[index].data.ptr,
+				events[index].events);
+		}
+		if (rung) shardDrain(shard);
+
+		now = statsNow();
+		if (shard->busy != NULL && now >= nextScan)
+		{
+			shardExpire(shard);
+			nextScan = now + REACTOR_SCAN_MS * 1000000ULL;
+		}
+	}
+
+	return NULL;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to queue a module's request frame with its shard.       )
+//  --------------------------------------------------------------------------
+static int sendReactor(seaMaxModule *in, struct iovec *frame, int count)
+{
+	reactor_conn *conn = (reactor_conn*)in->link;
+	int length = frameLength(frame, count);
+
+	if (length > sizeof(conn->tx)) return -EINVAL;
+
+	frameCopy(frame, count, conn->tx, length);
+	conn->txLength = length;
+	conn->txDone = 0;
+	conn->rxLength = 0;
+	conn->result = 0;
+	conn->deadline = statsNow() + MODBUS_RESPONSE_TIMEOUT_MS * 1000000ULL;
+	__atomic_store_n(&conn->done, REACTOR_PENDING, __ATOMIC_RELEASE);
+
+	reactorPush(conn->shard, &conn->requestNode);
+	return length;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to wait for the shard to finish the request.            )
+// The shard enforces the deadline, so the wait always ends.
+//  --------------------------------------------------------------------------
+static int receiveReactor(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	reactor_conn *conn = (reactor_conn*)in->link;
+
+	reactorWait(&conn->done);
+
+	*length = conn->rxLength;
+	if (*length > 0)
+	{
+		SEAMAX_PROBE3(first_byte, in->traceId, in->requestSlave, *length);
+		frameFill(frame, count, conn->rx, *length);
+	}
+	return conn->result;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to have the shard drop a module's connection.           )
+//  --------------------------------------------------------------------------
+static void closeReactor(seaMaxModule *in)
+{
+	reactor_conn *conn = (reactor_conn*)in->link;
+
+	if (conn == NULL) return;
+
+	__atomic_store_n(&conn->closed, REACTOR_PENDING, __ATOMIC_RELEASE);
+	reactorPush(conn->shard, &conn->closeNode);
+	reactorWait(&conn->closed);
+	free(conn);
+	in->link = NULL;
+
+	pthread_mutex_lock(&reactorLock);
+	reactorAttached--;
+	pthread_mutex_unlock(&reactorLock);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function; the descriptor belongs to the shard.                   )
+//  --------------------------------------------------------------------------
+static int pollFdReactor(seaMaxModule *in)
+{
+	return -1;
+}
+
+// Put in place of tcpTransport by reactorAttach; never opened by name
+static const seamax_transport_s reactorTransport =
+{
+	"sealevel_tcp://", NULL, sendReactor, receiveReactor, closeReactor,
+	pollFdReactor
+};
+
+//  --------------------------------------------------------------------------
+// ( Private function to give a TCP module being opened to a shard.           )
+// Returns 1 with no reactor running, for the caller to connect itself.  The
+// connection is made by the shard when the module is first used.
+//  --------------------------------------------------------------------------
+int reactorAttach(seaMaxModule *in, struct sockaddr_in *address)
+{
+	reactor_conn *conn;
+
+	pthread_mutex_lock(&reactorLock);
+	if (reactorCount == 0)
+	{
+		pthread_mutex_unlock(&reactorLock);
+		return 1;
+	}
+
+	conn = calloc(1, sizeof(reactor_conn));
+	if (conn == NULL)
+	{
+		pthread_mutex_unlock(&reactorLock);
+		return -ENOMEM;
+	}
+	conn->shard = &reactorShards[reactorNext++ % reactorCount];
+	reactorAttached++;
+	pthread_mutex_unlock(&reactorLock);
+
+	conn->address = *address;
+	conn->fd = -1;
+	conn->requestNode.kind = REACTOR_REQUEST;
+	conn->requestNode.conn = conn;
+	conn->closeNode.kind = REACTOR_CLOSE;
+	conn->closeNode.conn = conn;
+
+	in->link = conn;
+	in->transport = &reactorTransport;
+	in->commMode = MODBUS_TCP;
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to stop and free the shards started so far.             )
+//  --------------------------------------------------------------------------
+static void reactorFree(int started)
+{
+	unsigned long long ring = 1;
+	int index;
+
+	for (index = 0; index < started; index++)
+	{
+		__atomic_store_n(&reactorShards[index].stopping, 1, __ATOMIC_RELEASE);
+		if (write(reactorShards[index].wakeFd, &ring, sizeof(ring)) < 0)
+			continue;
+	}
+	for (index = 0; index < started; index++)
+		pthread_join(reactorShards[index].thread, NULL);
+
+	for (index = 0; index < reactorCount; index++)
+	{
+		if (reactorShards[index].epollFd >= 0)
+			close(reactorShards[index].epollFd);
+		if (reactorShards[index].wakeFd >= 0)
+			close(reactorShards[index].wakeFd);
+	}
+	free(reactorShards);
+	reactorShards = NULL;
+	reactorCount = 0;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Start the Modbus/TCP reactor.
+/// Starts shards event loop threads, each pinned to a core where the system
+/// allows it.  Every "sealevel_tcp://" module opened from then on belongs to
+/// one shard, in turn, which connects it when it is first used, does all of
+/// its socket I/O, ends requests that pass the response timeout, and
+/// reconnects after a failure.  The calling thread sleeps while its request
+/// is out, so with \a SeaMaxLinBatch a single thread can poll thousands of
+/// modules.  Modules opened before the call keep their own sockets.
+///
+/// \param[in] shards  Event loops to run; 0 or less for one per core.
+///
+/// \return int     Error code.
+/// \retval >0      Number of event loops started.
+/// \retval -EBUSY  The reactor is already running.
+/// \retval -ENOMEM Low memory.
+/// \retval -EAGAIN Unable to start a thread.
+// ----------------------------------------------------------------------------
+int SeaMaxLinReactorStart(int shards)
+{
+	struct epoll_event event;
+	cpu_set_t cpus;
+	int index, ret = 0;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cores < 1) cores = 1;
+	if (shards <= 0) shards = cores;
+
+	pthread_mutex_lock(&reactorLock);
+	if (reactorCount != 0)
+	{
+		pthread_mutex_unlock(&reactorLock);
+		return -EBUSY;
+	}
+
+	reactorShards = calloc(shards, sizeof(reactor_shard));
+	if (reactorShards == NULL)
+	{
+		pthread_mutex_unlock(&reactorLock);
+		return -ENOMEM;
+	}
+	reactorCount = shards;
+	for (index = 0; index < shards; index++)
+		reactorShards[index].epollFd = reactorShards[index].wakeFd = -1;
+
+	for (index = 0; index < shards && ret == 0; index++)
+	{
+		reactor_shard *shard = &reactorShards[index];
+
+		shard->epollFd = epoll_create1(EPOLL_CLOEXEC);
+		shard->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+		if (shard->epollFd < 0 || shard->wakeFd < 0 ||
+			epoll_ctl(shard->epollFd, EPOLL_CTL_ADD, shard->wakeFd, &event) < 0)
+		{
+			ret = -ENOMEM;
+			break;
+		}
+
+		if (pthread_create(&shard->thread, NULL, shardLoop, shard) != 0)
+		{
+			ret = -EAGAIN;
+			break;
+		}
+
+		CPU_ZERO(&cpus);
+		CPU_SET(index % cores, &cpus);
+		pthread_setaffinity_np(shard->thread, sizeof(cpus), &cpus);
+	}
+
+	if (ret < 0)
+	{
+		reactorFree(index);
+		pthread_mutex_unlock(&reactorLock);
+		return ret;
+	}
+
+	pthread_mutex_unlock(&reactorLock);
+	return shards;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Stop the Modbus/TCP reactor.
+/// Every module opened on it must be closed first.
+///
+/// \return int     Error code.
+/// \retval 0       Stopped, or was not running.
+/// \retval -EBUSY  Modules are still open on the reactor.
+// ----------------------------------------------------------------------------
+int SeaMaxLinReactorStop(void)
+{
+	pthread_mutex_lock(&reactorLock);
+	if (reactorAttached > 0)
+	{
+		pthread_mutex_unlock(&reactorLock);
+		return -EBUSY;
+	}
+
+	reactorFree(reactorCount);
+	pthread_mutex_unlock(&reactorLock);
+	return 0;
+}
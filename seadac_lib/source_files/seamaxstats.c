@@ -0,0 +1,343 @@
+/*
+ * seamaxstats.c
+ * SeaMAX for Linux
+ *
+ * This code keeps per module and per slave runtime statistics: request and
+ * byte counters plus a log-linear latency histogram.  Everything on the I/O
+ * path is a relaxed atomic add, so no lock is ever taken to count.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <termios.h>
+
+#include "seamaxlin.h"
+
+#define STAT_ADD(field, amount) \
+	__atomic_fetch_add(&(field), (amount), __ATOMIC_RELAXED)
+
+//  --------------------------------------------------------------------------
+// ( Private function returning a monotonic timestamp in nanoseconds.        )
+//  --------------------------------------------------------------------------
+unsigned long long statsNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function mapping a latency in microseconds to its bucket.        )
+//  --------------------------------------------------------------------------
+static int statsBucket(unsigned long long us)
+{
+	int msb, bucket;
+
+	if (us < 4) return (int)us;
+
+	msb = 63 - __builtin_clzll(us);
+	bucket = (msb - 1) * 4 + (int)((us >> (msb - 2)) & 3);
+
+	return (bucket < SEAMAX_STATS_BUCKETS) ? bucket : SEAMAX_STATS_BUCKETS - 1;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function returning the exclusive upper bound of a bucket (us).   )
+//  --------------------------------------------------------------------------
+static unsigned long long statsBucketLimit(int bucket)
+{
+	if (bucket < 4) return bucket + 1;
+
+	return (unsigned long long)(5 + (bucket & 3)) << (bucket / 4 - 1);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function returning the slave's counters, allocating on first use )
+// Only Modbus connections have slaves; SeaDAC Lite modules count per module.
+//  --------------------------------------------------------------------------
+static seamax_stats_s *statsSlave(seaMaxModule *in, slave_address_t slaveId)
+{
+	seamax_stats_s *slave, *expected = NULL;
+
+	if (in->commMode == FTDI_DIRECT) return NULL;
+
+	slave = __atomic_load_n(&in->slaveStats[slaveId], __ATOMIC_ACQUIRE);
+	if (slave != NULL) return slave;
+
+	slave = (seamax_stats_s*)calloc(1, sizeof(seamax_stats_s));
+	if (slave == NULL) return NULL;
+
+	//Another thread may have beaten us to it; use theirs in that case.
+	if (!__atomic_compare_exchange_n(&in->slaveStats[slaveId], &expected,
+		slave, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		free(slave);
+		slave = expected;
+	}
+
+	return slave;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to add a latency sample to one set of counters.         )
+//  --------------------------------------------------------------------------
+static void statsLatency(seamax_stats_s *stats, unsigned long long us)
+{
+	unsigned long long max = __atomic_load_n(&stats->latency_max_us,
+		__ATOMIC_RELAXED);
+
+	STAT_ADD(stats->latency[statsBucket(us)], 1);
+	STAT_ADD(stats->latency_count, 1);
+	STAT_ADD(stats->latency_sum_us, us);
+
+	while (us > max && !__atomic_compare_exchange_n(&stats->latency_max_us,
+		&max, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to mark the start of a request/response exchange.       )
+//  --------------------------------------------------------------------------
+void statsBegin(seaMaxModule *in, slave_address_t slaveId)
+{
+	in->requestSlave = slaveId;
+	in->requestStart = statsNow();
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to count a request that made it onto the wire.          )
+//  --------------------------------------------------------------------------
+void statsSent(seaMaxModule *in, int bytes)
+{
+	seamax_stats_s *slave = statsSlave(in, in->requestSlave);
+
+	STAT_ADD(in->stats.requests, 1);
+	STAT_ADD(in->stats.bytes_tx, bytes);
+
+	if (slave != NULL)
+	{
+		STAT_ADD(slave->requests, 1);
+		STAT_ADD(slave->bytes_tx, bytes);
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to count a response, good or exception, and its time.   )
+//  --------------------------------------------------------------------------
+void statsReceived(seaMaxModule *in, int bytes, int exception)
+{
+	seamax_stats_s *slave = statsSlave(in, in->requestSlave);
+	unsigned long long ns = statsNow() - in->requestStart;
+
+	if (exception) STAT_ADD(in->stats.exceptions, 1);
+	else STAT_ADD(in->stats.responses, 1);
+	STAT_ADD(in->stats.bytes_rx, bytes);
+	STAT_ADD(in->stats.busy_ns, ns);
+	statsLatency(&in->stats, ns / 1000);
+
+	if (slave != NULL)
+	{
+		if (exception) STAT_ADD(slave->exceptions, 1);
+		else STAT_ADD(slave->responses, 1);
+		STAT_ADD(slave->bytes_rx, bytes);
+		STAT_ADD(slave->busy_ns, ns);
+		statsLatency(slave, ns / 1000);
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to count a failed exchange.                             )
+// A missing or short response (-EFAULT, -ENODEV) is a timeout, anything else
+// is an error.
+//  --------------------------------------------------------------------------
+void statsFailed(seaMaxModule *in, int error)
+{
+	seamax_stats_s *slave = statsSlave(in, in->requestSlave);
+	unsigned long long ns = statsNow() - in->requestStart;
+	int timeout = (error == -EFAULT || error == -ENODEV);
+
+	//A timed out request held the bus just as long as a good one
+	if (timeout) STAT_ADD(in->stats.timeouts, 1);
+	else STAT_ADD(in->stats.errors, 1);
+	STAT_ADD(in->stats.busy_ns, ns);
+
+	if (slave != NULL)
+	{
+		if (timeout) STAT_ADD(slave->timeouts, 1);
+		else STAT_ADD(slave->errors, 1);
+		STAT_ADD(slave->busy_ns, ns);
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to count a request that had to be sent again.          )
+//  --------------------------------------------------------------------------
+void statsRetry(seaMaxModule *in)
+{
+	seamax_stats_s *slave = statsSlave(in, in->requestSlave);
+
+	STAT_ADD(in->stats.retries, 1);
+	if (slave != NULL) STAT_ADD(slave->retries, 1);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to release the per slave counters.                      )
+//  --------------------------------------------------------------------------
+void statsFree(seaMaxModule *in)
+{
+	int i;
+
+	for (i = 0; i < 256; i++)
+	{
+		free(in->slaveStats[i]);
+		in->slaveStats[i] = NULL;
+	}
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to copy a set of counters without tearing any of them.  )
+//  --------------------------------------------------------------------------
+static void statsCopy(seamax_stats_s *to, seamax_stats_s *from)
+{
+	unsigned long long *dst = (unsigned long long*)to;
+	unsigned long long *src = (unsigned long long*)from;
+	size_t i;
+
+	for (i = 0; i < sizeof(seamax_stats_s) / sizeof(*src); i++)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to zero a set of counters.                              )
+//  --------------------------------------------------------------------------
+static void statsZero(seamax_stats_s *stats)
+{
+	unsigned long long *dst = (unsigned long long*)stats;
+	size_t i;
+
+	for (i = 0; i < sizeof(seamax_stats_s) / sizeof(*dst); i++)
+		__atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Retrieve runtime statistics for a module or one of its slaves.
+/// Takes a snapshot of the request, byte, error and latency counters kept
+/// for the module.  Each counter is read atomically, but the snapshot as a
+/// whole is not taken under a lock, so counters may be a few requests apart
+/// if I/O is running on another thread.
+///
+/// \param[in] *SeaMaxPointer  Pointer to a seaMaxModule.
+/// \param[in] slaveId         Slave ID (0-255) or SEAMAX_STATS_MODULE.
+/// \param[out] *stats         Where to store the snapshot.
+///
+/// \return int      Error code.
+/// \retval 0        Success.
+/// \retval -EBADF   No module.
+/// \retval -EINVAL  Null buffer or slave ID out of range.
+///
+/// \note SeaDAC Lite modules only keep module totals.  A slave that has never
+/// been addressed reads back as all zeros.
+// ----------------------------------------------------------------------------
+int SeaMaxLinGetStats(SeaMaxLin *SeaMaxPointer, int slaveId,
+	seamax_stats_s *stats)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	seamax_stats_s *slave;
+
+	if (SeaMaxPointer == NULL) return -EBADF;
+	if (stats == NULL) return -EINVAL;
+	if (slaveId < SEAMAX_STATS_MODULE || slaveId > 255) return -EINVAL;
+
+	if (slaveId == SEAMAX_STATS_MODULE)
+	{
+		statsCopy(stats, &in->stats);
+		return 0;
+	}
+
+	slave = __atomic_load_n(&in->slaveStats[slaveId], __ATOMIC_ACQUIRE);
+	if (slave != NULL) statsCopy(stats, slave);
+	else memset(stats, 0, sizeof(seamax_stats_s));
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Zero all runtime statistics of a module and its slaves.
+///
+/// \param[in] *SeaMaxPointer  Pointer to a seaMaxModule.
+///
+/// \return int      Error code.
+/// \retval 0        Success.
+/// \retval -EBADF   No module.
+// ----------------------------------------------------------------------------
+int SeaMaxLinResetStats(SeaMaxLin *SeaMaxPointer)
+{
+	seaMaxModule *in = (seaMaxModule*)SeaMaxPointer;
+	seamax_stats_s *slave;
+	int i;
+
+	if (SeaMaxPointer == NULL) return -EBADF;
+
+	statsZero(&in->stats);
+	for (i = 0; i < 256; i++)
+	{
+		slave = __atomic_load_n(&in->slaveStats[i], __ATOMIC_ACQUIRE);
+		if (slave != NULL) statsZero(slave);
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Estimate a latency quantile from a statistics snapshot.
+/// Walks the histogram of a \a seamax_stats_s filled in by
+/// \a SeaMaxLinGetStats and returns the upper bound of the bucket holding the
+/// requested quantile.  With four buckets per power of two the answer is
+/// within 25% of the true value.
+///
+/// \param[in] *stats  Snapshot to examine.
+/// \param[in] q       Quantile, from 0.0 to 1.0 (0.99 for p99).
+///
+/// \return unsigned long long  Latency in microseconds, 0 if no samples.
+// ----------------------------------------------------------------------------
+unsigned long long SeaMaxLinStatsQuantile(seamax_stats_s *stats, double q)
+{
+	unsigned long long rank, limit, seen = 0;
+	int bucket;
+
+	if (stats == NULL || stats->latency_count == 0) return 0;
+	if (q < 0.0) q = 0.0;
+	if (q > 1.0) q = 1.0;
+
+	rank = (unsigned long long)(q * stats->latency_count);
+	if (rank >= stats->latency_count) rank = stats->latency_count - 1;
+
+	for (bucket = 0; bucket < SEAMAX_STATS_BUCKETS; bucket++)
+	{
+		seen += stats->latency[bucket];
+		if (seen > rank) break;
+	}
+
+	//The last bucket is open ended, and no bucket goes past the slowest.
+	limit = statsBucketLimit(bucket);
+	if (bucket >= SEAMAX_STATS_BUCKETS - 1 || limit > stats->latency_max_us)
+		return stats->latency_max_us;
+	return limit;
+}
@@ -0,0 +1,218 @@
+/*
+ * seamaxtrace.c
+ * SeaMAX for Linux
+ *
+ * This code implements the frame trace ring: a fixed size, process wide
+ * record of every frame sent to or received from a module, which can be
+ * dumped to a compact capture file when a bus misbehaves.
+ *
+ * Writers claim a slot with a single atomic increment and publish it with a
+ * per slot sequence number, so recording never blocks and never allocates.
+ * Readers copy a slot and discard it if its sequence moved while copying.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/uio.h>
+
+#include "seamaxlin.h"
+
+#define TRACE_MASK	(SEAMAX_TRACE_ENTRIES - 1)
+
+#if (SEAMAX_TRACE_ENTRIES & TRACE_MASK) != 0
+#error SEAMAX_TRACE_ENTRIES must be a power of two
+#endif
+
+// A slot is stable when its sequence is even and non-zero.
+typedef struct trace_slot
+{
+	unsigned long long sequence;
+	seamax_trace_entry_s entry;
+} trace_slot;
+
+static trace_slot traceRing[SEAMAX_TRACE_ENTRIES];
+static unsigned long long traceHead = 0;
+static unsigned int traceModules = 0;
+static int traceEnabled = 1;
+
+//  --------------------------------------------------------------------------
+// ( Private function handing out module numbers for trace entries.           )
+//  --------------------------------------------------------------------------
+unsigned int traceNextId(void)
+{
+	return __atomic_fetch_add(&traceModules, 1, __ATOMIC_RELAXED);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to record a frame in the trace ring.                    )
+//  --------------------------------------------------------------------------
+void traceFrame(seaMaxModule *in, seamax_trace_dir_t direction,
+	unsigned char *frame, int length, int result)
+{
+	unsigned long long timestamp, index;
+	trace_slot *slot;
+
+	if (!__atomic_load_n(&traceEnabled, __ATOMIC_RELAXED)) return;
+	if (length < 0) length = 0;
+
+	timestamp = statsNow();
+	index = __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED);
+	slot = &traceRing[index & TRACE_MASK];
+
+	//Odd sequence marks the slot as being written
+	__atomic_store_n(&slot->sequence, 2 * index + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->entry.timestamp_ns = timestamp;
+	slot->entry.module = in->traceId;
+	slot->entry.length = length;
+	slot->entry.result = result;
+	slot->entry.direction = direction;
+	slot->entry.slave = in->requestSlave;
+	slot->entry.captured = (length < SEAMAX_TRACE_BYTES) ?
+		length : SEAMAX_TRACE_BYTES;
+	slot->entry.reserved = 0;
+	if (frame != NULL) memcpy(slot->entry.data, frame, slot->entry.captured);
+	else slot->entry.captured = 0;
+
+	__atomic_store_n(&slot->sequence, 2 * index + 2, __ATOMIC_RELEASE);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to record a frame held in pieces; length bytes of it.   )
+//  --------------------------------------------------------------------------
+void traceFrames(seaMaxModule *in, seamax_trace_dir_t direction,
+	struct iovec *frame, int count, int length, int result)
+{
+	unsigned char lead[SEAMAX_TRACE_BYTES];
+
+	if (!__atomic_load_n(&traceEnabled, __ATOMIC_RELAXED)) return;
+
+	frameCopy(frame, count, lead,
+		(length < SEAMAX_TRACE_BYTES) ? length : SEAMAX_TRACE_BYTES);
+	traceFrame(in, direction, lead, length, result);
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Turn frame tracing on or off.
+/// Tracing is on by default.  Recording a frame costs one clock read, one
+/// atomic increment and a copy of at most \a SEAMAX_TRACE_BYTES bytes.
+///
+/// \param[in] enable  Non-zero to record frames, zero to stop.
+///
+/// \return int  The previous setting.
+// ----------------------------------------------------------------------------
+int SeaMaxLinTraceEnable(int enable)
+{
+	return __atomic_exchange_n(&traceEnabled, enable ? 1 : 0,
+		__ATOMIC_RELAXED);
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Copy the most recent frames out of the trace ring.
+/// Entries are returned oldest first.  Entries being written while the copy
+/// is taken are skipped rather than returned half written.
+///
+/// \param[out] *entries  Where to store the entries.
+/// \param[in] maximum    Number of entries there is room for.
+///
+/// \return int      Number of entries stored.
+/// \retval -EINVAL  Null buffer.
+// ----------------------------------------------------------------------------
+int SeaMaxLinTraceSnapshot(seamax_trace_entry_s *entries, int maximum)
+{
+	unsigned long long head, index, first, before, after;
+	trace_slot *slot;
+	int count = 0;
+
+	if (entries == NULL || maximum < 0) return -EINVAL;
+
+	head = __atomic_load_n(&traceHead, __ATOMIC_ACQUIRE);
+	first = (head > SEAMAX_TRACE_ENTRIES) ? head - SEAMAX_TRACE_ENTRIES : 0;
+	if (head - first > (unsigned long long)maximum) first = head - maximum;
+
+	for (index = first; index < head; index++)
+	{
+		slot = &traceRing[index & TRACE_MASK];
+
+		before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if (before != 2 * index + 2) continue;
+
+		memcpy(&entries[count], &slot->entry, sizeof(seamax_trace_entry_s));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+		if (after == before) count++;
+	}
+
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+/// \ingroup group_seamax_fun
+/// \brief Write the trace ring to a capture file.
+/// The file holds a \a seamax_trace_header_s followed by the entries, oldest
+/// first.  Use the seamaxtrace tool to decode it.  Recording carries on while
+/// the dump is taken.
+///
+/// \param[in] *filename  Capture file to create (overwritten if present).
+///
+/// \return int      Number of entries written.
+/// \retval -EINVAL  Null filename.
+/// \retval -ENOMEM  Low memory.
+/// \retval -EIO     Unable to create or write the file.
+// ----------------------------------------------------------------------------
+int SeaMaxLinTraceDump(const char *filename)
+{
+	seamax_trace_header_s header;
+	seamax_trace_entry_s *entries;
+	FILE *capture;
+	int count, ok;
+
+	if (filename == NULL) return -EINVAL;
+
+	entries = (seamax_trace_entry_s*)malloc(SEAMAX_TRACE_ENTRIES *
+		sizeof(seamax_trace_entry_s));
+	if (entries == NULL) return -ENOMEM;
+
+	count = SeaMaxLinTraceSnapshot(entries, SEAMAX_TRACE_ENTRIES);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "SMTR", 4);
+	header.version = 1;
+	header.entry_size = sizeof(seamax_trace_entry_s);
+	header.count = count;
+
+	capture = fopen(filename, "wb");
+	if (capture == NULL)
+	{
+		free(entries);
+		return -EIO;
+	}
+
+	ok = fwrite(&header, sizeof(header), 1, capture) == 1;
+	if (ok && count > 0)
+		ok = fwrite(entries, sizeof(seamax_trace_entry_s), count, capture)
+			== (size_t)count;
+	if (fclose(capture) != 0) ok = 0;
+
+	free(entries);
+	return ok ? count : -EIO;
+}
@@ -0,0 +1,257 @@
+/*
+ * seamaxtransport.c
+ * SeaMAX for Linux
+ *
+ * This code implements the serial (RTU) and socket (TCP) transports: opening
+ * the link and moving whole Modbus frames over it.  Framing itself is left to
+ * encodeFrame and decodeResponse.  Frames go straight between the link and
+ * their pieces with vectored reads and writes, so the data being written is
+ * never copied on the way.  A module opened while an I/O engine is chosen (see
+ * seamaxio.c) has its frames moved by that engine instead.
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "seamaxlin.h"
+#include "seamaxprobes.h"
+
+//  --------------------------------------------------------------------------
+// ( Private function to open a SeaIO device using serial                     )
+//  --------------------------------------------------------------------------
+static int openRTU(seaMaxModule *in, char *devName)
+{
+	struct termios newtio;
+
+	//Quick test to make sure nothing is already opened
+	if (in->hDevice > 0) return -EBUSY;
+
+	//Open device for reading and writing, and not control tty.  (CTRL-C)
+	in->hDevice = open(devName, O_RDWR | O_NOCTTY);
+	if (in->hDevice < 0) return -EBADF;
+
+	//Save the current serial line configuration.
+	in->initalConfig = (struct termios*) malloc(sizeof(struct termios));
+	if (in->initalConfig == NULL) return -ENOMEM;
+	if (tcgetattr(in->hDevice, in->initalConfig) < 0) return -EPERM;
+	bzero(&newtio, sizeof(newtio));
+
+	//9600 Baud, 8 data bits, local use, and readable
+	newtio.c_cflag = B9600 | CS8 | CLOCAL | CREAD;
+
+	//IGNPAR  : ignore bytes with parity errors
+	newtio.c_iflag = IGNPAR;
+
+	//Raw output.
+	newtio.c_oflag = 0;
+
+	//ICANON  : enable canonical input
+	newtio.c_lflag = 0;
+
+	//1/10 second timeout VERY IMPORTANT
+	newtio.c_cc[VTIME] = 1;
+	newtio.c_cc[VMIN] = 0;
+
+	//clean line and activate settings
+	tcflush(in->hDevice, TCIFLUSH);
+	if (tcsetattr(in->hDevice, TCSANOW, &newtio) < 0) return -EXDEV;
+
+	//if we got this far without any errors, it's ok to update local data
+	in->commMode = MODBUS_RTU;
+
+	return ioAttach(in);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to write a frame to the serial port.                   )
+//  --------------------------------------------------------------------------
+static int sendRTU(seaMaxModule *in, struct iovec *frame, int count)
+{
+	if (in->link != NULL) return ioSend(in, frame, count);
+	return writev(in->hDevice, frame, count);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to read a response from the serial port.               )
+// The port returns whatever arrived within 1/10 second of the last byte, so
+// reads go on until the frame (slave, function, data and CRC) is complete, or
+// is a whole exception response.
+//  --------------------------------------------------------------------------
+static int receiveRTU(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	struct iovec rest[FRAME_PIECES];
+	int incoming, pieces;
+
+	if (in->link != NULL)
+		return ioReceive(in, frame, count, length, expected, deadline);
+
+	*length = 0;
+	while (*length < expected + 4)
+	{
+		pieces = frameSlice(frame, count, *length, expected + 4 - *length,
+			rest);
+		incoming = (pieces > 0) ? readv(in->hDevice, rest, pieces) : 0;
+		if (incoming <= 0 || statsNow() > deadline) return -EFAULT;
+
+		if (*length == 0)
+			SEAMAX_PROBE3(first_byte, in->traceId, in->requestSlave,
+				incoming);
+
+		usleep(1000 * in->throttle);
+		*length += incoming;
+		if (*length >= 220) return -ENOMEM;
+		if (rtuException(frame, count, *length)) break;
+	}
+
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to put the serial port back and close it.              )
+//  --------------------------------------------------------------------------
+static void closeRTU(seaMaxModule *in)
+{
+	ioDetach(in);
+	if (in->hDevice <= 0) return;
+
+	//Return serial line state to previous.
+	if (in->initalConfig != NULL)
+		tcsetattr(in->hDevice, TCSANOW, in->initalConfig);
+	close(in->hDevice);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function returning the descriptor of a serial or socket link.    )
+//  --------------------------------------------------------------------------
+static int pollFdHandle(seaMaxModule *in)
+{
+	return in->hDevice;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to open a SeaIO device using sockets                    )
+//  --------------------------------------------------------------------------
+static int openTCP(seaMaxModule *in, char *devName)
+{
+	char *passed;
+	char port[6] = "502";
+	struct hostent *host;
+	struct sockaddr_in sockinfo;
+	int ret;
+
+	//Quick test to make sure nothing is already opened
+	if (in->hDevice > 0) return -EBUSY;
+
+	//Get the port number if one was supplied, otherwise default to 502
+	if ((passed = strpbrk(devName, ":")) != NULL)
+	{
+		passed[0] = 0;                //clear the ':'
+		memcpy(port, &passed[1], 5);  //update the port variable
+	}
+
+	//Get host address from the name or address provided
+	if ((host = gethostbyname(devName)) == NULL) return -EBADF;
+
+	//Prepare and make connection.
+	memset(&sockinfo, 0, sizeof(sockinfo));
+	sockinfo.sin_family = AF_INET;
+	sockinfo.sin_addr.s_addr = *(long*)host->h_addr_list[0];
+	sockinfo.sin_port = htons(atoi(port));
+
+	//With the reactor running, its shard connects when the module is used
+	if ((ret = reactorAttach(in, &sockinfo)) <= 0) return ret;
+
+	//Open socket.
+	in->hDevice = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (in->hDevice < 0) return -EBUSY;
+
+	if (connect(in->hDevice, (struct sockaddr*) &sockinfo,
+		sizeof(sockinfo)) < 0) return -1;
+
+	//If we get here, it's ok to update local data.
+	in->commMode = MODBUS_TCP;
+
+	return ioAttach(in);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to write a frame to the socket.                        )
+//  --------------------------------------------------------------------------
+static int sendTCP(seaMaxModule *in, struct iovec *frame, int count)
+{
+	if (in->link != NULL) return ioSend(in, frame, count);
+	return writev(in->hDevice, frame, count);
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to read a response from the socket.                    )
+// A Modbus/TCP response arrives as one segment, so a single receive is taken
+// once the socket is readable.
+//  --------------------------------------------------------------------------
+static int receiveTCP(seaMaxModule *in, struct iovec *frame, int count,
+	int *length, int expected, unsigned long long deadline)
+{
+	struct pollfd ready = { in->hDevice, POLLIN, 0 };
+	unsigned long long now = statsNow();
+	struct iovec first[FRAME_PIECES];
+
+	if (in->link != NULL)
+		return ioReceive(in, frame, count, length, expected, deadline);
+
+	*length = 0;
+	if (now >= deadline ||
+		poll(&ready, 1, (deadline - now + 999999) / 1000000) <= 0)
+		return 0;
+
+	*length = readv(in->hDevice, first,
+		frameSlice(frame, count, 0, 255, first));
+	if (*length > 0)
+		SEAMAX_PROBE3(first_byte, in->traceId, in->requestSlave, *length);
+	else *length = 0;
+
+	return 0;
+}
+
+//  --------------------------------------------------------------------------
+// ( Private function to close the socket.                                   )
+//  --------------------------------------------------------------------------
+static void closeTCP(seaMaxModule *in)
+{
+	ioDetach(in);
+	if (in->hDevice > 0) close(in->hDevice);
+}
+
+// The serial device path keeps the last '/' of "sealevel_rtu://"
+const seamax_transport_s rtuTransport =
+{
+	"sealevel_rtu:/", openRTU, sendRTU, receiveRTU, closeRTU, pollFdHandle
+};
+
+const seamax_transport_s tcpTransport =
+{
+	"sealevel_tcp://", openTCP, sendTCP, receiveTCP, closeTCP, pollFdHandle
+};
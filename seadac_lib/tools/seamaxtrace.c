@@ -0,0 +1,105 @@
+/*
+ * seamaxtrace.c
+ * SeaMAX for Linux
+ *
+ * This tool decodes a frame trace capture written by SeaMaxLinTraceDump()
+ * and prints one line per frame.
+ *
+ * Build from this directory with:
+ *   gcc -O2 -I../source_files -o seamaxtrace seamaxtrace.c
+ *
+ * Usage: ./seamaxtrace [-m module] capture.smtr
+ *
+ * Sealevel and SeaMAX are registered trademarks of Sealevel Systems
+ * Incorporated.
+ *
+ * (c) 2008-2017 Sealevel Systems, Inc.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Lesser GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 3 of the License, or (at your option) any later version.
+ * LGPL v3
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+
+#include "seamaxlin.h"
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-m module] capture\n", name);
+	exit(2);
+}
+
+int main(int argc, char * argv[])
+{
+	seamax_trace_header_s header;
+	seamax_trace_entry_s entry;
+	unsigned long long first = 0;
+	long module = -1;
+	unsigned int n;
+	int i, arg = 1;
+	FILE *capture;
+
+	if (argc > 2 && strcmp(argv[1], "-m") == 0)
+	{
+		module = atol(argv[2]);
+		arg = 3;
+	}
+	if (arg != argc - 1) usage(argv[0]);
+
+	capture = fopen(argv[arg], "rb");
+	if (capture == NULL)
+	{
+		perror(argv[arg]);
+		return 1;
+	}
+
+	if (fread(&header, sizeof(header), 1, capture) != 1 ||
+		memcmp(header.magic, "SMTR", 4) != 0)
+	{
+		fprintf(stderr, "%s: not a SeaMAX trace capture\n", argv[arg]);
+		return 1;
+	}
+	if (header.version != 1 || header.entry_size != sizeof(entry))
+	{
+		fprintf(stderr, "%s: unsupported capture version %u (entry %u)\n",
+			argv[arg], header.version, header.entry_size);
+		return 1;
+	}
+
+	printf("%u frames\n", header.count);
+
+	for (n = 0; n < header.count; n++)
+	{
+		if (fread(&entry, sizeof(entry), 1, capture) != 1)
+		{
+			fprintf(stderr, "%s: truncated after %u frames\n", argv[arg], n);
+			return 1;
+		}
+		if (n == 0) first = entry.timestamp_ns;
+		if (module >= 0 && entry.module != (unsigned long)module) continue;
+
+		//A damaged capture can claim more bytes than an entry holds
+		if (entry.captured > SEAMAX_TRACE_BYTES)
+			entry.captured = SEAMAX_TRACE_BYTES;
+
+		printf("%12.6f  mod %-3u %s slave %-3u len %-4u %-12s",
+			(entry.timestamp_ns - first) / 1e9, entry.module,
+			(entry.direction == SEAMAX_TRACE_TX) ? "TX" : "RX",
+			entry.slave, entry.length,
+			(entry.result == 0) ? "ok" : strerror(-entry.result));
+
+		for (i = 0; i < entry.captured; i++) printf(" %02X", entry.data[i]);
+		if (entry.captured < entry.length) printf(" ...");
+		printf("\n");
+	}
+
+	fclose(capture);
+	return 0;
+}